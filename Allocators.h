@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory_resource>
+
+const size_t DEFAULT_FRAME_ARENA_BYTES{ 64 * 1024 };
+
+/*
+* FrameArena
+*
+* A linear allocator for data which only lives for part of a frame - query results, command buffers
+* and the like. Allocation is a pointer bump inside one block taken from the upstream resource and
+* deallocation only counts down the live allocations. Once nothing allocated from the arena is alive
+* it rewinds to the start of its block.
+*
+* If a frame needs more than the block holds, the extra requests are passed upstream and remembered.
+* On the next rewind they are released and the block is regrown to the peak usage, so after the
+* busiest frame has been seen the arena never touches the upstream resource again.
+*/
+class FrameArena : public std::pmr::memory_resource
+{
+private:
+	struct Overflow
+	{
+		void* p;
+		size_t bytes;
+		size_t alignment;
+	};
+
+	std::pmr::memory_resource* m_upstream{ nullptr };
+	char* m_block{ nullptr };
+	size_t m_capacity{ 0 };
+	size_t m_offset{ 0 };
+	size_t m_live{ 0 };
+	size_t m_peak{ 0 };
+	size_t m_overflow_bytes{ 0 };
+	std::pmr::vector<Overflow> m_overflow;
+
+	void rewind() {
+		/* Releases any overflow allocations and grows the block to cover the peak usage. */
+		for (auto& overflow : m_overflow) {
+			m_upstream->deallocate(overflow.p, overflow.bytes, overflow.alignment);
+		}
+		m_overflow.clear();
+		m_overflow_bytes = 0;
+
+		if (m_peak > m_capacity) {
+			auto capacity = m_capacity > 0 ? m_capacity : 1;
+			while (capacity < m_peak) {
+				capacity *= 2;
+			}
+			m_upstream->deallocate(m_block, m_capacity, alignof(std::max_align_t));
+			m_block = static_cast<char*>(m_upstream->allocate(capacity, alignof(std::max_align_t)));
+			m_capacity = capacity;
+		}
+
+		m_offset = 0;
+		m_peak = 0;
+	}
+
+protected:
+	virtual void* do_allocate(size_t bytes, size_t alignment) override {
+		auto base = reinterpret_cast<uintptr_t>(m_block);
+		auto aligned = ((base + m_offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base;
+
+		void* p{ nullptr };
+		if (aligned + bytes <= m_capacity) {
+			p = m_block + aligned;
+			m_offset = aligned + bytes;
+		}
+		else {
+			p = m_upstream->allocate(bytes, alignment);
+			m_overflow.push_back({ p, bytes, alignment });
+			m_overflow_bytes += bytes + alignment;
+		}
+
+		m_live++;
+		if (m_offset + m_overflow_bytes > m_peak) {
+			m_peak = m_offset + m_overflow_bytes;
+		}
+		return p;
+	}
+
+	virtual void do_deallocate(void*, size_t, size_t) override {
+		/* Memory is only handed back by rewinding, once everything allocated has been released. */
+		if (m_live > 0 && --m_live == 0) {
+			rewind();
+		}
+	}
+
+	virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+		return this == &other;
+	}
+
+public:
+	FrameArena(size_t capacity = DEFAULT_FRAME_ARENA_BYTES,
+		std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) :
+		m_upstream(upstream), m_capacity(capacity), m_overflow(upstream) {
+		m_block = static_cast<char*>(m_upstream->allocate(m_capacity, alignof(std::max_align_t)));
+	};
+
+	~FrameArena() {
+		for (auto& overflow : m_overflow) {
+			m_upstream->deallocate(overflow.p, overflow.bytes, overflow.alignment);
+		}
+		m_upstream->deallocate(m_block, m_capacity, alignof(std::max_align_t));
+	};
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void reset() {
+		/* Rewinds the arena at the end of a frame. Allocations which are still alive are left untouched. */
+		if (m_live == 0) {
+			rewind();
+		}
+	}
+
+	inline size_t capacity() const {
+		return m_capacity;
+	}
+
+	inline size_t used() const {
+		return m_offset + m_overflow_bytes;
+	}
+};
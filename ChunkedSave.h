@@ -0,0 +1,266 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <istream>
+#include <ostream>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+#include "Compression.h"
+
+/*
+* Chunked saves
+*
+* World::SaveChunked writes the World as a series of independent blocks rather than one stream. There
+* is a block for the entity table and the pending KillAfter timers, and each component is split into
+* blocks of at most elements_per_block components, each holding those components, their lengths and
+* the entity ids they belong to. A component's blocks come in order and cover its slots exactly. The
+* sparse arrays aren't saved at all, they are rebuilt from the entity ids. Each block is compressed on
+* its own (see Compression.h) unless that doesn't make it smaller.
+*
+*	"ECSC" | version | number of components | block | block | ... | end block
+*	block: kind | codec | component | first | count | total | raw size | stored size | data
+*
+* Because no block depends on another, blocks are encoded and decoded on several threads at once. They
+* are streamed a window of a few blocks per thread at a time, so neither side holds the whole file in
+* memory. Components are identified by their position in the list given to SaveChunked and
+* LoadChunked, which must be the same.
+*/
+
+const uint32_t CHUNKED_SAVE_MAGIC{ 0x43534345 }; // "ECSC"
+const uint32_t CHUNKED_SAVE_VERSION{ 3 };
+const uint16_t DEFAULT_ELEMENTS_PER_BLOCK{ 4096 };
+const size_t BLOCKS_PER_THREAD{ 2 };
+
+enum class BlockKind : uint8_t { WORLD, COMPONENT, END };
+enum class BlockCodec : uint8_t { NONE, LZ };
+
+struct BlockHeader
+{
+	BlockKind kind{ BlockKind::END };
+	BlockCodec codec{ BlockCodec::NONE };
+	uint16_t section{ 0 };
+	// the components in the block are pool slots [first, first + count) of total.
+	uint32_t first{ 0 };
+	uint32_t count{ 0 };
+	uint32_t total{ 0 };
+	uint32_t raw_size{ 0 };
+	uint32_t stored_size{ 0 };
+};
+
+struct SaveBlock
+{
+	BlockHeader header;
+	std::string raw;
+	std::vector<char> stored;
+};
+
+struct ChunkedSaveOptions
+{
+	bool compress{ true };
+	uint16_t elements_per_block{ DEFAULT_ELEMENTS_PER_BLOCK };
+	// 0 uses every hardware thread.
+	unsigned threads{ 0 };
+};
+
+inline unsigned ChunkedSaveThreads(const unsigned threads) {
+	return threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+inline void AppendUint16(std::string& raw, const uint16_t x) {
+	/* Block contents are little endian. */
+	raw.push_back(static_cast<char>(x & 0xFF));
+	raw.push_back(static_cast<char>(x >> 8));
+}
+
+inline void AppendUint32(std::string& raw, const uint32_t x) {
+	for (int i = 0; i < 4; i++) {
+		raw.push_back(static_cast<char>((x >> (i * 8)) & 0xFF));
+	}
+}
+
+inline uint16_t ReadUint16(const char* buffer, size_t& offset) {
+	auto x = static_cast<uint16_t>(static_cast<uint8_t>(buffer[offset]) | (static_cast<uint8_t>(buffer[offset + 1]) << 8));
+	offset += 2;
+	return x;
+}
+
+inline uint32_t ReadUint32(const char* buffer, size_t& offset) {
+	uint32_t x{ 0 };
+	for (int i = 0; i < 4; i++) {
+		x |= static_cast<uint32_t>(static_cast<uint8_t>(buffer[offset + i])) << (i * 8);
+	}
+	offset += 4;
+	return x;
+}
+
+inline void WriteBlockHeader(std::ostream& out, const BlockHeader& header) {
+	std::string raw;
+	raw.push_back(static_cast<char>(header.kind));
+	raw.push_back(static_cast<char>(header.codec));
+	AppendUint16(raw, header.section);
+	AppendUint32(raw, header.first);
+	AppendUint32(raw, header.count);
+	AppendUint32(raw, header.total);
+	AppendUint32(raw, header.raw_size);
+	AppendUint32(raw, header.stored_size);
+	out.write(raw.data(), raw.size());
+}
+
+inline void ReadBlockHeader(std::istream& in, BlockHeader& header) {
+	char raw[24];
+	if (!in.read(raw, sizeof(raw))) {
+		throw std::runtime_error("Save file is truncated.");
+	}
+	size_t offset{ 2 };
+	header.kind = static_cast<BlockKind>(raw[0]);
+	header.codec = static_cast<BlockCodec>(raw[1]);
+	header.section = ReadUint16(raw, offset);
+	header.first = ReadUint32(raw, offset);
+	header.count = ReadUint32(raw, offset);
+	header.total = ReadUint32(raw, offset);
+	header.raw_size = ReadUint32(raw, offset);
+	header.stored_size = ReadUint32(raw, offset);
+	if (header.kind > BlockKind::END || header.codec > BlockCodec::LZ || header.first + static_cast<uint64_t>(header.count) > header.total) {
+		throw std::runtime_error("Save file is corrupt.");
+	}
+}
+
+inline void CompressBlock(SaveBlock& block, const bool compress) {
+	/* Keeps the block uncompressed if compressing it doesn't save anything. */
+	block.header.raw_size = static_cast<uint32_t>(block.raw.size());
+	block.stored.clear();
+	if (compress) {
+		LZCompress(block.raw.data(), block.raw.size(), block.stored);
+	}
+	if (!compress || block.stored.size() >= block.raw.size()) {
+		block.header.codec = BlockCodec::NONE;
+		block.stored.assign(block.raw.begin(), block.raw.end());
+	}
+	else {
+		block.header.codec = BlockCodec::LZ;
+	}
+	block.header.stored_size = static_cast<uint32_t>(block.stored.size());
+}
+
+inline void DecompressBlock(SaveBlock& block) {
+	auto raw_size = block.header.raw_size;
+	block.raw.assign(raw_size, '\0');
+	if (block.header.codec == BlockCodec::LZ) {
+		LZDecompress(block.stored.data(), block.stored.size(), &block.raw[0], raw_size);
+	}
+	else if (block.stored.size() == raw_size) {
+		std::copy(block.stored.begin(), block.stored.end(), block.raw.begin());
+	}
+	else {
+		throw std::runtime_error("Save file is corrupt.");
+	}
+}
+
+class BlockWorkers {
+	/* The threads a chunked save or load encodes and decodes its blocks on. They are started once, when
+	*  the save or load starts, and each window of blocks is handed to them with run, so a save doesn't
+	*  start and join threads for every window.
+	*/
+public:
+	explicit BlockWorkers(const unsigned threads) {
+		for (unsigned i = 1; i < threads; i++) {
+			m_threads.emplace_back([this]() { wait_for_work(); });
+		}
+	}
+
+	~BlockWorkers() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_start.notify_all();
+		for (auto& thread : m_threads) {
+			thread.join();
+		}
+	}
+
+	BlockWorkers(const BlockWorkers&) = delete;
+	BlockWorkers& operator=(const BlockWorkers&) = delete;
+
+	void run(const size_t count, const std::function<void(const size_t)>& function) {
+		/* Calls function(i) for every i in [0, count) across the workers and the calling thread. The 
+		*  first exception thrown is rethrown once every thread has finished.
+		*/
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_function = &function;
+			m_count = count;
+			m_next = 0;
+			m_failed = false;
+			m_error = nullptr;
+			m_busy = static_cast<unsigned>(m_threads.size());
+			m_generation++;
+		}
+		m_start.notify_all();
+		work();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this]() { return m_busy == 0; });
+		m_function = nullptr;
+		if (m_error) {
+			std::rethrow_exception(m_error);
+		}
+	}
+
+private:
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_start;
+	std::condition_variable m_done;
+	const std::function<void(const size_t)>* m_function{ nullptr };
+	size_t m_count{ 0 };
+	std::atomic<size_t> m_next{ 0 };
+	std::atomic<bool> m_failed{ false };
+	std::exception_ptr m_error;
+	uint64_t m_generation{ 0 };
+	unsigned m_busy{ 0 };
+	bool m_stop{ false };
+
+	void work() {
+		for (auto i = m_next++; i < m_count && !m_failed; i = m_next++) {
+			try {
+				(*m_function)(i);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_failed.exchange(true)) {
+					m_error = std::current_exception();
+				}
+			}
+		}
+	}
+
+	void wait_for_work() {
+		uint64_t seen{ 0 };
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_start.wait(lock, [&]() { return m_stop || m_generation != seen; });
+				if (m_stop) {
+					return;
+				}
+				seen = m_generation;
+			}
+			work();
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_busy--;
+			}
+			m_done.notify_one();
+		}
+	}
+};
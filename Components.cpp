@@ -1,6 +1,6 @@
 #include "Components.h"
 
-void Position::serialise(std::ofstream& file)
+void Position::serialise(std::ostream& file)
 {
 	utils::serialiseUint32(file, static_cast<uint32_t>(x));
 	utils::serialiseUint32(file, static_cast<uint32_t>(y));
@@ -12,51 +12,51 @@ void Position::deserialise(const char* buffer, size_t& offset)
 	y = static_cast<int>(utils::deserialiseUint32(buffer, offset));
 }
 
-void MeshRenderer::serialise(std::ofstream& file)
+void MeshRenderer::serialise(std::ostream&)
 {
 
 }
 
-void MeshRenderer::deserialise(const char* buffer, size_t& offset)
+void MeshRenderer::deserialise(const char*, size_t&)
 {
 
 }
 
-void AI::serialise(std::ofstream& file)
+void AI::serialise(std::ostream&)
 {
 
 }
 
-void AI::deserialise(const char* buffer, size_t& offset)
+void AI::deserialise(const char*, size_t&)
 {
 
 }
 
-void RigidBody::serialise(std::ofstream& file)
+void RigidBody::serialise(std::ostream&)
 {
 
 }
 
-void RigidBody::deserialise(const char* buffer, size_t& offset)
+void RigidBody::deserialise(const char*, size_t&)
 {
 
 }
 
-void Sprite::serialise(std::ofstream& file)
+void Sprite::serialise(std::ostream&)
 {
 }
 
-void Sprite::deserialise(const char* buffer, size_t& offset)
+void Sprite::deserialise(const char*, size_t&)
 {
 
 }
 
-void Model::serialise(std::ofstream& file)
+void Model::serialise(std::ostream&)
 {
 
 }
 
-void Model::deserialise(const char* buffer, size_t& offset)
+void Model::deserialise(const char*, size_t&)
 {
 
 }
@@ -1,10 +1,11 @@
 #pragma once
 
-#include <fstream>;
+#include <fstream>
+#include <ostream>
 #include "Utils.hpp"
 
 struct ISerializeable {
-	virtual void serialise(std::ofstream& file) = 0;
+	virtual void serialise(std::ostream& file) = 0;
 	virtual void deserialise(const char* buffer, size_t& offset) = 0;
 };
 
@@ -23,7 +24,7 @@ struct Position : public ISerializeable
 
 	float x{ 0.0f }, y{ 0.0f }, z{ 0.0f };
 
-	virtual void serialise(std::ofstream& file) override;
+	virtual void serialise(std::ostream& file) override;
 	virtual void deserialise(const char* buffer, size_t& offset) override;
 };
 
@@ -34,35 +35,35 @@ struct MeshRenderer : public ISerializeable
 	virtual ~MeshRenderer() {};
 	unsigned int id;
 
-	virtual void serialise(std::ofstream& file) override;
+	virtual void serialise(std::ostream& file) override;
 	virtual void deserialise(const char* buffer, size_t& offset) override;
 };
 
 struct AI : public ISerializeable
 {
 	virtual ~AI() {};
-	virtual void serialise(std::ofstream& file) override;
+	virtual void serialise(std::ostream& file) override;
 	virtual void deserialise(const char* buffer, size_t& offset) override;
 };
 
 struct RigidBody : public ISerializeable
 {
 	virtual ~RigidBody() {};
-	virtual void serialise(std::ofstream& file) override;
+	virtual void serialise(std::ostream& file) override;
 	virtual void deserialise(const char* buffer, size_t& offset) override;
 };
 
 struct Sprite : public ISerializeable
 {
 	virtual ~Sprite() {};
-	virtual void serialise(std::ofstream& file) override;
+	virtual void serialise(std::ostream& file) override;
 	virtual void deserialise(const char* buffer, size_t& offset) override;
 };
 
 struct Model : public ISerializeable
 {
 	virtual ~Model() {};
-	virtual void serialise(std::ofstream& file) override;
+	virtual void serialise(std::ostream& file) override;
 	virtual void deserialise(const char* buffer, size_t& offset) override;
 };
 
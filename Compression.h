@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+/*
+* A small, fast LZ77 codec for save blocks, in the style of LZ4.
+*
+* The compressed data is a series of sequences, each a token byte holding the number of literals in
+* its high nibble and the match length (less LZ_MIN_MATCH) in its low nibble, further length bytes for
+* either nibble which is 15, the literals themselves and a two byte little endian offset back to the
+* match. The last sequence has literals only. Matches are found through a hash table of the last
+* position each four byte string was seen at, so compression is a single pass.
+*/
+
+const size_t LZ_MIN_MATCH{ 4 };
+const size_t LZ_MAX_OFFSET{ 65535 };
+const int LZ_HASH_BITS{ 14 };
+
+inline uint32_t LZRead32(const char* p) {
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+inline uint32_t LZHash(const uint32_t value) {
+	return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+inline void LZWriteLength(std::vector<char>& out, size_t length) {
+	/* The part of a length which didn't fit in its nibble, as bytes of 255 and a remainder. */
+	while (length >= 255) {
+		out.push_back(static_cast<char>(255));
+		length -= 255;
+	}
+	out.push_back(static_cast<char>(length));
+}
+
+inline void LZWriteSequence(std::vector<char>& out, const char* literals, const size_t num_literals,
+	const size_t offset, const size_t match_length) {
+	/* match_length is zero for the last sequence, which has no match. */
+	auto literal_nibble = num_literals < 15 ? num_literals : 15;
+	auto match_nibble = match_length == 0 ? 0 : (match_length - LZ_MIN_MATCH < 15 ? match_length - LZ_MIN_MATCH : 15);
+	out.push_back(static_cast<char>((literal_nibble << 4) | match_nibble));
+	if (literal_nibble == 15) {
+		LZWriteLength(out, num_literals - 15);
+	}
+	out.insert(out.end(), literals, literals + num_literals);
+
+	if (match_length > 0) {
+		out.push_back(static_cast<char>(offset & 0xFF));
+		out.push_back(static_cast<char>(offset >> 8));
+		if (match_nibble == 15) {
+			LZWriteLength(out, match_length - LZ_MIN_MATCH - 15);
+		}
+	}
+}
+
+inline void LZCompress(const char* source, const size_t size, std::vector<char>& out) {
+	/* Appends the compressed form of size bytes of source to out. */
+	std::vector<uint32_t> table(size_t(1) << LZ_HASH_BITS, 0);
+	size_t anchor{ 0 };
+	size_t i{ 0 };
+
+	while (i + LZ_MIN_MATCH <= size) {
+		auto hash = LZHash(LZRead32(source + i));
+		// positions are stored plus one, so that zero means none.
+		auto candidate = static_cast<size_t>(table[hash]);
+		table[hash] = static_cast<uint32_t>(i + 1);
+
+		if (candidate > 0 && i - (candidate - 1) <= LZ_MAX_OFFSET &&
+			LZRead32(source + candidate - 1) == LZRead32(source + i)) {
+			auto match = candidate - 1;
+			auto length = LZ_MIN_MATCH;
+			while (i + length < size && source[match + length] == source[i + length]) {
+				length++;
+			}
+
+			LZWriteSequence(out, source + anchor, i - anchor, i - match, length);
+			i += length;
+			anchor = i;
+			continue;
+		}
+
+		// step faster through data which isn't compressing.
+		i += 1 + ((i - anchor) >> 6);
+	}
+
+	LZWriteSequence(out, source + anchor, size - anchor, 0, 0);
+}
+
+inline size_t LZReadLength(const char* source, const size_t size, size_t& in) {
+	size_t length{ 0 };
+	uint8_t byte;
+	do {
+		if (in >= size) {
+			throw std::runtime_error("Compressed data is corrupt.");
+		}
+		byte = static_cast<uint8_t>(source[in++]);
+		length += byte;
+	} while (byte == 255);
+	return length;
+}
+
+inline void LZDecompress(const char* source, const size_t size, char* destination, const size_t raw_size) {
+	/* Decompresses into destination, which must hold exactly raw_size bytes. Throws if the data is
+	*  corrupt rather than reading or writing out of bounds.
+	*/
+	size_t in{ 0 };
+	size_t out{ 0 };
+
+	while (true) {
+		if (in >= size) {
+			throw std::runtime_error("Compressed data is corrupt.");
+		}
+		auto token = static_cast<uint8_t>(source[in++]);
+
+		size_t num_literals = token >> 4;
+		if (num_literals == 15) {
+			num_literals += LZReadLength(source, size, in);
+		}
+		if (num_literals > size - in || num_literals > raw_size - out) {
+			throw std::runtime_error("Compressed data is corrupt.");
+		}
+		if (num_literals > 0) {
+			std::memcpy(destination + out, source + in, num_literals);
+		}
+		in += num_literals;
+		out += num_literals;
+
+		if (in == size) {
+			break;
+		}
+
+		if (size - in < 2) {
+			throw std::runtime_error("Compressed data is corrupt.");
+		}
+		size_t offset = static_cast<uint8_t>(source[in]) | (static_cast<size_t>(static_cast<uint8_t>(source[in + 1])) << 8);
+		in += 2;
+
+		size_t length = (token & 0xF) + LZ_MIN_MATCH;
+		if ((token & 0xF) == 15) {
+			length += LZReadLength(source, size, in);
+		}
+		if (offset == 0 || offset > out || length > raw_size - out) {
+			throw std::runtime_error("Compressed data is corrupt.");
+		}
+
+		auto* match = destination + out - offset;
+		if (offset >= length) {
+			std::memcpy(destination + out, match, length);
+		}
+		else {
+			// the match overlaps what it is copied to, e.g. a run of one byte.
+			for (size_t i = 0; i < length; i++) {
+				destination[out + i] = match[i];
+			}
+		}
+		out += length;
+	}
+
+	if (out != raw_size) {
+		throw std::runtime_error("Compressed data is corrupt.");
+	}
+}
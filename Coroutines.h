@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "World.h"
+
+/*
+* Budgeted systems
+*
+* Work which can't finish within one frame - pathing, planning - can be written as a coroutine which
+* returns a SystemTask. Resume it once a frame; inside, co_yield the frame's budget after each unit of
+* work and the coroutine suspends only if the budget has run out, carrying on from the same place on
+* the next Resume. co_yield NextFrame{} always suspends, e.g. at the end of a pass.
+*
+*	SystemTask Pathing(World& world, const FrameBudget& budget) {
+*		ResumableView<Position, AI> view(world);
+*		while (true) {
+*			for (auto entity : view) {
+*				PlanPath(world, entity);
+*				co_yield budget;
+*			}
+*			co_yield NextFrame{};
+*		}
+*	}
+*
+*	budget.Start(2000);
+*	pathing.Resume();
+*
+* A ResumableView iterates its own copy of the matching entities, taken when each pass begins, and
+* skips any which have since been killed or lost a component. Removals while suspended therefore
+* never move the cursor, and entities which gain the components join on the next pass. Components
+* fetched before a co_yield should be fetched again after it. The copy is refilled in place, so once
+* it has grown to the largest pass no more memory is allocated.
+*/
+
+class FrameBudget
+{
+private:
+	std::chrono::steady_clock::time_point m_deadline{};
+
+public:
+	inline void Start(const int64_t microseconds) {
+		/* Call at the start of the frame's budgeted work. */
+		m_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+	}
+
+	inline bool Exhausted() const {
+		return std::chrono::steady_clock::now() >= m_deadline;
+	}
+};
+
+struct NextFrame {};
+
+class SystemTask
+{
+public:
+	struct BudgetAwaiter
+	{
+		const FrameBudget& budget;
+
+		inline bool await_ready() const noexcept { return !budget.Exhausted(); };
+		inline void await_suspend(std::coroutine_handle<>) const noexcept {};
+		inline void await_resume() const noexcept {};
+	};
+
+	struct promise_type
+	{
+		std::exception_ptr error;
+
+		SystemTask get_return_object() { return SystemTask(std::coroutine_handle<promise_type>::from_promise(*this)); };
+		std::suspend_always initial_suspend() noexcept { return {}; };
+		std::suspend_always final_suspend() noexcept { return {}; };
+		BudgetAwaiter yield_value(const FrameBudget& budget) noexcept { return { budget }; };
+		std::suspend_always yield_value(NextFrame) noexcept { return {}; };
+		void return_void() {};
+		void unhandled_exception() { error = std::current_exception(); };
+	};
+
+private:
+	std::coroutine_handle<promise_type> m_handle;
+
+public:
+	explicit SystemTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) {};
+	SystemTask(SystemTask&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {};
+	SystemTask& operator=(SystemTask&& other) noexcept {
+		if (this != &other) {
+			if (m_handle) {
+				m_handle.destroy();
+			}
+			m_handle = std::exchange(other.m_handle, nullptr);
+		}
+		return *this;
+	}
+	SystemTask(const SystemTask&) = delete;
+	SystemTask& operator=(const SystemTask&) = delete;
+
+	~SystemTask() {
+		if (m_handle) {
+			m_handle.destroy();
+		}
+	}
+
+	bool Resume() {
+		/* Runs the system until it next suspends. Returns false once it has finished, and rethrows
+		*  anything it threw.
+		*/
+		if (m_handle && !m_handle.done()) {
+			m_handle.resume();
+			if (m_handle.promise().error) {
+				std::rethrow_exception(std::exchange(m_handle.promise().error, nullptr));
+			}
+		}
+		return !Done();
+	}
+
+	inline bool Done() const {
+		return !m_handle || m_handle.done();
+	}
+};
+
+template <typename... Components>
+class ResumableView
+{
+private:
+	World& m_world;
+	std::vector<uint32_t> m_entities;
+
+public:
+	class iterator
+	{
+	private:
+		ResumableView* m_view;
+		size_t m_index;
+
+		void SkipStale() {
+			auto& entities = m_view->m_entities;
+			while (m_index < entities.size() && !m_view->m_world.template HasComponents<Components...>(entities[m_index])) {
+				m_index++;
+			}
+		}
+
+	public:
+		iterator(ResumableView* view, const size_t index) : m_view(view), m_index(index) {
+			SkipStale();
+		};
+
+		inline uint32_t operator*() const { return m_view->m_entities[m_index]; };
+		inline bool operator!=(const iterator& other) const { return m_index != other.m_index; };
+		inline bool operator==(const iterator& other) const { return m_index == other.m_index; };
+
+		iterator& operator++() {
+			m_index++;
+			SkipStale();
+			return *this;
+		}
+	};
+
+	ResumableView(World& world) : m_world(world) {};
+
+	iterator begin() {
+		/* Begins a pass, over the entities which have the components now. */
+		m_world.template FillEntitiesWith<Components...>(m_entities, 0);
+		return iterator(this, 0);
+	}
+
+	iterator end() {
+		return iterator(this, m_entities.size());
+	}
+};
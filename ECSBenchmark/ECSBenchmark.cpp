@@ -0,0 +1,922 @@
+#include "World.h"
+#include "Replication.h"
+#include "Coroutines.h"
+#include "FrameExtract.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+* ecs_bench - microbenchmarks for every World operation.
+*
+* Each benchmark sets up a world, then times one batch of operations between timer.start() and
+* timer.stop() and returns how many operations the batch made. Batches are repeated until the
+* minimum time has been spent measuring. Results are written as JSON:
+*
+*	ecs_bench [--filter <substring>] [--min-time <seconds>] [--out <file>]
+*/
+
+static std::atomic<size_t> g_allocations{ 0 };
+
+/* Every form of new is replaced, so that allocations_per_op counts arrays and over-aligned allocations 
+*  (the pools, the frame arena) too, and every form of delete frees with the matching function. 
+*/
+static void* CountedAllocate(const size_t size) noexcept {
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size > 0 ? size : 1);
+}
+
+static void CountedFree(void* p) noexcept {
+	std::free(p);
+}
+
+static void* CountedAllocate(const size_t size, const std::align_val_t alignment) noexcept {
+	/* Over-allocates, and keeps the pointer malloc returned just before the aligned block. */
+	auto align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+	if (size > SIZE_MAX - align - sizeof(void*)) {
+		return nullptr;
+	}
+	auto* raw = static_cast<char*>(CountedAllocate(size + align + sizeof(void*)));
+	if (raw == nullptr) {
+		return nullptr;
+	}
+	auto aligned = (reinterpret_cast<uintptr_t>(raw) + sizeof(void*) + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+	reinterpret_cast<void**>(aligned)[-1] = raw;
+	return reinterpret_cast<void*>(aligned);
+}
+
+static void CountedFree(void* p, const std::align_val_t) noexcept {
+	if (p != nullptr) {
+		CountedFree(static_cast<void**>(p)[-1]);
+	}
+}
+
+template <typename... Alignment>
+static void* CountedAllocateOrThrow(const size_t size, const Alignment... alignment) {
+	if (void* p = CountedAllocate(size, alignment...)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return CountedAllocateOrThrow(size); }
+void* operator new[](size_t size) { return CountedAllocateOrThrow(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return CountedAllocateOrThrow(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return CountedAllocateOrThrow(size, alignment); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedAllocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedAllocate(size); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return CountedAllocate(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return CountedAllocate(size, alignment); }
+
+void operator delete(void* p) noexcept { CountedFree(p); }
+void operator delete[](void* p) noexcept { CountedFree(p); }
+void operator delete(void* p, size_t) noexcept { CountedFree(p); }
+void operator delete[](void* p, size_t) noexcept { CountedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { CountedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { CountedFree(p); }
+void operator delete(void* p, std::align_val_t alignment) noexcept { CountedFree(p, alignment); }
+void operator delete[](void* p, std::align_val_t alignment) noexcept { CountedFree(p, alignment); }
+void operator delete(void* p, size_t, std::align_val_t alignment) noexcept { CountedFree(p, alignment); }
+void operator delete[](void* p, size_t, std::align_val_t alignment) noexcept { CountedFree(p, alignment); }
+void operator delete(void* p, std::align_val_t alignment, const std::nothrow_t&) noexcept { CountedFree(p, alignment); }
+void operator delete[](void* p, std::align_val_t alignment, const std::nothrow_t&) noexcept { CountedFree(p, alignment); }
+
+const int NUM_ENTITIES{ 10000 };
+
+class Timer
+{
+private:
+	std::chrono::steady_clock::time_point m_start;
+	size_t m_start_allocations{ 0 };
+
+public:
+	double elapsed_ns{ 0.0 };
+	size_t allocations{ 0 };
+	// anything a benchmark produces which is worth reporting per op, e.g. bytes sent.
+	size_t bytes{ 0 };
+
+	inline void start() {
+		m_start_allocations = g_allocations.load(std::memory_order_relaxed);
+		m_start = std::chrono::steady_clock::now();
+	}
+
+	inline void stop() {
+		auto end = std::chrono::steady_clock::now();
+		elapsed_ns += std::chrono::duration<double, std::nano>(end - m_start).count();
+		allocations += g_allocations.load(std::memory_order_relaxed) - m_start_allocations;
+	}
+};
+
+using BenchmarkFunction = std::function<size_t(Timer&)>;
+
+struct Benchmark
+{
+	std::string name;
+	BenchmarkFunction function;
+};
+
+struct Result
+{
+	std::string name;
+	size_t batches{ 0 };
+	size_t items{ 0 };
+	double ns_per_op{ 0.0 };
+	double items_per_second{ 0.0 };
+	double allocations_per_op{ 0.0 };
+	double bytes_per_op{ 0.0 };
+};
+
+struct Listened
+{
+	float value{ 0.0f };
+};
+
+struct StaticListened
+{
+	float value{ 0.0f };
+	static inline size_t constructed{ 0 };
+};
+
+// Position held under the other storage policies.
+struct Lifetime
+{
+	uint32_t ticks{ 0 };
+	Lifetime() {};
+	Lifetime(uint32_t ticks) : ticks(ticks) {};
+};
+
+struct HashedPosition : public Position { using Position::Position; };
+struct StablePosition : public Position { using Position::Position; };
+
+template <>
+struct ComponentStorage<HashedPosition> : HashedStorage {};
+
+template <>
+struct ComponentStorage<StablePosition> : StableStorage {};
+
+template <>
+struct Signals<StaticListened> : Listeners<StaticListened>
+{
+	static void on_construct(World&, const uint32_t, StaticListened&) {
+		StaticListened::constructed++;
+	};
+};
+
+std::unique_ptr<World> MakeWorld() {
+	auto world = std::make_unique<World>();
+	world->RegisterComponent<Position>();
+	world->RegisterComponent<MeshRenderer>();
+	world->RegisterComponent<AI>();
+	world->RegisterComponent<Listened>();
+	world->RegisterComponent<StaticListened>();
+	return world;
+}
+
+std::vector<uint32_t> CreateEntities(World& world, const int count) {
+	std::vector<uint32_t> entities;
+	entities.reserve(count);
+	for (int i = 0; i < count; i++) {
+		entities.push_back(world.CreateEntity());
+	}
+	return entities;
+}
+
+std::unique_ptr<World> MakePopulatedWorld(const int density_position, const int density_mesh, const int density_ai,
+	std::vector<uint32_t>* created = nullptr) {
+	/* Every entity has a chance (in percent) of having each component, using a fixed seed so that
+	*  runs are comparable.
+	*/
+	auto world = MakeWorld();
+	std::mt19937 rng{ 42 };
+	std::uniform_int_distribution<int> percent(0, 99);
+
+	auto entities = CreateEntities(*world, NUM_ENTITIES);
+	if (created != nullptr) {
+		*created = entities;
+	}
+
+	for (auto entity : entities) {
+		if (percent(rng) < density_position) {
+			world->AddComponent<Position>(entity, 1.0f, 2.0f, 3.0f);
+		}
+		if (percent(rng) < density_mesh) {
+			world->AddComponent<MeshRenderer>(entity, 1);
+		}
+		if (percent(rng) < density_ai) {
+			world->AddComponent<AI>(entity);
+		}
+	}
+	return world;
+}
+
+template <typename Component>
+size_t BenchAddComponent(Timer& timer) {
+	auto world = MakeWorld();
+	world->RegisterComponent<Component>();
+	auto entities = CreateEntities(*world, NUM_ENTITIES);
+
+	timer.start();
+	for (auto& entity : entities) {
+		world->AddComponent<Component>(entity);
+	}
+	timer.stop();
+	return entities.size();
+}
+
+template <typename Component>
+size_t BenchRemoveComponent(Timer& timer) {
+	auto world = MakeWorld();
+	world->RegisterComponent<Component>();
+	auto entities = CreateEntities(*world, NUM_ENTITIES);
+	for (auto& entity : entities) {
+		world->AddComponent<Component>(entity);
+	}
+	std::shuffle(entities.begin(), entities.end(), std::mt19937{ 7 });
+
+	timer.start();
+	for (auto& entity : entities) {
+		world->RemoveComponent<Component>(entity);
+	}
+	timer.stop();
+	return entities.size();
+}
+
+size_t BenchReplication(Timer& timer, const size_t move_every, const bool decode) {
+	/* Times one tick of replication after moving every move_every-th Position. bytes_per_op is the
+	*  bandwidth in bytes per entity per tick.
+	*/
+	std::vector<uint32_t> entities;
+	auto world = MakePopulatedWorld(100, 50, 0, &entities);
+	World client_world;
+	ReplicationServer server(*world);
+	ReplicationClient client(client_world);
+	server.Replicate<Position>();
+	server.Replicate<MeshRenderer>();
+	client.Replicate<Position>();
+	client.Replicate<MeshRenderer>();
+
+	auto player = server.AddClient();
+	for (auto entity : entities) {
+		server.SetInterest(player, entity);
+	}
+	std::vector<uint8_t> packet;
+	client.Decode(packet.data(), server.Encode(player, packet));
+	world->EndFrame();
+
+	for (size_t i = 0; i < entities.size(); i += move_every) {
+		world->GetComponent<Position>(entities[i])->x += 1.0f;
+	}
+
+	timer.start();
+	timer.bytes += server.Encode(player, packet);
+	if (decode) {
+		client.Decode(packet.data(), packet.size());
+	}
+	timer.stop();
+	return entities.size();
+}
+
+SystemTask TouchAI(World& world, const FrameBudget& budget, size_t& visited) {
+	ResumableView<Position, AI> view(world);
+	while (true) {
+		for (auto entity : view) {
+			world.GetComponent<Position>(entity)->x += 1.0f;
+			visited++;
+			co_yield budget;
+		}
+		co_yield NextFrame{};
+	}
+}
+
+std::vector<Benchmark> MakeBenchmarks() {
+	std::vector<Benchmark> benchmarks;
+
+	benchmarks.push_back({ "CreateEntity", [](Timer& timer) {
+		auto world = MakeWorld();
+
+		timer.start();
+		for (int i = 0; i < NUM_ENTITIES; i++) {
+			world->CreateEntity();
+		}
+		timer.stop();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "CreateEntity/recycled", [](Timer& timer) {
+		auto world = MakeWorld();
+		for (auto entity : CreateEntities(*world, NUM_ENTITIES)) {
+			world->KillEntity(entity);
+		}
+
+		timer.start();
+		for (int i = 0; i < NUM_ENTITIES; i++) {
+			world->CreateEntity();
+		}
+		timer.stop();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "KillEntity", [](Timer& timer) {
+		std::vector<uint32_t> entities;
+		auto world = MakePopulatedWorld(100, 50, 10, &entities);
+
+		timer.start();
+		for (auto& entity : entities) {
+			world->KillEntity(entity);
+		}
+		timer.stop();
+		return entities.size();
+	} });
+
+	benchmarks.push_back({ "RuntimeComponent/column", [](Timer& timer) {
+		// a script updating every component of a runtime type in one call.
+		auto world = MakeWorld();
+		auto speed_id = world->RegisterComponent(RuntimeComponent{ "BenchSpeed", sizeof(float), alignof(float) });
+		auto entities = CreateEntities(*world, NUM_ENTITIES);
+		for (auto& entity : entities) {
+			world->AddComponent(speed_id, entity);
+		}
+
+		timer.start();
+		auto column = world->GetColumn(speed_id);
+		for (size_t i = 0; i < column.size; i++) {
+			*static_cast<float*>(column[i]) += 1.0f;
+		}
+		timer.stop();
+		return column.size;
+	} });
+
+	benchmarks.push_back({ "RuntimeComponent/per_entity", [](Timer& timer) {
+		// the same update through one lookup per entity.
+		auto world = MakeWorld();
+		auto speed_id = world->RegisterComponent(RuntimeComponent{ "BenchSpeed", sizeof(float), alignof(float) });
+		auto entities = CreateEntities(*world, NUM_ENTITIES);
+		for (auto& entity : entities) {
+			world->AddComponent(speed_id, entity);
+		}
+
+		timer.start();
+		for (auto entity : entities) {
+			*static_cast<float*>(world->GetComponent(speed_id, entity)) += 1.0f;
+		}
+		timer.stop();
+		return entities.size();
+	} });
+
+	benchmarks.push_back({ "Disable", [](Timer& timer) {
+		std::vector<uint32_t> entities;
+		auto world = MakePopulatedWorld(100, 50, 10, &entities);
+
+		timer.start();
+		for (auto entity : entities) {
+			world->Disable(entity);
+		}
+		timer.stop();
+		return entities.size();
+	} });
+
+	benchmarks.push_back({ "GetComponents/Position_90pct_disabled", [](Timer& timer) {
+		// only the enabled tenth of the pool is visited.
+		std::vector<uint32_t> entities;
+		auto world = MakePopulatedWorld(100, 0, 0, &entities);
+		for (size_t i = 0; i < entities.size(); i++) {
+			if (i % 10 != 0) {
+				world->Disable(entities[i]);
+			}
+		}
+
+		timer.start();
+		auto components = world->GetComponents<Position>();
+		timer.stop();
+		return components.size();
+	} });
+
+	benchmarks.push_back({ "AddComponent/Position", BenchAddComponent<Position> });
+	benchmarks.push_back({ "AddComponent/AI", BenchAddComponent<AI> });
+
+	// the cost of the signal dispatch - compare against a component with no listeners.
+	benchmarks.push_back({ "AddComponent/no_listeners", BenchAddComponent<Listened> });
+	benchmarks.push_back({ "AddComponent/static_listener", BenchAddComponent<StaticListened> });
+	benchmarks.push_back({ "AddComponent/runtime_listener", [](Timer& timer) {
+		auto world = MakeWorld();
+		size_t constructed{ 0 };
+		world->OnConstruct<Listened>([&constructed](World&, uint32_t, Listened&) { constructed++; });
+		auto entities = CreateEntities(*world, NUM_ENTITIES);
+
+		timer.start();
+		for (auto& entity : entities) {
+			world->AddComponent<Listened>(entity);
+		}
+		timer.stop();
+		return entities.size();
+	} });
+
+	benchmarks.push_back({ "AddComponent/per_entity_spawn", [](Timer& timer) {
+		auto world = MakeWorld();
+		timer.start();
+		for (size_t i = 0; i < NUM_ENTITIES; i++) {
+			auto entity = world->CreateEntity();
+			world->AddComponent<Position>(entity, 1.0f, 2.0f, 3.0f);
+			world->AddComponent<MeshRenderer>(entity, 1);
+			world->AddComponent<Listened>(entity);
+		}
+		timer.stop();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "Instantiate/prefab", [](Timer& timer) {
+		auto world = MakeWorld();
+		Prefab prefab;
+		prefab.With<Position>(1.0f, 2.0f, 3.0f).With<MeshRenderer>(1).With<Listened>();
+		timer.start();
+		auto entities = world->Instantiate(prefab, NUM_ENTITIES);
+		timer.stop();
+		return entities.size();
+	} });
+
+	benchmarks.push_back({ "RemoveComponent/Position", BenchRemoveComponent<Position> });
+
+	// the storage policies, against Position above.
+	benchmarks.push_back({ "AddComponent/hashed", BenchAddComponent<HashedPosition> });
+	benchmarks.push_back({ "AddComponent/stable", BenchAddComponent<StablePosition> });
+	benchmarks.push_back({ "RemoveComponent/hashed", BenchRemoveComponent<HashedPosition> });
+	benchmarks.push_back({ "RemoveComponent/stable", BenchRemoveComponent<StablePosition> });
+
+	benchmarks.push_back({ "GetComponent/random", [](Timer& timer) {
+		auto world = MakeWorld();
+		auto entities = CreateEntities(*world, NUM_ENTITIES);
+		for (auto& entity : entities) {
+			world->AddComponent<Position>(entity, 1.0f, 1.0f, 1.0f);
+		}
+		std::shuffle(entities.begin(), entities.end(), std::mt19937{ 7 });
+
+		float sum{ 0.0f };
+		timer.start();
+		for (auto& entity : entities) {
+			sum += world->GetComponent<Position>(entity)->x;
+		}
+		timer.stop();
+
+		if (sum < 0.0f) {
+			std::printf("%f", sum);
+		}
+		return entities.size();
+	} });
+
+	benchmarks.push_back({ "GetComponent/random_hashed", [](Timer& timer) {
+		// 1 in 10 entities, looked up through the hash table rather than the sparse array.
+		auto world = MakeWorld();
+		world->RegisterComponent<HashedPosition>();
+		auto entities = CreateEntities(*world, NUM_ENTITIES);
+		std::vector<uint32_t> holders;
+		for (size_t i = 0; i < entities.size(); i += 10) {
+			world->AddComponent<HashedPosition>(entities[i], 1.0f, 1.0f, 1.0f);
+			holders.push_back(entities[i]);
+		}
+		std::shuffle(holders.begin(), holders.end(), std::mt19937{ 7 });
+
+		float sum{ 0.0f };
+		timer.start();
+		for (auto& entity : holders) {
+			sum += world->GetComponent<HashedPosition>(entity)->x;
+		}
+		timer.stop();
+
+		if (sum < 0.0f) {
+			std::printf("%f", sum);
+		}
+		return holders.size();
+	} });
+
+	benchmarks.push_back({ "GetResource", [](Timer& timer) {
+		// a singleton held as a resource, against the same data on a dummy entity below.
+		auto world = MakeWorld();
+		world->SetResource<Position>(1.0f, 1.0f, 1.0f);
+
+		float sum{ 0.0f };
+		timer.start();
+		for (int i = 0; i < NUM_ENTITIES; i++) {
+			sum += world->GetResource<Position>()->x;
+		}
+		timer.stop();
+
+		if (sum < 0.0f) {
+			std::printf("%f", sum);
+		}
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "GetResource/singleton_entity", [](Timer& timer) {
+		auto world = MakeWorld();
+		auto singleton = world->CreateEntity();
+		world->AddComponent<Position>(singleton, 1.0f, 1.0f, 1.0f);
+
+		float sum{ 0.0f };
+		timer.start();
+		for (int i = 0; i < NUM_ENTITIES; i++) {
+			sum += world->GetComponent<Position>(singleton)->x;
+		}
+		timer.stop();
+
+		if (sum < 0.0f) {
+			std::printf("%f", sum);
+		}
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "ForEachShared/16_meshes", [](Timer& timer) {
+		// draw batches straight from the shared values, against sorting per entity meshes below.
+		auto world = MakeWorld();
+		world->RegisterComponent<SharedRef<MeshRenderer>>();
+		auto entities = CreateEntities(*world, NUM_ENTITIES);
+		for (int i = 0; i < NUM_ENTITIES; i++) {
+			world->AddShared<MeshRenderer>(entities[i], static_cast<unsigned int>(i % 16));
+		}
+
+		size_t batches{ 0 };
+		timer.start();
+		world->ForEachShared<MeshRenderer>([&](const MeshRenderer& renderer, const std::vector<uint32_t>& sharing) {
+			batches += renderer.id * sharing.size();
+		});
+		timer.stop();
+
+		if (batches == 0) {
+			std::printf("%zu", batches);
+		}
+		return entities.size();
+	} });
+
+	benchmarks.push_back({ "ForEachShared/sort_unshared", [](Timer& timer) {
+		auto world = MakeWorld();
+		auto entities = CreateEntities(*world, NUM_ENTITIES);
+		for (int i = 0; i < NUM_ENTITIES; i++) {
+			world->AddComponent<MeshRenderer>(entities[i], static_cast<unsigned int>(i % 16));
+		}
+
+		std::vector<std::pair<unsigned int, uint32_t>> draws;
+		draws.reserve(entities.size());
+		timer.start();
+		for (auto entity : world->GetEntitiesWith<MeshRenderer>()) {
+			draws.emplace_back(world->GetComponent<MeshRenderer>(entity)->id, entity);
+		}
+		std::sort(draws.begin(), draws.end());
+		timer.stop();
+
+		if (draws.empty()) {
+			std::printf("%zu", draws.size());
+		}
+		return entities.size();
+	} });
+
+	for (int density : { 10, 50, 100 }) {
+		auto suffix = "/" + std::to_string(density) + "%";
+
+		benchmarks.push_back({ "GetEntitiesWith/1" + suffix, [density](Timer& timer) {
+			auto world = MakePopulatedWorld(density, density, density);
+			timer.start();
+			auto entities = world->GetEntitiesWith<Position>();
+			timer.stop();
+			return static_cast<size_t>(NUM_ENTITIES);
+		} });
+
+		benchmarks.push_back({ "GetEntitiesWith/2" + suffix, [density](Timer& timer) {
+			auto world = MakePopulatedWorld(density, density, density);
+			timer.start();
+			auto entities = world->GetEntitiesWith<Position, MeshRenderer>();
+			timer.stop();
+			return static_cast<size_t>(NUM_ENTITIES);
+		} });
+
+		benchmarks.push_back({ "GetEntitiesWith/3" + suffix, [density](Timer& timer) {
+			auto world = MakePopulatedWorld(density, density, density);
+			timer.start();
+			auto entities = world->GetEntitiesWith<Position, MeshRenderer, AI>();
+			timer.stop();
+			return static_cast<size_t>(NUM_ENTITIES);
+		} });
+
+		benchmarks.push_back({ "GetComponents/1" + suffix, [density](Timer& timer) {
+			auto world = MakePopulatedWorld(density, density, density);
+			timer.start();
+			auto components = world->GetComponents<Position>();
+			timer.stop();
+			return static_cast<size_t>(NUM_ENTITIES);
+		} });
+
+		benchmarks.push_back({ "GetComponents/2" + suffix, [density](Timer& timer) {
+			auto world = MakePopulatedWorld(density, density, density);
+			timer.start();
+			auto components = world->GetComponents<Position, MeshRenderer>();
+			timer.stop();
+			return static_cast<size_t>(NUM_ENTITIES);
+		} });
+
+		benchmarks.push_back({ "GetComponents/3" + suffix, [density](Timer& timer) {
+			auto world = MakePopulatedWorld(density, density, density);
+			timer.start();
+			auto components = world->GetComponents<Position, MeshRenderer, AI>();
+			timer.stop();
+			return static_cast<size_t>(NUM_ENTITIES);
+		} });
+
+		// density here is the share of Positions changed since the system last ran.
+		benchmarks.push_back({ "GetComponents/changed" + suffix, [density](Timer& timer) {
+			std::vector<uint32_t> entities;
+			auto world = MakePopulatedWorld(100, 100, 0, &entities);
+			auto last_run = world->SystemTick();
+			for (size_t i = 0; i < entities.size(); i += 100 / density) {
+				world->GetComponent<Position>(entities[i])->x += 1.0f;
+			}
+			timer.start();
+			auto components = world->GetComponents<Changed<const Position>, const MeshRenderer>(last_run);
+			timer.stop();
+			return static_cast<size_t>(NUM_ENTITIES);
+		} });
+	}
+
+	benchmarks.push_back({ "PropagateTransforms", [](Timer& timer) {
+		// a forest of trees, each node with up to four children.
+		std::vector<uint32_t> entities;
+		auto world = MakePopulatedWorld(100, 0, 0, &entities);
+		for (size_t i = 1; i < entities.size(); i++) {
+			if (i % 100 != 0) {
+				world->SetParent(entities[i], entities[(i - 1) / 4]);
+			}
+		}
+		timer.start();
+		world->PropagateTransforms();
+		timer.stop();
+		return entities.size();
+	} });
+
+	benchmarks.push_back({ "Snapshot/rollback_1%", [](Timer& timer) {
+		// one rollback tick - snapshot, change 1% of the Positions, restore.
+		std::vector<uint32_t> entities;
+		auto world = MakePopulatedWorld(100, 50, 10, &entities);
+		timer.start();
+		auto snapshot = world->Snapshot();
+		for (size_t i = 0; i < entities.size(); i += 100) {
+			world->GetComponent<Position>(entities[i])->x += 1.0f;
+		}
+		world->Restore(snapshot);
+		timer.stop();
+		return entities.size();
+	} });
+
+	benchmarks.push_back({ "Replication/encode_1%", [](Timer& timer) {
+		// one tick for one client interested in every entity, after 1% of the Positions moved.
+		return BenchReplication(timer, 100, false);
+	} });
+
+	benchmarks.push_back({ "Replication/encode_all", [](Timer& timer) {
+		return BenchReplication(timer, 1, false);
+	} });
+
+	benchmarks.push_back({ "Replication/loopback_1%", [](Timer& timer) {
+		// as encode_1%, plus decoding the packet into a client World.
+		return BenchReplication(timer, 100, true);
+	} });
+
+	benchmarks.push_back({ "SystemTask/pass", [](Timer& timer) {
+		// one whole pass of a budgeted system whose budget never runs out, the overhead per entity of
+		// the resumable view and the budget checks.
+		auto world = MakePopulatedWorld(100, 0, 100);
+		FrameBudget budget;
+		budget.Start(60 * 1000 * 1000);
+		size_t visited{ 0 };
+		auto system = TouchAI(*world, budget, visited);
+
+		timer.start();
+		system.Resume();
+		timer.stop();
+		return visited;
+	} });
+
+	benchmarks.push_back({ "Serialise", [](Timer& timer) {
+		auto world = MakePopulatedWorld(100, 50, 10);
+		std::ofstream file("ecs_bench_save.bin", std::ios::binary);
+
+		timer.start();
+		world->Serialise(file);
+		world->Serialise<Position>(file);
+		world->Serialise<MeshRenderer>(file);
+		world->Serialise<AI>(file);
+		file.flush();
+		timer.stop();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "SaveChunked", [](Timer& timer) {
+		auto world = MakePopulatedWorld(100, 50, 10);
+		std::ofstream file("ecs_bench_save.bin", std::ios::binary);
+
+		timer.start();
+		world->SaveChunked<Position, MeshRenderer, AI>(file);
+		file.flush();
+		timer.stop();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "LoadChunked", [](Timer& timer) {
+		{
+			auto world = MakePopulatedWorld(100, 50, 10);
+			std::ofstream file("ecs_bench_save.bin", std::ios::binary);
+			world->SaveChunked<Position, MeshRenderer, AI>(file);
+		}
+		std::ifstream file("ecs_bench_save.bin", std::ios::binary);
+		auto world = MakeWorld();
+
+		timer.start();
+		world->LoadChunked<Position, MeshRenderer, AI>(file);
+		timer.stop();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "SaveAsync/capture", [](Timer& timer) {
+		// only the capture is timed, it is all the simulation thread pays for.
+		auto world = MakePopulatedWorld(100, 50, 10);
+		timer.start();
+		auto saved = world->SaveAsync<Position, MeshRenderer, AI>("ecs_bench_save.bin");
+		timer.stop();
+		saved.get();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "FrameExtract/publish", [](Timer& timer) {
+		// after the views have grown, publishing is a copy per component.
+		auto world = MakePopulatedWorld(100, 100, 10);
+		FrameExtract<Position, MeshRenderer> extract;
+		for (int i = 0; i < 3; i++) {
+			extract.Publish(*world);
+		}
+		timer.start();
+		extract.Publish(*world);
+		timer.stop();
+		return extract.Acquire()->size();
+	} });
+
+	benchmarks.push_back({ "KillAfter/expire", [](Timer& timer) {
+		// lifetimes of 1 to 600 frames, run until every entity has been killed.
+		auto world = MakeWorld();
+		auto entities = CreateEntities(*world, NUM_ENTITIES);
+		std::mt19937 rng{ 42 };
+		for (auto entity : entities) {
+			world->KillAfter(entity, rng() % 600 + 1);
+		}
+
+		timer.start();
+		for (int frame = 0; frame < 600; frame++) {
+			world->EndFrame();
+		}
+		timer.stop();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "KillAfter/scan_lifetimes", [](Timer& timer) {
+		// the same lifetimes counted down in a component which is visited every frame.
+		auto world = MakeWorld();
+		world->RegisterComponent<Lifetime>();
+		auto entities = CreateEntities(*world, NUM_ENTITIES);
+		std::mt19937 rng{ 42 };
+		for (auto entity : entities) {
+			world->AddComponent<Lifetime>(entity, static_cast<uint32_t>(rng() % 600 + 1));
+		}
+
+		std::vector<uint32_t> expired;
+		timer.start();
+		for (int frame = 0; frame < 600; frame++) {
+			expired.clear();
+			for (auto entity : world->GetEntitiesWith<Lifetime>()) {
+				if (--world->GetComponent<Lifetime>(entity)->ticks == 0) {
+					expired.push_back(entity);
+				}
+			}
+			for (auto& entity : expired) {
+				world->KillEntity(entity);
+			}
+			world->EndFrame();
+		}
+		timer.stop();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	benchmarks.push_back({ "Deserialise", [](Timer& timer) {
+		{
+			auto world = MakePopulatedWorld(100, 50, 10);
+			std::ofstream file("ecs_bench_save.bin", std::ios::binary);
+			world->Serialise(file);
+			world->Serialise<Position>(file);
+			world->Serialise<MeshRenderer>(file);
+			world->Serialise<AI>(file);
+		}
+		std::ifstream file("ecs_bench_save.bin", std::ios::binary);
+		std::vector<char> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		auto world = MakeWorld();
+
+		timer.start();
+		size_t offset{ 0 };
+		world->Deserialise(buffer.data(), offset);
+		world->Deserialise<Position>(buffer.data(), offset);
+		world->Deserialise<MeshRenderer>(buffer.data(), offset);
+		world->Deserialise<AI>(buffer.data(), offset);
+		timer.stop();
+		return static_cast<size_t>(NUM_ENTITIES);
+	} });
+
+	return benchmarks;
+}
+
+Result Run(const Benchmark& benchmark, const double min_time_s) {
+	Timer timer;
+	Result result;
+	result.name = benchmark.name;
+
+	do {
+		result.items += benchmark.function(timer);
+		result.batches++;
+	} while (timer.elapsed_ns < min_time_s * 1e9);
+
+	result.ns_per_op = timer.elapsed_ns / static_cast<double>(result.items);
+	result.items_per_second = static_cast<double>(result.items) / (timer.elapsed_ns * 1e-9);
+	result.allocations_per_op = static_cast<double>(timer.allocations) / static_cast<double>(result.items);
+	result.bytes_per_op = static_cast<double>(timer.bytes) / static_cast<double>(result.items);
+	return result;
+}
+
+void WriteJSON(std::FILE* out, const std::vector<Result>& results) {
+	char date[32];
+	auto now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::gmtime(&now));
+
+	std::fprintf(out, "{\n  \"context\": {\n");
+	std::fprintf(out, "    \"date\": \"%s\",\n", date);
+	std::fprintf(out, "    \"num_entities\": %d,\n", NUM_ENTITIES);
+	std::fprintf(out, "    \"max_entities\": %d\n", MAX_ENTITIES);
+	std::fprintf(out, "  },\n  \"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		auto& result = results[i];
+		std::fprintf(out, "    {\"name\": \"%s\", \"batches\": %zu, \"items\": %zu, \"ns_per_op\": %.3f, "
+			"\"items_per_second\": %.1f, \"allocations_per_op\": %.4f, \"bytes_per_op\": %.3f}%s\n",
+			result.name.c_str(), result.batches, result.items, result.ns_per_op,
+			result.items_per_second, result.allocations_per_op, result.bytes_per_op, i + 1 < results.size() ? "," : "");
+	}
+	std::fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+	std::string filter;
+	std::string out_path;
+	double min_time_s{ 0.5 };
+
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+			min_time_s = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			out_path = argv[++i];
+		}
+		else {
+			std::fprintf(stderr, "usage: %s [--filter <substring>] [--min-time <seconds>] [--out <file>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<Result> results;
+	for (auto& benchmark : MakeBenchmarks()) {
+		if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) {
+			continue;
+		}
+		results.push_back(Run(benchmark, min_time_s));
+		std::fprintf(stderr, "%-32s %12.2f ns/op %14.0f items/s %8.4f allocs/op %8.3f bytes/op\n", results.back().name.c_str(),
+			results.back().ns_per_op, results.back().items_per_second, results.back().allocations_per_op, results.back().bytes_per_op);
+	}
+	std::remove("ecs_bench_save.bin");
+
+	std::FILE* out = out_path.empty() ? stdout : std::fopen(out_path.c_str(), "w");
+	if (out == nullptr) {
+		std::fprintf(stderr, "could not open %s\n", out_path.c_str());
+		return 1;
+	}
+	WriteJSON(out, results);
+	if (out != stdout) {
+		std::fclose(out);
+	}
+	return 0;
+}
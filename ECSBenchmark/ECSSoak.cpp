@@ -0,0 +1,322 @@
+#include "World.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+/*
+* ecs_soak - long running churn test.
+*
+* Drives a random mix of create, kill, add, remove and query operations against one World, timing
+* every operation into a log-linear latency histogram per operation. Resident memory, the free list
+* length and the number of live entities are sampled at a fixed interval. The run fails if resident
+* memory grows by more than the allowed amount after the warm up interval.
+*
+*	ecs_soak [--minutes <m> | --seconds <s>] [--mix create,kill,add,remove,query] [--interval <s>]
+*	         [--max-rss-growth-mb <mb>] [--seed <n>] [--out <file>] [--trace <file>]
+*
+* --trace writes the World's counters and timings as a Chrome trace, it needs a build configured with
+* -DECS_INSTRUMENTATION=ON.
+*/
+
+class LatencyHistogram
+{
+	/* HDR style histogram - values are bucketed by their highest set bit, and each of those ranges is
+	*  split into 2^SUB_BUCKET_BITS linear sub buckets, so every recorded value is accurate to ~3%.
+	*/
+private:
+	static const int SUB_BUCKET_BITS{ 5 };
+	static const int SUB_BUCKETS{ 1 << SUB_BUCKET_BITS };
+	static const int MAGNITUDES{ 64 - SUB_BUCKET_BITS + 1 };
+
+	std::vector<uint64_t> m_counts = std::vector<uint64_t>(MAGNITUDES * SUB_BUCKETS, 0);
+	uint64_t m_total{ 0 };
+	uint64_t m_max{ 0 };
+
+	static int BucketIndex(const uint64_t value) {
+		if (value < SUB_BUCKETS) {
+			return static_cast<int>(value);
+		}
+		int magnitude{ 63 };
+		while ((value >> magnitude) == 0) {
+			magnitude--;
+		}
+		// keep the top SUB_BUCKET_BITS + 1 bits of the value.
+		auto shift = magnitude - SUB_BUCKET_BITS;
+		auto sub_bucket = static_cast<int>(value >> shift) - SUB_BUCKETS;
+		return (shift + 1) * SUB_BUCKETS + sub_bucket;
+	}
+
+	static uint64_t BucketValue(const int index) {
+		/* The highest value which falls into the bucket. */
+		if (index < SUB_BUCKETS) {
+			return static_cast<uint64_t>(index);
+		}
+		auto shift = index / SUB_BUCKETS - 1;
+		auto top_bits = static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS);
+		return ((top_bits + 1) << shift) - 1;
+	}
+
+public:
+	void record(const uint64_t value) {
+		m_counts[BucketIndex(value)]++;
+		m_total++;
+		if (value > m_max) {
+			m_max = value;
+		}
+	}
+
+	uint64_t percentile(const double percent) const {
+		if (m_total == 0) {
+			return 0;
+		}
+		auto target = static_cast<uint64_t>(std::ceil(percent / 100.0 * static_cast<double>(m_total)));
+		uint64_t seen{ 0 };
+		for (size_t i = 0; i < m_counts.size(); i++) {
+			seen += m_counts[i];
+			if (seen >= target) {
+				auto value = BucketValue(static_cast<int>(i));
+				return value < m_max ? value : m_max;
+			}
+		}
+		return m_max;
+	}
+
+	inline uint64_t count() const {
+		return m_total;
+	}
+
+	inline uint64_t max() const {
+		return m_max;
+	}
+};
+
+size_t ResidentBytes() {
+	/* Current resident set size, 0 where it can't be read. */
+#ifdef __linux__
+	std::FILE* statm = std::fopen("/proc/self/statm", "r");
+	if (statm == nullptr) {
+		return 0;
+	}
+	unsigned long total_pages{ 0 };
+	unsigned long resident_pages{ 0 };
+	auto read = std::fscanf(statm, "%lu %lu", &total_pages, &resident_pages);
+	std::fclose(statm);
+	return read == 2 ? resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+	return 0;
+#endif
+}
+
+enum Operation { CREATE, KILL, ADD, REMOVE, QUERY, NUM_OPERATIONS };
+
+const char* OPERATION_NAMES[NUM_OPERATIONS]{ "create", "kill", "add", "remove", "query" };
+
+struct Sample
+{
+	double elapsed_s;
+	size_t resident_bytes;
+	size_t free_entities;
+	size_t live_entities;
+	uint64_t operations;
+};
+
+int main(int argc, char** argv) {
+	double duration_s{ 60.0 };
+	double interval_s{ 1.0 };
+	double max_rss_growth_mb{ 16.0 };
+	unsigned int seed{ 1 };
+	int mix[NUM_OPERATIONS]{ 20, 20, 25, 25, 10 };
+	std::string out_path;
+	std::string trace_path;
+
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--minutes") == 0 && i + 1 < argc) {
+			duration_s = std::atof(argv[++i]) * 60.0;
+		}
+		else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+			duration_s = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+			interval_s = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--max-rss-growth-mb") == 0 && i + 1 < argc) {
+			max_rss_growth_mb = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = static_cast<unsigned int>(std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--mix") == 0 && i + 1 < argc) {
+			if (std::sscanf(argv[++i], "%d,%d,%d,%d,%d", &mix[CREATE], &mix[KILL], &mix[ADD], &mix[REMOVE], &mix[QUERY]) != 5) {
+				std::fprintf(stderr, "--mix expects five weights: create,kill,add,remove,query\n");
+				return 1;
+			}
+		}
+		else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			out_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+		}
+		else {
+			std::fprintf(stderr, "usage: %s [--minutes <m> | --seconds <s>] [--mix create,kill,add,remove,query] "
+				"[--interval <s>] [--max-rss-growth-mb <mb>] [--seed <n>] [--out <file>] [--trace <file>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	World world;
+	world.RegisterComponent<Position>();
+	world.RegisterComponent<MeshRenderer>();
+	world.RegisterComponent<AI>();
+
+	std::mt19937 rng{ seed };
+	std::discrete_distribution<int> pick_operation(std::begin(mix), std::end(mix));
+	std::uniform_int_distribution<int> pick_component(0, 2);
+
+	std::vector<uint32_t> alive;
+	alive.reserve(MAX_ENTITIES);
+	LatencyHistogram histograms[NUM_OPERATIONS];
+	std::vector<Sample> samples;
+	uint64_t operations{ 0 };
+	double checksum{ 0.0 };
+
+	auto random_alive = [&]() -> size_t {
+		return std::uniform_int_distribution<size_t>(0, alive.size() - 1)(rng);
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+	auto next_sample_s = 0.0;
+	auto elapsed_s = 0.0;
+
+	while (elapsed_s < duration_s) {
+		// one frame of operations between each clock check.
+		for (int i = 0; i < 1000; i++) {
+			auto operation = static_cast<Operation>(pick_operation(rng));
+			if (operation != CREATE && alive.empty()) {
+				operation = CREATE;
+			}
+			if (operation == CREATE && alive.size() == MAX_ENTITIES) {
+				operation = KILL;
+			}
+
+			auto component = pick_component(rng);
+			auto index = alive.empty() ? 0 : random_alive();
+			auto begin = std::chrono::steady_clock::now();
+
+			switch (operation) {
+			case CREATE:
+				alive.push_back(world.CreateEntity());
+				break;
+			case KILL:
+				world.KillEntity(alive[index]);
+				alive[index] = alive.back();
+				alive.pop_back();
+				break;
+			case ADD:
+				if (component == 0 && !world.HasComponent(world.GetID<Position>(), alive[index])) {
+					world.AddComponent<Position>(alive[index], 1.0f, 1.0f, 1.0f);
+				}
+				else if (component == 1 && !world.HasComponent(world.GetID<MeshRenderer>(), alive[index])) {
+					world.AddComponent<MeshRenderer>(alive[index], 1);
+				}
+				else if (component == 2 && !world.HasComponent(world.GetID<AI>(), alive[index])) {
+					world.AddComponent<AI>(alive[index]);
+				}
+				break;
+			case REMOVE:
+				if (component == 0) {
+					world.RemoveComponent<Position>(alive[index]);
+				}
+				else if (component == 1) {
+					world.RemoveComponent<MeshRenderer>(alive[index]);
+				}
+				else {
+					world.RemoveComponent<AI>(alive[index]);
+				}
+				break;
+			case QUERY:
+				for (auto& [p, m] : world.GetComponents<Position, MeshRenderer>()) {
+					checksum += p->x;
+				}
+				break;
+			default:
+				break;
+			}
+
+			auto end = std::chrono::steady_clock::now();
+			histograms[operation].record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()));
+			operations++;
+		}
+		world.EndFrame();
+
+		elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (elapsed_s >= next_sample_s) {
+			samples.push_back({ elapsed_s, ResidentBytes(), world.GetNumFreeEntities(), alive.size(), operations });
+			next_sample_s += interval_s;
+		}
+	}
+	samples.push_back({ elapsed_s, ResidentBytes(), world.GetNumFreeEntities(), alive.size(), operations });
+
+	// compare against the first sample after the warm up interval, when the pools and free list have settled.
+	auto& baseline = samples.size() > 2 ? samples[1] : samples.front();
+	auto growth_bytes = static_cast<double>(samples.back().resident_bytes) - static_cast<double>(baseline.resident_bytes);
+	bool passed = growth_bytes <= max_rss_growth_mb * 1024.0 * 1024.0;
+
+	std::FILE* out = out_path.empty() ? stdout : std::fopen(out_path.c_str(), "w");
+	if (out == nullptr) {
+		std::fprintf(stderr, "could not open %s\n", out_path.c_str());
+		return 1;
+	}
+
+	std::fprintf(out, "{\n  \"duration_s\": %.3f,\n  \"operations\": %llu,\n  \"checksum\": %.1f,\n", elapsed_s,
+		static_cast<unsigned long long>(operations), checksum);
+	std::fprintf(out, "  \"rss_growth_bytes\": %.0f,\n  \"max_rss_growth_bytes\": %.0f,\n  \"passed\": %s,\n", growth_bytes,
+		max_rss_growth_mb * 1024.0 * 1024.0, passed ? "true" : "false");
+	std::fprintf(out, "  \"latency_ns\": {\n");
+	for (int i = 0; i < NUM_OPERATIONS; i++) {
+		auto& histogram = histograms[i];
+		std::fprintf(out, "    \"%s\": {\"count\": %llu, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}%s\n",
+			OPERATION_NAMES[i], static_cast<unsigned long long>(histogram.count()),
+			static_cast<unsigned long long>(histogram.percentile(50.0)),
+			static_cast<unsigned long long>(histogram.percentile(99.0)),
+			static_cast<unsigned long long>(histogram.percentile(99.9)),
+			static_cast<unsigned long long>(histogram.max()), i + 1 < NUM_OPERATIONS ? "," : "");
+	}
+	std::fprintf(out, "  },\n  \"samples\": [\n");
+	for (size_t i = 0; i < samples.size(); i++) {
+		auto& sample = samples[i];
+		std::fprintf(out, "    {\"elapsed_s\": %.3f, \"rss_bytes\": %zu, \"free_entities\": %zu, \"live_entities\": %zu, "
+			"\"operations\": %llu}%s\n", sample.elapsed_s, sample.resident_bytes, sample.free_entities,
+			sample.live_entities, static_cast<unsigned long long>(sample.operations), i + 1 < samples.size() ? "," : "");
+	}
+	std::fprintf(out, "  ]\n}\n");
+	if (out != stdout) {
+		std::fclose(out);
+	}
+
+	if (!trace_path.empty()) {
+#ifdef ECS_INSTRUMENTATION
+		std::ofstream trace(trace_path);
+		world.GetInstrumentation().write_chrome_trace(trace);
+#else
+		std::fprintf(stderr, "--trace needs a build with ECS_INSTRUMENTATION defined, no trace written\n");
+#endif
+	}
+
+	if (!passed) {
+		std::fprintf(stderr, "resident memory grew by %.0f bytes, more than the allowed %.1f MB\n", growth_bytes, max_rss_growth_mb);
+		return 1;
+	}
+	return 0;
+}
@@ -1,11 +1,156 @@
 #include "pch.h"
 #include "CppUnitTest.h"
 #include "..\World.h"
+#include "..\Replication.h"
+#include "..\Coroutines.h"
+#include "..\FrameExtract.h"
 
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sstream>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
+// count every global heap allocation made by the tests.
+static std::atomic<size_t> g_allocations{ 0 };
+
+void* operator new(size_t size)
+{
+	g_allocations++;
+	if (void* p = std::malloc(size > 0 ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept
+{
+	std::free(p);
+}
+
+struct CountingResource : public std::pmr::memory_resource
+{
+	size_t allocations{ 0 };
+	size_t deallocations{ 0 };
+
+	virtual void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		allocations++;
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+
+	virtual void do_deallocate(void* p, size_t bytes, size_t alignment) override
+	{
+		deallocations++;
+		std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	}
+
+	virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+struct Tracked
+{
+	Tracked() {};
+	Tracked(int _value) : value(_value) {};
+	int value{ 0 };
+
+	static inline int constructed{ 0 };
+	static inline int updated{ 0 };
+	static inline int destroyed{ 0 };
+};
+
+struct Collision
+{
+	Collision(uint32_t _a, uint32_t _b) : a(_a), b(_b) {};
+	uint32_t a;
+	uint32_t b;
+};
+
+struct Padded
+{
+	int value{ 0 };
+};
+
+template <>
+struct ComponentLayout<Padded> : PaddedLayout<Padded> {};
+
+struct Settings : public ISerializeable
+{
+	Settings() {};
+	Settings(uint32_t _gravity) : gravity(_gravity) {};
+	uint32_t gravity{ 0 };
+
+	virtual void serialise(std::ostream& file) override { utils::serialiseUint32(file, gravity); };
+	virtual void deserialise(const char* buffer, size_t& offset) override { gravity = utils::deserialiseUint32(buffer, offset); };
+};
+
+// the same data as Settings, held in a hash table and in a stable pool.
+struct Rare : public Settings { using Settings::Settings; };
+struct Anchor : public Settings { using Settings::Settings; };
+
+template <>
+struct ComponentStorage<Rare> : HashedStorage {};
+
+template <>
+struct ComponentStorage<Anchor> : StableStorage {};
+
+template <>
+struct Signals<Tracked> : Listeners<Tracked>
+{
+	static void on_construct(World& world, const uint32_t entity, Tracked& component) { Tracked::constructed++; };
+	static void on_update(World& world, const uint32_t entity, Tracked& component) { Tracked::updated++; };
+	static void on_destroy(World& world, const uint32_t entity, Tracked& component) { Tracked::destroyed++; };
+};
+
+// a flag, the padding after it and a field which isn't sent, none of which should cause a resend.
+template <>
+struct Replicated<Settings>
+{
+	static constexpr bool enabled{ true };
+	struct State { uint8_t flag; uint32_t gravity; uint32_t unsent; };
+	static inline uint32_t quantised{ 0 };
+	static State quantise(const Settings& settings) { return { 1, settings.gravity, quantised++ }; };
+	static void write(BitWriter& writer, const State& state, const State&) { writer.write(state.flag, 1); writer.write(state.gravity, 32); };
+	static State read(BitReader& reader, const State&) { return { static_cast<uint8_t>(reader.read(1)), reader.read(32), 0 }; };
+	static void apply(const State& state, Settings& settings) { settings.gravity = state.gravity; };
+};
+
+SystemTask CountAI(World& world, const FrameBudget& budget, std::vector<uint32_t>& visited, int& passes)
+{
+	ResumableView<Position, AI> view(world);
+	while (true) {
+		for (auto entity : view) {
+			visited.push_back(entity);
+			co_yield budget;
+		}
+		passes++;
+		co_yield NextFrame{};
+	}
+}
+
+SystemTask CountPasses(World& world, int& visited, int& passes)
+{
+	ResumableView<Position, AI> view(world);
+	while (true) {
+		for (auto entity : view) {
+			visited += entity != NULL_ENTITY;
+		}
+		passes++;
+		co_yield NextFrame{};
+	}
+}
+
 namespace ECSUnitTest
 {
 	TEST_CLASS(ECSUnitTest)
@@ -422,5 +567,1805 @@ namespace ECSUnitTest
 			}
 			Assert::AreEqual(5, i);
 		}
+
+		TEST_METHOD(ConstructSignal)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			int calls{ 0 };
+			float x{ 0.0f };
+			world.OnConstruct<Position>([&](World& w, uint32_t e, Position& p) { calls++; x = p.x; });
+
+			auto entity = world.CreateEntity();
+			world.AddComponent<Position>(entity, 3.0f, 0.0f, 0.0f);
+
+			Assert::AreEqual(1, calls);
+			Assert::AreEqual(3.0f, x);
+		}
+
+		TEST_METHOD(DestroySignalOnKillEntity)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<MeshRenderer>();
+			int calls{ 0 };
+			world.OnDestroy<MeshRenderer>([&](World& w, uint32_t e, MeshRenderer& m) { calls += m.id; });
+
+			auto entity = world.CreateEntity();
+			world.AddComponent<Position>(entity);
+			world.AddComponent<MeshRenderer>(entity, 7);
+			world.KillEntity(entity);
+
+			Assert::AreEqual(7, calls);
+		}
+
+		TEST_METHOD(PatchAndReplaceSignal)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			int calls{ 0 };
+			world.OnUpdate<Position>([&](World& w, uint32_t e, Position& p) { calls++; });
+
+			auto entity = world.CreateEntity();
+			world.AddComponent<Position>(entity);
+			world.Patch<Position>(entity, [](Position& p) { p.x = 5.0f; });
+			auto* p = world.Replace<Position>(entity, 1.0f, 2.0f, 3.0f);
+
+			Assert::AreEqual(2, calls);
+			Assert::AreEqual(1.0f, p->x);
+		}
+
+		TEST_METHOD(DisconnectSignal)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			int calls{ 0 };
+			auto connection = world.OnConstruct<Position>([&](World& w, uint32_t e, Position& p) { calls++; });
+			world.Disconnect<Position>(connection);
+
+			auto entity = world.CreateEntity();
+			world.AddComponent<Position>(entity);
+
+			Assert::AreEqual(0, calls);
+		}
+
+		TEST_METHOD(StaticSignals)
+		{
+			World world;
+			world.RegisterComponent<Tracked>();
+			Tracked::constructed = Tracked::updated = Tracked::destroyed = 0;
+
+			auto entity = world.CreateEntity();
+			world.AddComponent<Tracked>(entity, 1);
+			world.Patch<Tracked>(entity, [](Tracked& t) { t.value++; });
+			world.RemoveComponent<Tracked>(entity);
+
+			Assert::AreEqual(1, Tracked::constructed);
+			Assert::AreEqual(1, Tracked::updated);
+			Assert::AreEqual(1, Tracked::destroyed);
+		}
+
+		TEST_METHOD(EmitEventReadNextFrame)
+		{
+			World world;
+			world.RegisterEvent<Collision>();
+			world.Emit<Collision>(1U, 2U);
+
+			Assert::AreEqual(static_cast<size_t>(0), world.GetEvents<Collision>().size());
+
+			world.EndFrame();
+			uint32_t sum{ 0 };
+			world.GetEvents<Collision>().for_each([&](const Collision& c) { sum += c.a + c.b; });
+			Assert::AreEqual(3U, sum);
+
+			world.EndFrame();
+			Assert::AreEqual(static_cast<size_t>(0), world.GetEvents<Collision>().size());
+		}
+
+		TEST_METHOD(EmitEventsFromMultipleThreads)
+		{
+			World world;
+			world.RegisterEvent<Collision>();
+
+			std::vector<std::thread> threads;
+			for (int i = 0; i < 4; i++) {
+				threads.emplace_back([&world]() {
+					for (uint32_t j = 0; j < 100; j++) {
+						world.Emit<Collision>(j, j);
+					}
+				});
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			world.EndFrame();
+
+			Assert::AreEqual(static_cast<size_t>(400), world.GetEvents<Collision>().size());
+		}
+
+		TEST_METHOD(EmitFromMoreThreadsThanSlotsOverTime)
+		{
+			World world;
+			world.RegisterEvent<Collision>();
+
+			for (uint32_t i = 0; i < 2 * MAX_EVENT_THREADS; i++) {
+				std::thread([&world, i]() { world.Emit<Collision>(i, i); }).join();
+			}
+			world.EndFrame();
+
+			Assert::AreEqual(static_cast<size_t>(2 * MAX_EVENT_THREADS), world.GetEvents<Collision>().size());
+		}
+
+		TEST_METHOD(EmitUnregisteredEvent)
+		{
+			World world;
+			Assert::ExpectException<std::runtime_error>([&world]() { world.Emit<Collision>(1U, 2U); });
+		}
+
+		TEST_METHOD(DetectTagComponents)
+		{
+			Assert::IsTrue(is_tag_v<AI>);
+			Assert::IsTrue(is_tag_v<Model>);
+			Assert::IsFalse(is_tag_v<Position>);
+			Assert::IsFalse(is_tag_v<MeshRenderer>);
+		}
+
+		TEST_METHOD(AddAndRemoveTagComponent)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<AI>();
+			auto e1 = world.CreateEntity();
+			auto e2 = world.CreateEntity();
+			world.AddComponent<Position>(e1);
+			world.AddComponent<Position>(e2);
+			world.AddComponent<AI>(e1);
+			world.AddComponent<AI>(e2);
+
+			Assert::IsNotNull(world.GetComponent<AI>(e1));
+			Assert::AreEqual(static_cast<size_t>(2), world.GetEntitiesWith<Position, AI>().size());
+
+			world.RemoveComponent<AI>(e1);
+
+			Assert::IsNull(world.GetComponent<AI>(e1));
+			Assert::IsNotNull(world.GetComponent<AI>(e2));
+			Assert::AreEqual(static_cast<size_t>(1), world.GetEntitiesWith<Position, AI>().size());
+		}
+
+		TEST_METHOD(WorldAllocatesFromSuppliedResource)
+		{
+			CountingResource counting;
+			{
+				World world(&counting);
+				world.RegisterComponent<Position>();
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity);
+
+				Assert::IsTrue(counting.allocations > 0);
+			}
+			Assert::AreEqual(counting.allocations, counting.deallocations);
+		}
+
+		TEST_METHOD(FrameArenaRewindsWhenEmpty)
+		{
+			CountingResource counting;
+			FrameArena arena(64, &counting);
+			{
+				std::pmr::vector<uint32_t> scratch(&arena);
+				scratch.resize(100); // larger than the block, so taken upstream
+			}
+			arena.reset();
+			auto allocations = counting.allocations;
+			{
+				std::pmr::vector<uint32_t> scratch(&arena);
+				scratch.resize(100); // the block has grown to fit
+			}
+			Assert::AreEqual(allocations, counting.allocations);
+			Assert::IsTrue(arena.capacity() >= 400);
+		}
+
+		TEST_METHOD(SteadyStateFramesDoNotAllocate)
+		{
+			CountingResource counting;
+			World world(&counting);
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<MeshRenderer>();
+			world.RegisterEvent<Collision>();
+
+			auto frame = [&world]() {
+				uint32_t entities[100];
+				for (uint32_t i = 0; i < 100; i++) {
+					entities[i] = world.CreateEntity();
+					world.AddComponent<Position>(entities[i], 1.0f, 1.0f, 1.0f);
+					if (i % 2) {
+						world.AddComponent<MeshRenderer>(entities[i], i);
+					}
+					world.Emit<Collision>(i, i);
+				}
+				for (auto& [p, m] : world.GetComponents<Position, MeshRenderer>()) {
+					p->x += static_cast<float>(m->id);
+				}
+				auto moving = world.GetEntitiesWith<Position>();
+				for (auto& entity : entities) {
+					world.KillEntity(entity);
+				}
+				world.EndFrame();
+			};
+
+			for (int i = 0; i < 3; i++) {
+				frame();
+			}
+
+			auto global_allocations = g_allocations.load();
+			auto resource_allocations = counting.allocations;
+			for (int i = 0; i < 10; i++) {
+				frame();
+			}
+
+#ifndef ECS_INSTRUMENTATION
+			// the trace buffer grows as timings are recorded.
+			Assert::AreEqual(global_allocations, g_allocations.load());
+#endif
+			Assert::AreEqual(resource_allocations, counting.allocations);
+		}
+
+		TEST_METHOD(PoolsAreCacheLineAligned)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			auto entity = world.CreateEntity();
+			world.AddComponent<Position>(entity);
+
+			auto address = reinterpret_cast<uintptr_t>(world.GetComponent<Position>(entity));
+			Assert::AreEqual(static_cast<uintptr_t>(0), address % CACHE_LINE_SIZE);
+		}
+
+		TEST_METHOD(PaddedComponentLayout)
+		{
+			World world;
+			world.RegisterComponent<Padded>();
+			auto e1 = world.CreateEntity();
+			auto e2 = world.CreateEntity();
+			world.AddComponent<Padded>(e1);
+			world.AddComponent<Padded>(e2);
+
+			auto address1 = reinterpret_cast<uintptr_t>(world.GetComponent<Padded>(e1));
+			auto address2 = reinterpret_cast<uintptr_t>(world.GetComponent<Padded>(e2));
+			Assert::AreEqual(static_cast<uintptr_t>(CACHE_LINE_SIZE), address2 - address1);
+		}
+
+		TEST_METHOD(IterateComponentSpan)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			for (int i = 0; i < 10; i++) {
+				auto e = world.CreateEntity();
+				world.AddComponent<Position>(e, static_cast<float>(i), 0.0f, 0.0f);
+			}
+
+			auto positions = world.GetComponentSpan<Position>();
+			auto entities = world.GetEntitySpan<Position>();
+			float sum{ 0.0f };
+			for (auto& p : positions) {
+				sum += p.x;
+			}
+
+			Assert::AreEqual(static_cast<size_t>(10), positions.size);
+			Assert::AreEqual(positions.size, entities.size);
+			Assert::AreEqual(45.0f, sum);
+		}
+
+		TEST_METHOD(ComponentIDsSharedBetweenWorlds)
+		{
+			World first;
+			first.RegisterComponent<Position>();
+			first.RegisterComponent<MeshRenderer>();
+
+			World second;
+			second.RegisterComponent<MeshRenderer>();
+			second.RegisterComponent<Position>();
+
+			Assert::AreEqual(first.GetID<Position>(), second.GetID<Position>());
+			Assert::AreEqual(first.GetID<MeshRenderer>(), second.GetID<MeshRenderer>());
+
+			auto entity = second.CreateEntity();
+			second.AddComponent<Position>(entity);
+			second.KillEntity(entity);
+			entity = second.CreateEntity();
+
+			Assert::IsNull(second.GetComponent<Position>(entity));
+		}
+
+		TEST_METHOD(MoveEntityBetweenWorlds)
+		{
+			World source;
+			source.RegisterComponent<Position>();
+			source.RegisterComponent<MeshRenderer>();
+			source.RegisterComponent<AI>();
+			World destination;
+
+			auto other = source.CreateEntity();
+			source.AddComponent<Position>(other, 9.0f, 9.0f, 9.0f);
+			auto entity = source.CreateEntity();
+			source.AddComponent<Position>(entity, 1.0f, 2.0f, 3.0f);
+			source.AddComponent<MeshRenderer>(entity, 4);
+			source.AddComponent<AI>(entity);
+
+			auto moved = source.MoveEntity(destination, entity);
+
+			Assert::IsNull(source.GetComponent<Position>(entity));
+			Assert::AreEqual(9.0f, source.GetComponent<Position>(other)->x);
+			Assert::AreEqual(2.0f, destination.GetComponent<Position>(moved)->y);
+			Assert::AreEqual(4U, destination.GetComponent<MeshRenderer>(moved)->id);
+			Assert::IsNotNull(destination.GetComponent<AI>(moved));
+		}
+
+		TEST_METHOD(MigrateEntities)
+		{
+			World source;
+			source.RegisterComponent<Position>();
+			World destination;
+			destination.RegisterComponent<Position>();
+
+			for (int i = 0; i < 10; i++) {
+				auto e = source.CreateEntity();
+				source.AddComponent<Position>(e, static_cast<float>(i), 0.0f, 0.0f);
+			}
+
+			auto entities = source.GetEntitiesWith<Position>();
+			auto moved = source.MigrateEntities(destination, entities);
+
+			Assert::AreEqual(static_cast<size_t>(0), source.GetEntitiesWith<Position>().size());
+			Assert::AreEqual(static_cast<size_t>(10), destination.GetEntitiesWith<Position>().size());
+			Assert::AreEqual(3.0f, destination.GetComponent<Position>(moved[3])->x);
+		}
+
+		TEST_METHOD(MigrateEntitiesFromStdVector)
+		{
+			World source;
+			source.RegisterComponent<Position>();
+			World destination;
+			destination.RegisterComponent<Position>();
+
+			auto e = source.CreateEntity();
+			source.AddComponent<Position>(e, 1.0f, 2.0f, 3.0f);
+			auto found = source.GetEntitiesWith<Position>();
+			std::vector<uint32_t> entities(found.begin(), found.end());
+			auto moved = source.MigrateEntities(destination, entities);
+
+			Assert::AreEqual(static_cast<size_t>(1), moved.size());
+			Assert::AreEqual(2.0f, destination.GetComponent<Position>(moved[0])->y);
+		}
+
+		TEST_METHOD(InstrumentationCountsAndExportsTrace)
+		{
+			Instrumentation instrumentation;
+			instrumentation.components[2].adds += 3;
+			instrumentation.record_query(0, QueryKind::COMPONENTS, { 1, 2 }, 10);
+			instrumentation.record_query(0, QueryKind::COMPONENTS, { 1, 2 }, 4);
+			{
+				ScopedTrace trace(instrumentation, "System");
+			}
+
+			auto snapshot = instrumentation.snapshot();
+			Assert::AreEqual(static_cast<uint64_t>(3), snapshot.components[2].adds);
+			Assert::AreEqual(static_cast<size_t>(1), snapshot.queries.size());
+			Assert::AreEqual(std::string("GetComponents<1,2>"), snapshot.queries[0].signature);
+			Assert::AreEqual(static_cast<uint64_t>(2), snapshot.queries[0].calls);
+			Assert::AreEqual(static_cast<uint64_t>(14), snapshot.queries[0].results);
+			Assert::AreEqual(static_cast<size_t>(1), snapshot.trace_events);
+
+			std::ostringstream out;
+			instrumentation.write_chrome_trace(out);
+			auto json = out.str();
+			Assert::IsTrue(json.find("\"name\":\"System\",\"cat\":\"ecs\",\"ph\":\"X\"") != std::string::npos);
+			Assert::IsTrue(json.find("\"name\":\"component 2\"") != std::string::npos);
+			Assert::IsTrue(json.find("\"name\":\"GetComponents<1,2>\"") != std::string::npos);
+		}
+
+		TEST_METHOD(InstrumentationTracesFromMultipleThreads)
+		{
+			Instrumentation instrumentation;
+
+			std::vector<std::thread> threads;
+			for (int i = 0; i < 4; i++) {
+				threads.emplace_back([&instrumentation]() {
+					for (int j = 0; j < 100; j++) {
+						ScopedTrace trace(instrumentation, "System");
+						instrumentation.record_query(0, QueryKind::ENTITIES_WITH, { 1 }, 1);
+						instrumentation.count_lookup(1);
+					}
+				});
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+
+			auto snapshot = instrumentation.snapshot();
+			Assert::AreEqual(static_cast<size_t>(400), snapshot.trace_events);
+			Assert::AreEqual(static_cast<uint64_t>(400), snapshot.queries[0].calls);
+			Assert::AreEqual(static_cast<uint64_t>(400), snapshot.components[1].lookups);
+		}
+
+#ifdef ECS_INSTRUMENTATION
+		TEST_METHOD(WorldCountsPoolActivity)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			auto id = world.GetID<Position>();
+
+			auto e1 = world.CreateEntity();
+			auto e2 = world.CreateEntity();
+			world.AddComponent<Position>(e1, 1.0f, 1.0f, 1.0f);
+			world.AddComponent<Position>(e2, 2.0f, 2.0f, 2.0f);
+			world.GetComponent<Position>(e2);
+			world.RemoveComponent<Position>(e1);
+			world.GetEntitiesWith<Position>();
+
+			auto snapshot = world.GetInstrumentation().snapshot();
+			Assert::AreEqual(static_cast<uint64_t>(2), snapshot.components[id].adds);
+			Assert::AreEqual(static_cast<uint64_t>(1), snapshot.components[id].removes);
+			Assert::AreEqual(static_cast<uint64_t>(1), snapshot.components[id].lookups);
+			Assert::AreEqual(static_cast<uint64_t>(1), snapshot.components[id].swap_and_pops);
+			Assert::AreEqual(static_cast<size_t>(1), snapshot.queries.size());
+			Assert::AreEqual(static_cast<uint64_t>(1), snapshot.queries[0].results);
+		}
+#endif
+
+		TEST_METHOD(MemoryStatsReportLiveBytes)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			for (int i = 0; i < 100; i++) {
+				auto e = world.CreateEntity();
+				world.AddComponent<Position>(e, 1.0f, 1.0f, 1.0f);
+			}
+
+			auto stats = world.GetMemoryStats();
+			Assert::AreEqual(static_cast<size_t>(1), stats.components.size());
+			Assert::AreEqual(static_cast<size_t>(100 * sizeof(Position)), stats.components[0].pool_used_bytes);
+			Assert::IsTrue(stats.components[0].pool_reserved_bytes >= MAX_ENTITIES * sizeof(Position));
+			Assert::AreEqual(static_cast<size_t>(100), stats.components[0].packed_size);
+			Assert::AreEqual(static_cast<size_t>(100), stats.num_entities);
+			Assert::IsTrue(stats.fragmentation > 0.9);
+		}
+
+		TEST_METHOD(ShrinkToFitKeepsComponents)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 1000; i++) {
+				entities.push_back(world.CreateEntity());
+				world.AddComponent<Position>(entities.back(), static_cast<float>(i), 0.0f, 0.0f);
+			}
+			for (int i = 10; i < 1000; i++) {
+				world.KillEntity(entities[i]);
+			}
+
+			auto before = world.GetMemoryStats();
+			world.ShrinkToFit();
+			auto after = world.GetMemoryStats();
+
+			Assert::AreEqual(static_cast<size_t>(10 * sizeof(Position)), after.components[0].pool_reserved_bytes);
+			Assert::AreEqual(static_cast<size_t>(10 * sizeof(uint16_t)), after.components[0].sparse_bytes);
+			Assert::IsTrue(after.reserved_bytes < before.reserved_bytes);
+			Assert::AreEqual(5.0f, world.GetComponent<Position>(entities[5])->x);
+			Assert::IsFalse(world.HasComponent(world.GetID<Position>(), entities[500]));
+
+			// storage grows again after being trimmed.
+			for (int i = 0; i < 100; i++) {
+				auto e = world.CreateEntity();
+				world.AddComponent<Position>(e, 7.0f, 0.0f, 0.0f);
+				Assert::AreEqual(7.0f, world.GetComponent<Position>(e)->x);
+			}
+			Assert::AreEqual(static_cast<size_t>(110), world.GetComponents<Position>().size());
+			Assert::AreEqual(9.0f, world.GetComponent<Position>(entities[9])->x);
+		}
+
+		TEST_METHOD(ChangedFilterSkipsUnchangedEntities)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<MeshRenderer>();
+
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 10; i++) {
+				entities.push_back(world.CreateEntity());
+				world.AddComponent<Position>(entities.back(), 0.0f, 0.0f, 0.0f);
+				world.AddComponent<MeshRenderer>(entities.back(), i);
+			}
+
+			// the first run sees everything, reading through const doesn't mark anything.
+			Assert::AreEqual(static_cast<size_t>(10), world.GetComponents<Changed<const Position>, const MeshRenderer>(0).size());
+			auto last_run = world.SystemTick();
+			Assert::AreEqual(static_cast<size_t>(0), world.GetEntitiesWith<Changed<Position>>(last_run).size());
+
+			world.Patch<Position>(entities[3], [](Position& p) { p.x = 1.0f; });
+			world.GetComponent<Position>(entities[7])->x = 2.0f;
+			world.GetComponent<const Position>(entities[8]);
+
+			auto changed = world.GetEntitiesWith<Changed<Position>, MeshRenderer>(last_run);
+			Assert::AreEqual(static_cast<size_t>(2), changed.size());
+			Assert::IsTrue(std::find(changed.begin(), changed.end(), entities[3]) != changed.end());
+			Assert::IsTrue(std::find(changed.begin(), changed.end(), entities[7]) != changed.end());
+		}
+
+		TEST_METHOD(AddedFilterFollowsSwapAndPop)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+
+			auto e1 = world.CreateEntity();
+			auto e2 = world.CreateEntity();
+			world.AddComponent<Position>(e1);
+			world.AddComponent<Position>(e2);
+			auto last_run = world.SystemTick();
+
+			auto e3 = world.CreateEntity();
+			world.AddComponent<Position>(e3);
+			// e3's slot is moved into e1's place.
+			world.RemoveComponent<Position>(e1);
+
+			auto added = world.GetEntitiesWith<Added<Position>>(last_run);
+			Assert::AreEqual(static_cast<size_t>(1), added.size());
+			Assert::AreEqual(e3, added[0]);
+			Assert::AreEqual(static_cast<size_t>(2), world.GetEntitiesWith<Position>(0).size());
+		}
+
+		TEST_METHOD(InstantiatePrefab)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<MeshRenderer>();
+			world.RegisterComponent<Tracked>();
+			Tracked::constructed = 0;
+
+			Prefab goblin;
+			goblin.With<Position>(1.0f, 2.0f, 3.0f).With<MeshRenderer>(4).With<Tracked>();
+			goblin.With<MeshRenderer>(5);
+
+			auto existing = world.CreateEntity();
+			world.AddComponent<Position>(existing, 9.0f, 9.0f, 9.0f);
+
+			auto wave = world.Instantiate(goblin, 100);
+			Assert::AreEqual(static_cast<size_t>(100), wave.size());
+			Assert::AreEqual(static_cast<size_t>(101), world.GetComponents<Position>().size());
+			Assert::AreEqual(static_cast<size_t>(100), world.GetEntitiesWith<Position, MeshRenderer, Tracked>().size());
+			Assert::AreEqual(100, Tracked::constructed);
+
+			for (auto entity : wave) {
+				Assert::AreEqual(2.0f, world.GetComponent<Position>(entity)->y);
+				Assert::AreEqual(5u, world.GetComponent<MeshRenderer>(entity)->id);
+			}
+			Assert::AreEqual(9.0f, world.GetComponent<Position>(existing)->x);
+
+			// instantiated components are removed like any other.
+			world.KillEntity(wave[0]);
+			Assert::AreEqual(static_cast<size_t>(100), world.GetComponents<Position>().size());
+		}
+
+		TEST_METHOD(InstantiateFillsStableHoles)
+		{
+			World world;
+			world.RegisterComponent<Anchor>();
+			std::vector<uint32_t> entities;
+			for (uint32_t i = 0; i < MAX_ENTITIES - 10; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Anchor>(entity, i);
+				entities.push_back(entity);
+			}
+			auto* first_anchor = world.GetComponent<Anchor>(entities[0]);
+			for (size_t i = 0; i < entities.size(); i += 2) {
+				world.KillEntity(entities[i]);
+			}
+
+			// the batch is bigger than the space left at the end of the pool, so it has to use the holes.
+			Prefab prefab;
+			prefab.With<Anchor>(7u);
+			auto snapshot = world.Snapshot();
+			auto wave = world.Instantiate(prefab, entities.size() / 2 + 5);
+			Assert::IsTrue(first_anchor == world.GetComponent<Anchor>(wave[0]));
+			for (auto entity : wave) {
+				Assert::AreEqual(7u, world.GetComponent<Anchor>(entity)->gravity);
+			}
+			for (size_t i = 1; i < entities.size(); i += 2) {
+				Assert::AreEqual(static_cast<uint32_t>(i), world.GetComponent<Anchor>(entities[i])->gravity);
+			}
+			Assert::AreEqual(entities.size() + 5, world.GetEntitiesWith<Anchor>().size());
+
+			world.Restore(snapshot);
+			Assert::AreEqual(entities.size() / 2, world.GetEntitiesWith<Anchor>().size());
+			Assert::AreEqual(static_cast<uint32_t>(1), world.GetComponent<Anchor>(entities[1])->gravity);
+		}
+
+		TEST_METHOD(PropagateTransformsThroughHierarchy)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+
+			auto root = world.CreateEntity();
+			auto child = world.CreateEntity();
+			auto grandchild = world.CreateEntity();
+			world.AddComponent<Position>(root, 10.0f, 0.0f, 0.0f);
+			world.AddComponent<Position>(child, 1.0f, 0.0f, 0.0f);
+			world.AddComponent<Position>(grandchild, 0.0f, 1.0f, 0.0f);
+
+			// parented bottom up, so the subtree has to be moved after its new parent.
+			world.SetParent(grandchild, child);
+			world.SetParent(child, root);
+			world.PropagateTransforms();
+
+			Assert::AreEqual(root, world.GetParent(child));
+			Assert::AreEqual(11.0f, world.GetComponent<GlobalPosition>(grandchild)->x);
+			Assert::AreEqual(1.0f, world.GetComponent<GlobalPosition>(grandchild)->y);
+
+			auto other = world.CreateEntity();
+			world.AddComponent<Position>(other, 100.0f, 0.0f, 0.0f);
+			world.SetParent(child, other);
+			world.PropagateTransforms();
+			Assert::AreEqual(101.0f, world.GetComponent<GlobalPosition>(grandchild)->x);
+
+			auto threw = false;
+			try {
+				world.SetParent(other, grandchild);
+			}
+			catch (std::runtime_error&) {
+				threw = true;
+			}
+			Assert::IsTrue(threw);
+
+			// killing a parent leaves its children as roots.
+			world.KillEntity(child);
+			world.PropagateTransforms();
+			Assert::AreEqual(NULL_ENTITY, world.GetParent(grandchild));
+			Assert::AreEqual(0.0f, world.GetComponent<GlobalPosition>(grandchild)->x);
+		}
+
+		TEST_METHOD(PropagateTransformsOnlyMarksMovedGlobals)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+
+			std::vector<uint32_t> children;
+			auto root = world.CreateEntity();
+			world.AddComponent<Position>(root, 10.0f, 0.0f, 0.0f);
+			for (int i = 0; i < 5; i++) {
+				children.push_back(world.CreateEntity());
+				world.AddComponent<Position>(children.back(), static_cast<float>(i), 0.0f, 0.0f);
+				world.SetParent(children.back(), root);
+			}
+			world.PropagateTransforms();
+			auto last_run = world.SystemTick();
+
+			// nothing moved, so no GlobalPosition is written.
+			world.PropagateTransforms();
+			Assert::AreEqual(static_cast<size_t>(0), world.GetEntitiesWith<Changed<GlobalPosition>>(last_run).size());
+
+			world.GetComponent<Position>(children[2])->y = 3.0f;
+			world.PropagateTransforms();
+			auto changed = world.GetEntitiesWith<Changed<GlobalPosition>>(last_run);
+			Assert::AreEqual(static_cast<size_t>(1), changed.size());
+			Assert::AreEqual(children[2], changed[0]);
+			Assert::AreEqual(3.0f, world.GetComponent<const GlobalPosition>(children[2])->y);
+		}
+
+		TEST_METHOD(ReparentingCompactsHierarchy)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+
+			std::vector<uint32_t> chain;
+			for (int i = 0; i < 200; i++) {
+				chain.push_back(world.CreateEntity());
+				world.AddComponent<Position>(chain.back(), 1.0f, 0.0f, 0.0f);
+			}
+			// every link is made before its parent is in the tree, so each one appends a subtree.
+			for (int i = 199; i > 0; i--) {
+				world.SetParent(chain[i], chain[i - 1]);
+			}
+			for (int round = 0; round < 5; round++) {
+				auto a = world.CreateEntity();
+				world.SetParent(chain[1], a);
+				world.SetParent(chain[1], chain[0]);
+			}
+			world.PropagateTransforms();
+			Assert::AreEqual(200.0f, world.GetComponent<GlobalPosition>(chain[199])->x);
+			Assert::AreEqual(chain[49], world.GetParent(chain[50]));
+		}
+
+		TEST_METHOD(HierarchyAddedDirectlyStartsAsRoot)
+		{
+			World world;
+			world.RegisterComponent<Hierarchy>();
+			world.RegisterComponent<Position>();
+
+			auto lone = world.CreateEntity();
+			world.AddComponent<Hierarchy>(lone);
+			world.KillEntity(lone);
+
+			// the prefab's links point at nothing in this World, so they are dropped.
+			Prefab prefab;
+			prefab.With<Hierarchy>(Hierarchy{ 5, 6, 7, 8, 42 }).With<Position>(1.0f, 0.0f, 0.0f);
+			auto wave = world.Instantiate(prefab, 10);
+			for (auto entity : wave) {
+				Assert::AreEqual(NULL_ENTITY, world.GetParent(entity));
+			}
+
+			world.SetParent(wave[1], wave[0]);
+			world.SetParent(wave[2], wave[1]);
+			world.PropagateTransforms();
+			Assert::AreEqual(3.0f, world.GetComponent<GlobalPosition>(wave[2])->x);
+
+			world.KillEntity(wave[1]);
+			world.KillEntity(wave[3]);
+			Assert::AreEqual(NULL_ENTITY, world.GetParent(wave[2]));
+
+			// a moved entity leaves its tree behind.
+			World other;
+			auto moved = world.MoveEntity(other, wave[2]);
+			Assert::AreEqual(NULL_ENTITY, other.GetParent(moved));
+			other.KillEntity(moved);
+			world.KillEntity(wave[0]);
+			world.PropagateTransforms();
+		}
+
+		TEST_METHOD(RestoreSnapshot)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<MeshRenderer>();
+
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 100; i++) {
+				entities.push_back(world.CreateEntity());
+				world.AddComponent<Position>(entities.back(), static_cast<float>(i), 0.0f, 0.0f);
+				if (i % 2 == 0) {
+					world.AddComponent<MeshRenderer>(entities.back(), i);
+				}
+			}
+			world.KillEntity(entities[99]);
+
+			auto snapshot = world.Snapshot();
+
+			world.GetComponent<Position>(entities[5])->x = -1.0f;
+			world.RemoveComponent<Position>(entities[0]);
+			world.KillEntity(entities[10]);
+			for (int i = 0; i < 50; i++) {
+				auto e = world.CreateEntity();
+				world.AddComponent<MeshRenderer>(e, 1000);
+			}
+			world.SetParent(entities[20], entities[21]);
+
+			world.Restore(snapshot);
+
+			Assert::AreEqual(static_cast<size_t>(100), world.GetNumEntities());
+			Assert::AreEqual(static_cast<size_t>(1), world.GetNumFreeEntities());
+			Assert::AreEqual(static_cast<size_t>(99), world.GetComponents<Position>().size());
+			Assert::AreEqual(static_cast<size_t>(50), world.GetComponents<MeshRenderer>().size());
+			Assert::AreEqual(5.0f, world.GetComponent<Position>(entities[5])->x);
+			Assert::AreEqual(0.0f, world.GetComponent<Position>(entities[0])->x);
+			Assert::AreEqual(10u, world.GetComponent<MeshRenderer>(entities[10])->id);
+			Assert::AreEqual(NULL_ENTITY, world.GetParent(entities[20]));
+
+			// the snapshot can be restored again, and the world still works afterwards.
+			world.RemoveComponent<Position>(entities[1]);
+			world.Restore(snapshot);
+			Assert::AreEqual(1.0f, world.GetComponent<Position>(entities[1])->x);
+			auto e = world.CreateEntity();
+			world.AddComponent<Position>(e, 7.0f, 0.0f, 0.0f);
+			Assert::AreEqual(static_cast<size_t>(100), world.GetComponents<Position>().size());
+		}
+
+		TEST_METHOD(RestoreOlderSnapshotFromRing)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			auto entity = world.CreateEntity();
+			world.AddComponent<Position>(entity, 0.0f, 0.0f, 0.0f);
+
+			std::vector<uint32_t> snapshots;
+			for (int tick = 0; tick < DEFAULT_SNAPSHOT_RING + 2; tick++) {
+				snapshots.push_back(world.Snapshot());
+				world.GetComponent<Position>(entity)->x = static_cast<float>(tick + 1);
+			}
+
+			world.Restore(snapshots[4]);
+			Assert::AreEqual(4.0f, world.GetComponent<Position>(entity)->x);
+
+			// the two oldest were dropped from the ring, and everything after the restored one is gone.
+			auto threw = 0;
+			for (auto snapshot : { snapshots[0], snapshots[5] }) {
+				try {
+					world.Restore(snapshot);
+				}
+				catch (std::runtime_error&) {
+					threw++;
+				}
+			}
+			Assert::AreEqual(2, threw);
+		}
+
+		TEST_METHOD(ReplicateOverLoopback)
+		{
+			World server_world;
+			World client_world;
+			ReplicationServer server(server_world);
+			ReplicationClient client(client_world);
+			server.Replicate<Position>();
+			server.Replicate<MeshRenderer>();
+			client.Replicate<Position>();
+			client.Replicate<MeshRenderer>();
+			auto player = server.AddClient();
+
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 10; i++) {
+				auto entity = server_world.CreateEntity();
+				server_world.AddComponent<Position>(entity, i * 1.5f, -2.0f, 100.25f);
+				server_world.AddComponent<MeshRenderer>(entity, static_cast<unsigned int>(i));
+				server.SetInterest(player, entity);
+				entities.push_back(entity);
+			}
+
+			std::vector<uint8_t> packet;
+			client.Decode(packet.data(), server.Encode(player, packet));
+			auto* position = client_world.GetComponent<Position>(client.GetLocalEntity(entities[3]));
+			Assert::AreEqual(4.5f, position->x);
+			Assert::AreEqual(-2.0f, position->y);
+			Assert::AreEqual(100.25f, position->z);
+			Assert::AreEqual(3u, client_world.GetComponent<MeshRenderer>(client.GetLocalEntity(entities[3]))->id);
+
+			// nothing changed, so only the end of each channel is sent.
+			Assert::AreEqual(static_cast<size_t>(1), server.Encode(player, packet));
+			client.Decode(packet.data(), packet.size());
+
+			server_world.GetComponent<Position>(entities[5])->y = 7.0f;
+			server.SetInterest(player, entities[0], false);
+			server_world.RemoveComponent<MeshRenderer>(entities[1]);
+			client.Decode(packet.data(), server.Encode(player, packet));
+
+			Assert::AreEqual(7.0f, client_world.GetComponent<Position>(client.GetLocalEntity(entities[5]))->y);
+			Assert::AreEqual(NULL_ENTITY, client.GetLocalEntity(entities[0]));
+			Assert::IsNull(client_world.GetComponent<MeshRenderer>(client.GetLocalEntity(entities[1])));
+			Assert::IsNotNull(client_world.GetComponent<Position>(client.GetLocalEntity(entities[1])));
+			Assert::AreEqual(static_cast<size_t>(9), client_world.GetEntitiesWith<Position>().size());
+		}
+
+		TEST_METHOD(ReplicationIgnoresWhatIsNotSent)
+		{
+			World server_world;
+			World client_world;
+			ReplicationServer server(server_world);
+			ReplicationClient client(client_world);
+			server.Replicate<Settings>();
+			client.Replicate<Settings>();
+			auto player = server.AddClient();
+
+			auto entity = server_world.CreateEntity();
+			server_world.AddComponent<Settings>(entity, 10U);
+			server.SetInterest(player, entity);
+
+			std::vector<uint8_t> packet;
+			auto size = server.Encode(player, packet);
+			client.Decode(packet.data(), size);
+			Assert::AreEqual(static_cast<size_t>(1), server.Encode(player, packet));
+
+			server_world.GetComponent<Settings>(entity)->gravity = 20;
+			size = server.Encode(player, packet);
+			client.Decode(packet.data(), size);
+			Assert::AreEqual(20U, client_world.GetComponent<Settings>(client.GetLocalEntity(entity))->gravity);
+		}
+
+		TEST_METHOD(SaveAsyncWritesCapturedWorld)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<AI>();
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 100; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity, static_cast<float>(i), 2.0f, 0.0f);
+				if (i % 3 == 0) {
+					world.AddComponent<AI>(entity);
+				}
+				entities.push_back(entity);
+			}
+
+			auto saved = world.SaveAsync<Position, AI>("save_async_test.bin");
+			// changes after SaveAsync returns are not in the save.
+			for (auto entity : entities) {
+				world.GetComponent<Position>(entity)->x = -1.0f;
+			}
+			world.KillEntity(entities[10]);
+			saved.get();
+
+			std::ifstream file("save_async_test.bin", std::ios::binary);
+			std::vector<char> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			file.close();
+			std::remove("save_async_test.bin");
+
+			World loaded;
+			loaded.RegisterComponent<Position>();
+			loaded.RegisterComponent<AI>();
+			size_t offset{ 0 };
+			loaded.Deserialise(buffer.data(), offset);
+			loaded.Deserialise<Position>(buffer.data(), offset);
+			loaded.Deserialise<AI>(buffer.data(), offset);
+
+			Assert::AreEqual(static_cast<size_t>(100), loaded.GetEntitiesWith<Position>().size());
+			Assert::AreEqual(static_cast<size_t>(34), loaded.GetEntitiesWith<AI>().size());
+			Assert::AreEqual(10.0f, loaded.GetComponent<Position>(entities[10])->x);
+			Assert::AreEqual(2.0f, loaded.GetComponent<Position>(entities[99])->y);
+			Assert::AreEqual(static_cast<size_t>(0), loaded.GetNumFreeEntities());
+		}
+
+		TEST_METHOD(CompressionRoundTrip)
+		{
+			std::vector<char> source(100000);
+			for (size_t i = 0; i < source.size(); i++) {
+				// mostly zeros, with runs of a counter and a few bytes of noise.
+				source[i] = i % 32 < 4 ? static_cast<char>(i / 32) : (i % 997 == 0 ? static_cast<char>(i * 31) : 0);
+			}
+
+			std::vector<char> compressed;
+			LZCompress(source.data(), source.size(), compressed);
+			Assert::IsTrue(compressed.size() < source.size() / 4);
+
+			std::vector<char> decompressed(source.size());
+			LZDecompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size());
+			Assert::IsTrue(source == decompressed);
+
+			// a truncated stream is reported, not read past.
+			Assert::ExpectException<std::runtime_error>([&]() {
+				LZDecompress(compressed.data(), compressed.size() / 2, decompressed.data(), decompressed.size());
+			});
+		}
+
+		TEST_METHOD(ChunkedSaveRoundTrip)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<MeshRenderer>();
+			world.RegisterComponent<AI>();
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 1000; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity, static_cast<float>(i), static_cast<float>(2 * i), 0.0f);
+				if (i % 4 == 0) {
+					world.AddComponent<AI>(entity);
+				}
+				entities.push_back(entity);
+			}
+			world.KillEntity(entities[7]);
+
+			// small blocks, so each component is spread over several, on several threads.
+			ChunkedSaveOptions options;
+			options.elements_per_block = 64;
+			options.threads = 4;
+			std::stringstream save(std::ios::in | std::ios::out | std::ios::binary);
+			world.SaveChunked<Position, MeshRenderer, AI>(save, options);
+
+			World loaded;
+			loaded.RegisterComponent<Position>();
+			loaded.RegisterComponent<MeshRenderer>();
+			loaded.RegisterComponent<AI>();
+			loaded.LoadChunked<Position, MeshRenderer, AI>(save, 4);
+
+			Assert::AreEqual(static_cast<size_t>(999), loaded.GetEntitiesWith<Position>().size());
+			Assert::AreEqual(static_cast<size_t>(0), loaded.GetEntitiesWith<MeshRenderer>().size());
+			Assert::AreEqual(static_cast<size_t>(250), loaded.GetEntitiesWith<AI>().size());
+			Assert::AreEqual(static_cast<size_t>(1), loaded.GetNumFreeEntities());
+			Assert::IsNull(loaded.GetComponent<Position>(entities[7]));
+			Assert::AreEqual(500.0f, loaded.GetComponent<Position>(entities[500])->x);
+			Assert::AreEqual(1998.0f, loaded.GetComponent<Position>(entities[999])->y);
+			Assert::IsNotNull(loaded.GetComponent<AI>(entities[996]));
+
+			std::stringstream wrong(save.str());
+			Assert::ExpectException<std::runtime_error>([&]() { loaded.LoadChunked<Position, AI>(wrong); });
+		}
+
+		TEST_METHOD(ChunkedLoadRejectsCorruptBlocks)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			for (int i = 0; i < 200; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity, static_cast<float>(i), 0.0f, 0.0f);
+			}
+			ChunkedSaveOptions options;
+			options.elements_per_block = 64;
+			options.compress = false;
+			std::stringstream save(std::ios::in | std::ios::out | std::ios::binary);
+			world.SaveChunked<Position>(save, options);
+
+			// split the save back into its blocks, to write it out again with one of them damaged.
+			char header[12];
+			save.read(header, sizeof(header));
+			std::vector<std::pair<BlockHeader, std::vector<char>>> blocks;
+			BlockHeader block_header;
+			do {
+				ReadBlockHeader(save, block_header);
+				std::vector<char> stored(block_header.stored_size);
+				save.read(stored.data(), stored.size());
+				blocks.emplace_back(block_header, stored);
+			} while (block_header.kind != BlockKind::END);
+
+			auto load = [&](const size_t skip, const size_t stretch, const size_t shrink = SIZE_MAX) {
+				std::stringstream damaged(std::ios::in | std::ios::out | std::ios::binary);
+				damaged.write(header, sizeof(header));
+				for (size_t i = 0; i < blocks.size(); i++) {
+					if (i == skip) {
+						continue;
+					}
+					auto stored = blocks[i].second;
+					if (i == stretch) {
+						// the first component's length, which follows the entity ids.
+						stored[2 * blocks[i].first.count + 2] = 0x7F;
+					}
+					if (i == shrink) {
+						// the last component's length, which is then too short for what it reads.
+						std::fill_n(stored.begin() + 6 * blocks[i].first.count - 4, 4, '\0');
+					}
+					WriteBlockHeader(damaged, blocks[i].first);
+					damaged.write(stored.data(), stored.size());
+				}
+				World loaded;
+				loaded.RegisterComponent<Position>();
+				loaded.LoadChunked<Position>(damaged, 2);
+			};
+			load(SIZE_MAX, SIZE_MAX);
+			Assert::ExpectException<std::runtime_error>([&]() { load(2, SIZE_MAX); });
+			Assert::ExpectException<std::runtime_error>([&]() { load(0, SIZE_MAX); });
+			Assert::ExpectException<std::runtime_error>([&]() { load(SIZE_MAX, 3); });
+			Assert::ExpectException<std::runtime_error>([&]() { load(SIZE_MAX, SIZE_MAX, blocks.size() - 2); });
+		}
+
+		TEST_METHOD(SetAndSerialiseResources)
+		{
+			World world;
+			Assert::IsNull(world.GetResource<Settings>());
+
+			world.SetResource<Settings>(10u);
+			world.GetResource<Settings>()->gravity++;
+			Assert::AreEqual(11u, world.GetResource<const Settings>()->gravity);
+			Assert::AreEqual(3u, world.SetResource<Settings>(3u).gravity);
+
+			std::ostringstream file(std::ios::binary);
+			world.SerialiseResource<Settings>(file);
+			world.RemoveResource<Settings>();
+			Assert::IsFalse(world.HasResource<Settings>());
+
+			auto buffer = file.str();
+			size_t offset{ 0 };
+			world.DeserialiseResource<Settings>(buffer.data(), offset);
+			Assert::AreEqual(3u, world.GetResource<Settings>()->gravity);
+			Assert::AreEqual(buffer.size(), offset);
+		}
+
+		TEST_METHOD(SystemAccessConflicts)
+		{
+			auto physics = SystemAccess().Read<RigidBody>().Write<Position>().ReadResource<Settings>();
+			auto render = SystemAccess().Read<const Position, MeshRenderer>();
+			auto ai = SystemAccess().Write<AI>().ReadResource<Settings>();
+			auto tuning = SystemAccess().WriteResource<Settings>();
+
+			Assert::IsTrue(physics.ConflictsWith(render));
+			Assert::IsTrue(render.ConflictsWith(physics));
+			Assert::IsFalse(render.ConflictsWith(ai));
+			Assert::IsFalse(physics.ConflictsWith(ai));
+			Assert::IsTrue(tuning.ConflictsWith(ai));
+		}
+
+		TEST_METHOD(BudgetedSystemResumesAfterRemovals)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<AI>();
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 10; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity);
+				world.AddComponent<AI>(entity);
+				entities.push_back(entity);
+			}
+
+			// a spent budget, so the system stops after every entity.
+			FrameBudget budget;
+			budget.Start(0);
+			std::vector<uint32_t> visited;
+			int passes{ 0 };
+			auto system = CountAI(world, budget, visited, passes);
+			for (int frame = 0; frame < 3; frame++) {
+				system.Resume();
+			}
+			Assert::AreEqual(static_cast<size_t>(3), visited.size());
+
+			// swap-and-pop moves the last entities into the removed slots, the cursor must not skip them.
+			world.KillEntity(entities[0]);
+			world.RemoveComponent<AI>(entities[5]);
+			world.KillEntity(entities[8]);
+			auto late = world.CreateEntity();
+			world.AddComponent<Position>(late);
+			world.AddComponent<AI>(late);
+
+			while (passes == 0) {
+				system.Resume();
+			}
+			Assert::AreEqual(static_cast<size_t>(8), visited.size());
+			std::sort(visited.begin(), visited.end());
+			Assert::IsTrue(std::unique(visited.begin(), visited.end()) == visited.end());
+			Assert::IsFalse(std::find(visited.begin(), visited.end(), entities[5]) != visited.end());
+
+			// the next pass picks up the new entity, with a budget which doesn't run out.
+			budget.Start(1000000);
+			visited.clear();
+			system.Resume();
+			Assert::AreEqual(2, passes);
+			Assert::AreEqual(static_cast<size_t>(8), visited.size());
+		}
+
+		TEST_METHOD(ResumableViewPassesDoNotAllocate)
+		{
+			CountingResource counting;
+			World world(&counting);
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<AI>();
+			for (int i = 0; i < 100; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity);
+				world.AddComponent<AI>(entity);
+			}
+
+			int visited{ 0 };
+			int passes{ 0 };
+			auto system = CountPasses(world, visited, passes);
+			system.Resume();
+			world.EndFrame();
+
+			auto global_allocations = g_allocations.load();
+			auto resource_allocations = counting.allocations;
+			for (int frame = 0; frame < 10; frame++) {
+				system.Resume();
+				world.EndFrame();
+			}
+
+			Assert::AreEqual(11, passes);
+			Assert::AreEqual(1100, visited);
+#ifndef ECS_INSTRUMENTATION
+			Assert::AreEqual(global_allocations, g_allocations.load());
+#endif
+			Assert::AreEqual(resource_allocations, counting.allocations);
+		}
+
+		TEST_METHOD(SharedComponentsDeduplicate)
+		{
+			World world;
+			world.RegisterComponent<SharedRef<MeshRenderer>>();
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 30; i++) {
+				auto entity = world.CreateEntity();
+				world.AddShared<MeshRenderer>(entity, static_cast<unsigned int>(i % 3));
+				entities.push_back(entity);
+			}
+			Assert::AreEqual(static_cast<size_t>(3), world.GetNumSharedValues<MeshRenderer>());
+			Assert::IsTrue(world.GetShared<MeshRenderer>(entities[0]) == world.GetShared<MeshRenderer>(entities[3]));
+
+			// patching copies the value, the other entities sharing mesh 0 keep it.
+			world.PatchShared<MeshRenderer>(entities[0], [](MeshRenderer& renderer) { renderer.id = 7; });
+			Assert::AreEqual(static_cast<size_t>(4), world.GetNumSharedValues<MeshRenderer>());
+			Assert::AreEqual(7u, world.GetShared<MeshRenderer>(entities[0])->id);
+			Assert::AreEqual(0u, world.GetShared<MeshRenderer>(entities[3])->id);
+			world.PatchShared<MeshRenderer>(entities[0], [](MeshRenderer& renderer) { renderer.id = 0; });
+			Assert::AreEqual(static_cast<size_t>(3), world.GetNumSharedValues<MeshRenderer>());
+
+			// the last entity sharing mesh 2 frees it.
+			for (int i = 2; i < 30; i += 3) {
+				world.KillEntity(entities[i]);
+			}
+			Assert::AreEqual(static_cast<size_t>(2), world.GetNumSharedValues<MeshRenderer>());
+
+			World other;
+			other.RegisterComponent<SharedRef<MeshRenderer>>();
+			auto moved = world.MoveEntity(other, entities[1]);
+			Assert::AreEqual(1u, other.GetShared<MeshRenderer>(moved)->id);
+			Assert::AreEqual(static_cast<size_t>(1), other.GetNumSharedValues<MeshRenderer>());
+
+			std::vector<size_t> batches;
+			world.ForEachShared<MeshRenderer>([&](const MeshRenderer& renderer, const std::vector<uint32_t>& sharing) {
+				for (auto entity : sharing) {
+					Assert::AreEqual(renderer.id, world.GetShared<MeshRenderer>(entity)->id);
+				}
+				batches.push_back(sharing.size());
+			});
+			std::sort(batches.begin(), batches.end());
+			Assert::AreEqual(static_cast<size_t>(2), batches.size());
+			Assert::AreEqual(static_cast<size_t>(9), batches[0]);
+			Assert::AreEqual(static_cast<size_t>(10), batches[1]);
+		}
+
+		TEST_METHOD(RestoreKeepsSharedValues)
+		{
+			World world;
+			world.RegisterComponent<SharedRef<MeshRenderer>>();
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 6; i++) {
+				auto entity = world.CreateEntity();
+				world.AddShared<MeshRenderer>(entity, static_cast<unsigned int>(i % 2));
+				entities.push_back(entity);
+			}
+
+			auto snapshot = world.Snapshot();
+
+			// every entity sharing mesh 1 lets go of it, and a new value takes its place in the store.
+			world.KillEntity(entities[1]);
+			world.RemoveComponent<SharedRef<MeshRenderer>>(entities[3]);
+			world.PatchShared<MeshRenderer>(entities[5], [](MeshRenderer& renderer) { renderer.id = 9; });
+			auto spawned = world.CreateEntity();
+			world.AddShared<MeshRenderer>(spawned, 8u);
+			Assert::AreEqual(static_cast<size_t>(3), world.GetNumSharedValues<MeshRenderer>());
+
+			world.Restore(snapshot);
+			Assert::AreEqual(static_cast<size_t>(2), world.GetNumSharedValues<MeshRenderer>());
+			for (int i = 0; i < 6; i++) {
+				Assert::AreEqual(static_cast<unsigned int>(i % 2), world.GetShared<MeshRenderer>(entities[i])->id);
+			}
+			size_t sharing_total{ 0 };
+			world.ForEachShared<MeshRenderer>([&](const MeshRenderer& renderer, const std::vector<uint32_t>& sharing) {
+				for (auto entity : sharing) {
+					Assert::AreEqual(renderer.id, world.GetShared<MeshRenderer>(entity)->id);
+				}
+				sharing_total += sharing.size();
+			});
+			Assert::AreEqual(static_cast<size_t>(6), sharing_total);
+
+			// the restored refs keep working as entities come and go.
+			world.KillEntity(entities[0]);
+			world.PatchShared<MeshRenderer>(entities[3], [](MeshRenderer& renderer) { renderer.id = 0; });
+			Assert::AreEqual(0u, world.GetShared<MeshRenderer>(entities[3])->id);
+			Assert::AreEqual(1u, world.GetShared<MeshRenderer>(entities[1])->id);
+		}
+
+		TEST_METHOD(SharedComponentsSaveTheirValuesOnce)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<SharedRef<MeshRenderer>>();
+			Prefab rock;
+			rock.WithShared<MeshRenderer>(4u).With<Position>(1.0f, 0.0f, 0.0f);
+			auto rocks = world.Instantiate(rock, 50);
+			std::vector<uint32_t> entities(rocks.begin(), rocks.end());
+			for (int i = 0; i < 10; i++) {
+				auto entity = world.CreateEntity();
+				world.AddShared<MeshRenderer>(entity, 5u);
+				entities.push_back(entity);
+			}
+			Assert::AreEqual(4u, world.GetShared<MeshRenderer>(entities[0])->id);
+			Assert::AreEqual(static_cast<size_t>(2), world.GetNumSharedValues<MeshRenderer>());
+			world.KillEntity(entities[3]);
+
+			std::ostringstream file(std::ios::binary);
+			world.Serialise(file);
+			world.Serialise<SharedRef<MeshRenderer>>(file);
+			auto buffer = file.str();
+
+			World loaded;
+			loaded.RegisterComponent<SharedRef<MeshRenderer>>();
+			size_t offset{ 0 };
+			loaded.Deserialise(buffer.data(), offset);
+			loaded.Deserialise<SharedRef<MeshRenderer>>(buffer.data(), offset);
+			Assert::AreEqual(buffer.size(), offset);
+			Assert::AreEqual(static_cast<size_t>(2), loaded.GetNumSharedValues<MeshRenderer>());
+			Assert::IsNull(loaded.GetShared<MeshRenderer>(entities[3]));
+			Assert::AreEqual(4u, loaded.GetShared<MeshRenderer>(entities[49])->id);
+			Assert::AreEqual(5u, loaded.GetShared<MeshRenderer>(entities[50])->id);
+			loaded.KillEntity(entities[50]);
+			loaded.PatchShared<MeshRenderer>(entities[51], [](MeshRenderer& renderer) { renderer.id = 4; });
+			Assert::AreEqual(4u, loaded.GetShared<MeshRenderer>(entities[51])->id);
+
+			ChunkedSaveOptions options;
+			options.elements_per_block = 16;
+			std::stringstream save(std::ios::in | std::ios::out | std::ios::binary);
+			world.SaveChunked<Position, SharedRef<MeshRenderer>>(save, options);
+			World chunked;
+			chunked.RegisterComponent<Position>();
+			chunked.RegisterComponent<SharedRef<MeshRenderer>>();
+			chunked.LoadChunked<Position, SharedRef<MeshRenderer>>(save, 4);
+			Assert::AreEqual(static_cast<size_t>(2), chunked.GetNumSharedValues<MeshRenderer>());
+			Assert::AreEqual(5u, chunked.GetShared<MeshRenderer>(entities[59])->id);
+			size_t sharing_total{ 0 };
+			chunked.ForEachShared<MeshRenderer>([&](const MeshRenderer&, const std::vector<uint32_t>& sharing) {
+				sharing_total += sharing.size();
+			});
+			Assert::AreEqual(static_cast<size_t>(59), sharing_total);
+		}
+
+		TEST_METHOD(FrameExtractPublishesImmutableViews)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<MeshRenderer>();
+			FrameExtract<Position, MeshRenderer> extract;
+			Assert::IsTrue(extract.Acquire() == nullptr);
+
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 100; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity, 0.0f, 0.0f, 0.0f);
+				world.AddComponent<MeshRenderer>(entity, static_cast<unsigned int>(i));
+				entities.push_back(entity);
+			}
+			extract.Publish(world);
+
+			// the view doesn't change with the World until the next Acquire.
+			auto* view = extract.Acquire();
+			world.KillEntity(entities[0]);
+			world.GetComponent<Position>(entities[1])->x = 5.0f;
+			extract.Publish(world);
+			Assert::AreEqual(static_cast<size_t>(100), view->size());
+			for (size_t i = 0; i < view->size(); i++) {
+				Assert::AreEqual(0.0f, view->get<Position>(i).x);
+				Assert::AreEqual(entities[view->get<MeshRenderer>(i).id], view->entity(i));
+			}
+
+			view = extract.Acquire();
+			Assert::AreEqual(static_cast<uint64_t>(2), view->frame());
+			Assert::AreEqual(static_cast<size_t>(99), view->column<Position>().size());
+
+			// a render thread reading while the World changes sees every frame whole.
+			std::atomic<bool> done{ false };
+			std::atomic<int> torn{ 0 };
+			std::thread render([&]() {
+				while (!done) {
+					if (auto* frame = extract.Acquire()) {
+						for (auto& position : frame->column<Position>()) {
+							if (frame->frame() > 2 && position.y != static_cast<float>(frame->frame())) {
+								torn++;
+							}
+						}
+					}
+				}
+			});
+			for (uint64_t frame = 3; frame < 500; frame++) {
+				if (frame % 7 == 0) {
+					auto entity = world.CreateEntity();
+					world.AddComponent<Position>(entity);
+					world.AddComponent<MeshRenderer>(entity);
+				}
+				for (auto* position : world.GetComponents<Position>()) {
+					position->y = static_cast<float>(frame);
+				}
+				extract.Publish(world);
+			}
+			done = true;
+			render.join();
+			Assert::AreEqual(0, torn.load());
+		}
+
+		TEST_METHOD(HashedStorageIndexesRareComponents)
+		{
+			World world;
+			world.RegisterComponent<Rare>();
+			std::vector<uint32_t> entities;
+			for (uint32_t i = 0; i < 3000; i++) {
+				auto entity = world.CreateEntity();
+				if (i % 5 == 0) {
+					world.AddComponent<Rare>(entity, i);
+				}
+				entities.push_back(entity);
+			}
+
+			// removals shift later entries of a probe run back, the rest must still be found.
+			for (uint32_t i = 0; i < 3000; i += 10) {
+				world.RemoveComponent<Rare>(entities[i]);
+			}
+			for (uint32_t i = 0; i < 3000; i++) {
+				auto* rare = world.GetComponent<Rare>(entities[i]);
+				Assert::AreEqual(i % 10 == 5, rare != nullptr);
+				if (rare != nullptr) {
+					Assert::AreEqual(i, rare->gravity);
+				}
+			}
+			Assert::AreEqual(static_cast<size_t>(300), world.GetEntitiesWith<Rare>().size());
+
+			for (auto& component : world.GetMemoryStats().components) {
+				if (component.component_id == world.GetID<Rare>()) {
+					Assert::IsTrue(component.sparse_bytes < MAX_ENTITIES * sizeof(uint16_t) / 2);
+					Assert::IsTrue(component.pool_reserved_bytes < MAX_ENTITIES * sizeof(Rare) / 4);
+				}
+			}
+
+			auto snapshot = world.Snapshot();
+			for (uint32_t i = 0; i < 3000; i += 3) {
+				if (world.HasComponent(world.GetID<Rare>(), entities[i])) {
+					world.RemoveComponent<Rare>(entities[i]);
+				}
+				else {
+					world.AddComponent<Rare>(entities[i], 7u);
+				}
+			}
+			world.Restore(snapshot);
+			Assert::AreEqual(static_cast<size_t>(300), world.GetEntitiesWith<Rare>().size());
+			Assert::AreEqual(15u, world.GetComponent<Rare>(entities[15])->gravity);
+			Assert::IsNull(world.GetComponent<Rare>(entities[3]));
+
+			std::stringstream save(std::ios::in | std::ios::out | std::ios::binary);
+			world.SaveChunked<Rare>(save);
+			World loaded;
+			loaded.RegisterComponent<Rare>();
+			loaded.LoadChunked<Rare>(save);
+			Assert::AreEqual(static_cast<size_t>(300), loaded.GetEntitiesWith<Rare>().size());
+			Assert::AreEqual(2995u, loaded.GetComponent<Rare>(entities[2995])->gravity);
+		}
+
+		TEST_METHOD(StableStorageKeepsPointers)
+		{
+			World world;
+			world.RegisterComponent<Anchor>();
+			world.RegisterComponent<AI>();
+			std::vector<uint32_t> entities;
+			std::vector<Anchor*> anchors;
+			for (uint32_t i = 0; i < 100; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Anchor>(entity, i);
+				world.AddComponent<AI>(entity);
+				entities.push_back(entity);
+				anchors.push_back(world.GetComponent<Anchor>(entity));
+			}
+
+			for (uint32_t i = 0; i < 100; i += 2) {
+				world.KillEntity(entities[i]);
+			}
+			for (uint32_t i = 1; i < 100; i += 2) {
+				Assert::IsTrue(anchors[i] == world.GetComponent<Anchor>(entities[i]));
+				Assert::AreEqual(i, anchors[i]->gravity);
+			}
+			Assert::AreEqual(static_cast<size_t>(50), world.GetEntitiesWith<Anchor>().size());
+			Assert::AreEqual(static_cast<size_t>(50), world.GetEntitiesWith<Anchor, AI>().size());
+			Assert::AreEqual(static_cast<size_t>(50), world.GetComponents<Anchor>(0).size());
+
+			// new components fill the empty slots, lowest first.
+			auto snapshot = world.Snapshot();
+			auto entity = world.CreateEntity();
+			world.AddComponent<Anchor>(entity, 1000u);
+			Assert::IsTrue(anchors[0] == world.GetComponent<Anchor>(entity));
+			world.Restore(snapshot);
+			entity = world.CreateEntity();
+			world.AddComponent<Anchor>(entity, 1000u);
+			Assert::IsTrue(anchors[0] == world.GetComponent<Anchor>(entity));
+			Assert::AreEqual(static_cast<size_t>(51), world.GetEntitiesWith<Anchor>().size());
+
+			std::stringstream save(std::ios::in | std::ios::out | std::ios::binary);
+			world.SaveChunked<Anchor>(save);
+			World loaded;
+			loaded.RegisterComponent<Anchor>();
+			loaded.LoadChunked<Anchor>(save);
+			Assert::AreEqual(static_cast<size_t>(51), loaded.GetEntitiesWith<Anchor>().size());
+			Assert::AreEqual(99u, loaded.GetComponent<Anchor>(entities[99])->gravity);
+			auto later = loaded.CreateEntity();
+			loaded.AddComponent<Anchor>(later);
+			Assert::AreEqual(static_cast<size_t>(100), loaded.GetEntitySpan<Anchor>().size);
+		}
+
+		TEST_METHOD(KillAfterExpiresInBatches)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 100; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity);
+				world.KillAfter(entity, i % 10 + 1);
+				entities.push_back(entity);
+			}
+
+			// ten die at the end of each frame.
+			for (size_t frame = 1; frame <= 10; frame++) {
+				world.EndFrame();
+				Assert::AreEqual(frame * 10, world.GetNumFreeEntities());
+				Assert::AreEqual(100 - frame * 10, world.GetComponents<Position>().size());
+			}
+
+			// rescheduling replaces the time, and cancelling or killing sooner stops it.
+			auto a = world.CreateEntity();
+			auto b = world.CreateEntity();
+			auto c = world.CreateEntity();
+			world.KillAfter(a, 2);
+			world.KillAfter(a, 5);
+			world.KillAfter(b, 3);
+			world.CancelKill(b);
+			world.KillAfter(c, 4);
+			world.KillEntity(c);
+			Assert::AreEqual(static_cast<uint32_t>(5), world.GetTicksToKill(a));
+			Assert::AreEqual(static_cast<uint32_t>(0), world.GetTicksToKill(b));
+
+			// c's id is recycled before its old time is up - the new entity isn't killed.
+			auto d = world.CreateEntity();
+			Assert::AreEqual(c >> 16, d >> 16);
+			auto free = world.GetNumFreeEntities();
+			for (int frame = 0; frame < 4; frame++) {
+				world.EndFrame();
+			}
+			Assert::AreEqual(free, world.GetNumFreeEntities());
+			world.EndFrame();
+			Assert::AreEqual(free + 1, world.GetNumFreeEntities());
+			Assert::AreEqual(static_cast<uint32_t>(0), world.GetTicksToKill(d));
+
+			// long times are carried down the levels of the wheel and still expire on the right frame.
+			world.KillAfter(b, 5000);
+			world.KillAfter(d, 300000);
+			for (uint32_t frame = 1; frame < 5000; frame++) {
+				world.EndFrame();
+			}
+			Assert::AreEqual(static_cast<uint32_t>(1), world.GetTicksToKill(b));
+			world.EndFrame();
+			Assert::AreEqual(static_cast<uint32_t>(0), world.GetTicksToKill(b));
+			Assert::AreEqual(free + 2, world.GetNumFreeEntities());
+			Assert::AreEqual(static_cast<uint32_t>(295000), world.GetTicksToKill(d));
+		}
+
+		TEST_METHOD(KillAfterSurvivesRestoreAndLoad)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			std::vector<uint32_t> entities;
+			for (int i = 0; i < 50; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity);
+				world.KillAfter(entity, i % 5 + 1 + (i >= 40 ? 100 : 0));
+				entities.push_back(entity);
+			}
+			world.EndFrame();
+			auto snapshot = world.Snapshot();
+
+			// the frames after the snapshot, run once and then again from the restored World.
+			auto run = [&]() {
+				std::vector<size_t> alive;
+				for (int frame = 0; frame < 6; frame++) {
+					world.EndFrame();
+					alive.push_back(world.GetComponents<Position>().size());
+				}
+				return alive;
+			};
+			auto first = run();
+			world.CancelKill(entities[45]);
+			world.KillAfter(world.CreateEntity(), 1);
+
+			world.Restore(snapshot);
+			Assert::AreEqual(static_cast<uint32_t>(4), world.GetTicksToKill(entities[4]));
+			Assert::AreEqual(static_cast<uint32_t>(100), world.GetTicksToKill(entities[45]));
+			Assert::IsTrue(first == run());
+			Assert::AreEqual(static_cast<size_t>(10), world.GetComponents<Position>().size());
+
+			// saves carry the ticks left, after the components.
+			std::ostringstream file(std::ios::binary);
+			world.Serialise(file);
+			world.Serialise<Position>(file);
+			world.SerialiseTimers(file);
+			auto buffer = file.str();
+			World loaded;
+			loaded.RegisterComponent<Position>();
+			size_t offset{ 0 };
+			loaded.Deserialise(buffer.data(), offset);
+			loaded.Deserialise<Position>(buffer.data(), offset);
+			loaded.DeserialiseTimers(buffer.data(), offset);
+			Assert::AreEqual(buffer.size(), offset);
+			Assert::AreEqual(world.GetTicksToKill(entities[45]), loaded.GetTicksToKill(entities[45]));
+			auto last = loaded.GetTicksToKill(entities[49]);
+			for (uint32_t frame = 0; frame < last; frame++) {
+				loaded.EndFrame();
+			}
+			Assert::AreEqual(static_cast<size_t>(0), loaded.GetComponents<Position>().size());
+		}
+
+		TEST_METHOD(LoadSaveFromBeforeTimers)
+		{
+			// a save in the original layout - the entity table, then each component - and nothing after.
+			std::ostringstream file(std::ios::binary);
+			utils::serialiseUint32(file, 2);
+			utils::serialiseUint32(file, 0);
+			for (uint32_t i = 0; i < MAX_ENTITIES; i++) {
+				utils::serialiseUint32(file, i < 2 ? i << 16 : 0);
+			}
+			utils::serialiseUint32(file, 2);
+			for (uint32_t i = 0; i < 2; i++) {
+				utils::serialiseUint32(file, 10 + i);
+				utils::serialiseUint32(file, 20 + i);
+			}
+			for (uint32_t i = 0; i < MAX_ENTITIES; i++) {
+				utils::serialiseUint32(file, i < 2 ? i : MAX_ENTITIES + 1);
+			}
+			utils::serialiseUint32(file, 2);
+			utils::serialiseUint32(file, 0);
+			utils::serialiseUint32(file, 1);
+			auto buffer = file.str();
+
+			World loaded;
+			loaded.RegisterComponent<Position>();
+			size_t offset{ 0 };
+			loaded.Deserialise(buffer.data(), offset);
+			loaded.Deserialise<Position>(buffer.data(), offset);
+
+			Assert::AreEqual(buffer.size(), offset);
+			Assert::AreEqual(static_cast<size_t>(2), loaded.GetEntitiesWith<Position>().size());
+			Assert::AreEqual(11.0f, loaded.GetComponent<Position>(1U << 16)->x);
+			Assert::AreEqual(21.0f, loaded.GetComponent<Position>(1U << 16)->y);
+			Assert::AreEqual(0U, loaded.GetTicksToKill(1U << 16));
+		}
+
+		TEST_METHOD(DisabledEntitiesAreSkippedByQueries)
+		{
+			World world;
+			world.RegisterComponent<Position>();
+			world.RegisterComponent<Anchor>();
+			std::vector<uint32_t> entities;
+			for (uint32_t i = 0; i < 10; i++) {
+				auto entity = world.CreateEntity();
+				world.AddComponent<Position>(entity, static_cast<float>(i), 0.0f, 0.0f);
+				world.AddComponent<Anchor>(entity, i);
+				entities.push_back(entity);
+			}
+			auto* anchor = world.GetComponent<Anchor>(entities[2]);
+
+			// disabled entities keep their components but drop out of every query.
+			auto snapshot = world.Snapshot();
+			world.Disable(entities[2]);
+			world.Disable(entities[5]);
+			world.Disable(entities[5]);
+			Assert::IsFalse(world.IsEnabled(entities[2]));
+			Assert::AreEqual(static_cast<size_t>(8), world.GetEntitiesWith<Position>().size());
+			Assert::AreEqual(static_cast<size_t>(8), world.GetEntitiesWith<Anchor, Position>().size());
+			Assert::AreEqual(static_cast<size_t>(8), world.GetComponents<Anchor>(0).size());
+			Assert::AreEqual(static_cast<size_t>(8), world.GetComponentSpan<Position>().size);
+			for (auto* position : world.GetComponents<Position>()) {
+				Assert::IsTrue(position->x != 2.0f && position->x != 5.0f);
+			}
+			Assert::AreEqual(5.0f, world.GetComponent<Position>(entities[5])->x);
+			Assert::IsTrue(anchor == world.GetComponent<Anchor>(entities[2]));
+
+			// components added to or removed from either side keep the partition.
+			world.RemoveComponent<Position>(entities[0]);
+			world.RemoveComponent<Position>(entities[5]);
+			world.AddComponent<Position>(entities[5], 5.0f, 0.0f, 0.0f);
+			auto entity = world.CreateEntity();
+			world.AddComponent<Position>(entity, 10.0f, 0.0f, 0.0f);
+			Assert::AreEqual(static_cast<size_t>(8), world.GetEntitiesWith<Position>().size());
+
+			world.Enable(entities[5]);
+			Assert::AreEqual(static_cast<size_t>(9), world.GetEntitiesWith<Position>().size());
+			Assert::AreEqual(static_cast<size_t>(9), world.GetEntitiesWith<Anchor>().size());
+			Assert::AreEqual(5.0f, world.GetComponent<Position>(entities[5])->x);
+
+			// a killed entity's id comes back enabled.
+			world.KillEntity(entities[2]);
+			auto recycled = world.CreateEntity();
+			Assert::IsTrue(world.IsEnabled(recycled));
+
+			world.Restore(snapshot);
+			Assert::IsTrue(world.IsEnabled(entities[2]));
+			Assert::AreEqual(static_cast<size_t>(10), world.GetEntitiesWith<Anchor, Position>().size());
+			Assert::AreEqual(2.0f, world.GetComponent<Position>(entities[2])->x);
+		}
+
+		TEST_METHOD(RuntimeComponentsShareThePools)
+		{
+			struct Health
+			{
+				float hp;
+				int32_t team;
+			};
+			static int live{ 0 };
+			RuntimeComponent description;
+			description.name = "Health";
+			description.size = sizeof(Health);
+			description.alignment = alignof(Health);
+			description.construct = [](void* component, void*) { new (component) Health{ 100.0f, 0 }; live++; };
+			description.destroy = [](void*, void*) { live--; };
+
+			{
+				World world;
+				world.RegisterComponent<Position>();
+				auto health_id = world.RegisterComponent(description);
+				Assert::AreEqual(health_id, world.GetComponentID("Health"));
+				Assert::AreEqual(-1, world.GetComponentID("Mana"));
+
+				std::vector<uint32_t> entities;
+				for (int i = 0; i < 10; i++) {
+					auto entity = world.CreateEntity();
+					world.AddComponent<Position>(entity);
+					static_cast<Health*>(world.AddComponent(health_id, entity))->team = i;
+					entities.push_back(entity);
+				}
+				Assert::AreEqual(10, live);
+				Assert::IsTrue(world.HasComponent(health_id, entities[3]));
+
+				// a whole column in one call, with the entity of each component.
+				world.Disable(entities[9]);
+				auto column = world.GetColumn(health_id);
+				Assert::AreEqual(static_cast<size_t>(9), column.size);
+				for (size_t i = 0; i < column.size; i++) {
+					auto* health = static_cast<Health*>(column[i]);
+					health->hp -= static_cast<float>(health->team);
+					Assert::IsTrue(world.HasComponents<Position>(column.handles[column.entity_ids[i]]));
+				}
+				Assert::AreEqual(95.0f, static_cast<Health*>(world.GetComponent(health_id, entities[5]))->hp);
+				Assert::AreEqual(100.0f, static_cast<Health*>(world.GetComponent(health_id, entities[9]))->hp);
+
+				world.RemoveComponent(health_id, entities[0]);
+				world.KillEntity(entities[1]);
+				Assert::IsTrue(world.GetComponent(health_id, entities[0]) == nullptr);
+				Assert::AreEqual(8, live);
+
+				// moving an entity to another World moves its component rather than destroying it.
+				World other;
+				Assert::AreEqual(health_id, other.RegisterComponent(description));
+				auto moved = world.MoveEntity(other, entities[2]);
+				Assert::AreEqual(8, live);
+				Assert::AreEqual(98.0f, static_cast<Health*>(other.GetComponent(health_id, moved))->hp);
+			}
+			Assert::AreEqual(0, live);
+
+			description.size = 16;
+			World world;
+			Assert::ExpectException<std::runtime_error>([&]() { world.RegisterComponent(description); });
+		}
+
+		TEST_METHOD(RuntimeCallbacksBelongToTheirWorld)
+		{
+			RuntimeComponent description;
+			description.name = "Counted";
+			description.size = sizeof(int32_t);
+			description.alignment = alignof(int32_t);
+			description.destroy = [](void*, void* context) { (*static_cast<int*>(context))++; };
+
+			int first_destroyed{ 0 };
+			int second_destroyed{ 0 };
+			{
+				World first;
+				description.context = &first_destroyed;
+				auto counted_id = first.RegisterComponent(description);
+				auto entity = first.CreateEntity();
+				first.AddComponent(counted_id, entity);
+				{
+					// registering the same name in another World mustn't change what the first one calls.
+					World second;
+					description.context = &second_destroyed;
+					second.RegisterComponent(description);
+					for (int i = 0; i < 2; i++) {
+						auto other = second.CreateEntity();
+						second.AddComponent(counted_id, other);
+					}
+				}
+				Assert::AreEqual(0, first_destroyed);
+				Assert::AreEqual(2, second_destroyed);
+			}
+			Assert::AreEqual(1, first_destroyed);
+
+			// a World which never registered it can't add it by id, even though the name has an id.
+			World world;
+			world.RegisterComponent<Position>();
+			auto entity = world.CreateEntity();
+			Assert::ExpectException<std::runtime_error>([&]() { world.AddComponent(world.GetComponentID("Counted"), entity); });
+
+			// Worlds on different threads registering the same components at once.
+			std::vector<std::thread> threads;
+			std::atomic<int> failures{ 0 };
+			for (int i = 0; i < 8; i++) {
+				threads.emplace_back([&]() {
+					World local;
+					local.RegisterComponent<Position>();
+					local.RegisterComponent<RigidBody>();
+					RuntimeComponent shared{ "SharedAcrossThreads", 8, 4 };
+					auto id = local.RegisterComponent(shared);
+					auto entity = local.CreateEntity();
+					if (local.AddComponent(id, entity) == nullptr) {
+						failures++;
+					}
+				});
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			Assert::AreEqual(0, failures.load());
+		}
 	};
 }
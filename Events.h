@@ -0,0 +1,181 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <memory_resource>
+#include <stdexcept>
+
+const int MAX_EVENT_TYPES{ 32 };
+const int MAX_EVENT_THREADS{ 64 };
+
+/*
+* Event queues
+*
+* Each event type has one pair of buffers per emitting thread. Emit appends to the calling thread's
+* write buffer, so emitters never contend. At the end of the frame the write and read buffers are
+* swapped and the new write buffers are cleared, which keeps their capacity - once the buffers have
+* grown to the peak number of events per frame no more memory is allocated or freed.
+*
+* Events emitted during frame N are read during frame N + 1, one contiguous batch per emitting thread.
+* A slot freed by a thread which exits is reused by the next new emitting thread, so a batch can hold
+* the events of a thread which exited followed by those of the thread which took over its slot.
+*/
+
+class EventThreadSlots
+{
+	/* The slots of the threads currently emitting events. A thread takes the lowest free slot the first
+	*  time it emits and gives it back when it exits, so only MAX_EVENT_THREADS threads emitting at once
+	*  is an error, not MAX_EVENT_THREADS threads over the life of the process.
+	*/
+private:
+	static std::array<std::atomic<bool>, MAX_EVENT_THREADS>& used() {
+		static std::array<std::atomic<bool>, MAX_EVENT_THREADS> slots{};
+		return slots;
+	}
+
+public:
+	int slot{ -1 };
+
+	EventThreadSlots() {
+		for (int i = 0; i < MAX_EVENT_THREADS; i++) {
+			bool expected{ false };
+			if (used()[i].compare_exchange_strong(expected, true)) {
+				slot = i;
+				return;
+			}
+		}
+		throw std::runtime_error("Max number of event emitting threads exceeded.");
+	}
+
+	~EventThreadSlots() {
+		used()[slot].store(false);
+	}
+
+	EventThreadSlots(const EventThreadSlots&) = delete;
+	EventThreadSlots& operator=(const EventThreadSlots&) = delete;
+};
+
+inline int EventThreadSlot() {
+	/* Each thread which emits events holds a slot from the first time it emits until it exits. */
+	thread_local EventThreadSlots thread_slot;
+	return thread_slot.slot;
+}
+
+inline int NextEventID() {
+	static std::atomic<int> event_counter{ 0 };
+	return event_counter++;
+}
+
+struct IEventQueue
+{
+	virtual ~IEventQueue() {};
+	virtual void swap() = 0;
+};
+
+template <typename Event>
+class EventQueue : public IEventQueue
+{
+private:
+	std::vector<std::pmr::vector<Event>> m_write;
+	std::vector<std::pmr::vector<Event>> m_read;
+
+public:
+	EventQueue(std::pmr::memory_resource* resource) {
+		m_write.reserve(MAX_EVENT_THREADS);
+		m_read.reserve(MAX_EVENT_THREADS);
+		for (int i = 0; i < MAX_EVENT_THREADS; i++) {
+			m_write.emplace_back(resource);
+			m_read.emplace_back(resource);
+		}
+	};
+
+	template <typename... Args>
+	void emit(Args... args) {
+		m_write[EventThreadSlot()].emplace_back(std::forward<Args>(args)...);
+	}
+
+	virtual void swap() override {
+		for (int i = 0; i < MAX_EVENT_THREADS; i++) {
+			m_write[i].swap(m_read[i]);
+			m_write[i].clear();
+		}
+	}
+
+	inline int num_batches() const {
+		return MAX_EVENT_THREADS;
+	}
+
+	inline const std::pmr::vector<Event>& batch(const int slot) const {
+		/* The events emitted by one thread during the previous frame, in the order they were emitted. */
+		return m_read[slot];
+	}
+
+	size_t size() const {
+		size_t num_events{ 0 };
+		for (auto& events : m_read) {
+			num_events += events.size();
+		}
+		return num_events;
+	}
+
+	template <typename Function>
+	void for_each(Function function) const {
+		for (auto& events : m_read) {
+			for (auto& event : events) {
+				function(event);
+			}
+		}
+	}
+};
+
+class EventBus
+{
+private:
+	std::pmr::memory_resource* m_resource;
+	std::vector<std::unique_ptr<IEventQueue>> m_queues;
+
+public:
+	EventBus(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : m_resource(resource) {};
+
+	template <typename Event>
+	static int GetID() {
+		/* Event types have their own process wide ids, separate from the component ids. */
+		static const int event_id = NextEventID();
+
+		if (event_id >= MAX_EVENT_TYPES) {
+			throw std::runtime_error("Max number of event types exceeded.");
+		}
+		return event_id;
+	}
+
+	template <typename Event>
+	void Register() {
+		auto event_id = GetID<Event>();
+		if (m_queues.size() <= static_cast<size_t>(event_id)) {
+			m_queues.resize(event_id + 1);
+		}
+		if (m_queues[event_id] == nullptr) {
+			m_queues[event_id] = std::make_unique<EventQueue<Event>>(m_resource);
+		}
+	}
+
+	template <typename Event>
+	EventQueue<Event>& Queue() const {
+		auto event_id = GetID<Event>();
+		if (m_queues.size() <= static_cast<size_t>(event_id) || m_queues[event_id] == nullptr) {
+			throw std::runtime_error("Event type has not been registered.");
+		}
+		return *static_cast<EventQueue<Event>*>(m_queues[event_id].get());
+	}
+
+	void Swap() {
+		for (auto& queue : m_queues) {
+			if (queue != nullptr) {
+				queue->swap();
+			}
+		}
+	}
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <tuple>
+#include <vector>
+#include <atomic>
+
+#include "World.h"
+
+/*
+* Render extract
+*
+* The World is not safe to read while it is being changed - adding or removing a component moves
+* others around in their pools. A FrameExtract lets another thread, typically the renderer, read a
+* frame's worth of components while the simulation carries on with the next one. At a sync point,
+* usually after EndFrame, the simulation calls Publish, which copies the components of every entity
+* which has all of them into a FrameView. The render thread calls Acquire to get the last published
+* view, which doesn't change until it calls Acquire again.
+*
+*	FrameExtract<Position, MeshRenderer> extract;
+*
+*	// simulation thread
+*	world.EndFrame();
+*	extract.Publish(world);
+*
+*	// render thread
+*	if (auto* view = extract.Acquire()) {
+*		for (size_t i = 0; i < view->size(); i++) {
+*			Draw(view->get<MeshRenderer>(i), view->get<Position>(i));
+*		}
+*	}
+*
+* The views are triple buffered: one being written, one being read and the latest published one in
+* between. Publish and Acquire each swap a buffer with the one in between in a single atomic
+* exchange, so neither thread ever waits for the other. A renderer which falls behind skips frames,
+* and one which runs ahead sees the same frame again. A view keeps its capacity from frame to frame, so
+* publishing only allocates while the number of entities grows.
+*/
+
+template <typename... Components>
+class FrameView
+{
+private:
+	uint64_t m_frame{ 0 };
+	std::vector<uint32_t> m_entities;
+	std::tuple<std::vector<Components>...> m_columns;
+
+	template <typename... Any>
+	friend class FrameExtract;
+
+public:
+	inline uint64_t frame() const {
+		/* The number of the Publish call which filled the view, counting from 1. */
+		return m_frame;
+	}
+
+	inline size_t size() const {
+		return m_entities.size();
+	}
+
+	inline uint32_t entity(const size_t i) const {
+		/* The entity's handle in the World when the view was published. */
+		return m_entities[i];
+	}
+
+	template <typename Component>
+	inline const Component& get(const size_t i) const {
+		return std::get<std::vector<Component>>(m_columns)[i];
+	}
+
+	template <typename Component>
+	inline const std::vector<Component>& column() const {
+		/* One component per entity, in the order of the entities. */
+		return std::get<std::vector<Component>>(m_columns);
+	}
+};
+
+template <typename... Components>
+class FrameExtract
+{
+private:
+	// the in between buffer's index, with DIRTY set if it was published and hasn't been acquired yet.
+	static constexpr uint8_t INDEX_MASK{ 0x3 };
+	static constexpr uint8_t DIRTY{ 0x4 };
+
+	std::array<FrameView<Components...>, 3> m_views;
+	// only Publish touches m_back, only Acquire touches m_front.
+	uint8_t m_back{ 0 };
+	uint8_t m_front{ 1 };
+	std::atomic<uint8_t> m_middle{ 2 };
+	uint64_t m_frame{ 0 };
+
+public:
+	void Publish(World& world) {
+		/* Copies the components of every entity which has all of them into a view and makes it the one
+		*  returned by Acquire. Call this from the thread which changes the World, between changes.
+		*/
+		ECS_TRACE_SCOPE(world, "FrameExtract::Publish");
+		auto& view = m_views[m_back];
+		view.m_frame = ++m_frame;
+		view.m_entities.clear();
+		(std::get<std::vector<Components>>(view.m_columns).clear(), ...);
+
+		// const, so that publishing doesn't mark the components changed.
+		for (auto entity : world.template GetEntitiesWith<Components...>(0)) {
+			view.m_entities.push_back(entity);
+			(std::get<std::vector<Components>>(view.m_columns).push_back(*world.template GetComponent<const Components>(entity)), ...);
+		}
+
+		m_back = m_middle.exchange(static_cast<uint8_t>(m_back | DIRTY), std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	const FrameView<Components...>* Acquire() {
+		/* Returns the last published view, or nullptr if nothing has been published. The view stays valid
+		*  and unchanged until the next call. Call this from one reading thread only.
+		*/
+		if (m_middle.load(std::memory_order_relaxed) & DIRTY) {
+			m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+		}
+		auto& view = m_views[m_front];
+		return view.m_frame > 0 ? &view : nullptr;
+	}
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory_resource>
+
+#include "Signals.h"
+
+/*
+* Hierarchy
+*
+* Parent/child relationships are held in a Hierarchy component on every entity which is part of a
+* tree - its parent, its first child and its siblings, as an intrusive linked list. Alongside the
+* components the World keeps every hierarchy entity in one array ordered so that parents always come
+* before their children, which lets PropagateTransforms compute every GlobalPosition in a single
+* linear pass.
+*
+* Reparenting only reorders anything if the child currently comes before its new parent, in which
+* case its subtree is appended to the end of the array and its old entries are left as tombstones.
+* The array is compacted once tombstones make up half of it, so reparenting costs O(subtree)
+* amortised. However a Hierarchy is added - SetParent, AddComponent, Instantiate or MoveEntity - the
+* entity starts out as a root, and any links it was copied with are dropped. Killing an entity (or
+* removing its Hierarchy) detaches it, and its children become roots.
+*/
+
+const uint32_t NULL_ENTITY{ 0xFFFFFFFF };
+const uint32_t NO_PARENT_INDEX{ 0xFFFFFFFF };
+
+struct Hierarchy
+{
+	uint32_t parent{ NULL_ENTITY };
+	uint32_t first_child{ NULL_ENTITY };
+	uint32_t next_sibling{ NULL_ENTITY };
+	uint32_t prev_sibling{ NULL_ENTITY };
+	// where the entity sits in the World's HierarchyOrder.
+	uint32_t order_index{ 0 };
+};
+
+struct GlobalPosition
+{
+	GlobalPosition() {};
+	GlobalPosition(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {};
+
+	float x{ 0.0f }, y{ 0.0f }, z{ 0.0f };
+};
+
+struct HierarchyNode
+{
+	uint32_t entity;
+	// the parent's position in the order, NO_PARENT_INDEX for roots.
+	uint32_t parent_index;
+};
+
+struct HierarchyOrder
+{
+	std::pmr::vector<HierarchyNode> nodes;
+	size_t tombstones{ 0 };
+
+	HierarchyOrder(std::pmr::memory_resource* resource) : nodes(resource) {};
+};
+
+template <>
+struct Signals<Hierarchy> : Listeners<Hierarchy>
+{
+	// make the entity a root of its own and detach it from its tree, defined after World.
+	static void on_construct(World& world, const uint32_t entity, Hierarchy& hierarchy);
+	static void on_destroy(World& world, const uint32_t entity, Hierarchy& hierarchy);
+};
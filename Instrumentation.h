@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <initializer_list>
+
+#include "Registry.h"
+
+/*
+* Instrumentation
+*
+* Compiled in only when ECS_INSTRUMENTATION is defined. Without it every ECS_INSTRUMENT(...) statement
+* in World expands to nothing, so there is no cost at all when it is switched off.
+*
+* When enabled the World counts adds, removes, lookups and swap-and-pops per component, calls and
+* result sizes per query signature, and records scoped timings. GetInstrumentation().snapshot() copies
+* the counters out for a metrics system and write_chrome_trace() writes everything as trace event
+* JSON, which can be loaded into chrome://tracing or Perfetto.
+*
+* Systems running on worker threads may time themselves, query and look up components at once:
+* record_trace (and so ScopedTrace), record_query and count_lookup are thread-safe. The other counters
+* are only changed by calls which change the World, which mustn't run alongside anything else anyway.
+* snapshot, reset and write_chrome_trace are safe against those three calls, but counts made while
+* they run may or may not be included.
+*/
+
+#ifdef ECS_INSTRUMENTATION
+#define ECS_INSTRUMENT(...) __VA_ARGS__
+#else
+#define ECS_INSTRUMENT(...)
+#endif
+
+#define ECS_CONCAT_IMPL(a, b) a##b
+#define ECS_CONCAT(a, b) ECS_CONCAT_IMPL(a, b)
+
+// times the rest of the enclosing scope, e.g. ECS_TRACE_SCOPE(world, "Physics");
+#define ECS_TRACE_SCOPE(world, name) ECS_INSTRUMENT(ScopedTrace ECS_CONCAT(ecs_trace_, __LINE__)((world).GetInstrumentation(), name))
+
+const size_t MAX_TRACE_EVENTS{ 1 << 20 };
+
+enum class QueryKind { ENTITIES_WITH, COMPONENTS };
+
+inline int NextQueryID() {
+	static std::atomic<int> query_counter{ 0 };
+	return query_counter++;
+}
+
+struct ComponentCounters
+{
+	uint64_t adds{ 0 };
+	uint64_t removes{ 0 };
+	uint64_t lookups{ 0 };
+	uint64_t swap_and_pops{ 0 };
+};
+
+struct QueryCounters
+{
+	std::string signature;
+	uint64_t calls{ 0 };
+	uint64_t results{ 0 };
+	uint64_t max_results{ 0 };
+};
+
+struct TraceEvent
+{
+	const char* name;
+	int64_t start_us;
+	int64_t duration_us;
+	size_t thread;
+};
+
+struct InstrumentationSnapshot
+{
+	std::array<ComponentCounters, MAX_COMPONENTS> components;
+	std::vector<QueryCounters> queries;
+	size_t trace_events{ 0 };
+	size_t dropped_trace_events{ 0 };
+};
+
+class Instrumentation
+{
+private:
+	std::chrono::steady_clock::time_point m_epoch{ std::chrono::steady_clock::now() };
+	std::vector<TraceEvent> m_trace;
+	size_t m_dropped{ 0 };
+	// guards the trace and the query counters.
+	mutable std::mutex m_mutex;
+
+	static uint64_t load(const uint64_t& counter) {
+		return std::atomic_ref<const uint64_t>(counter).load(std::memory_order_relaxed);
+	}
+
+public:
+	std::array<ComponentCounters, MAX_COMPONENTS> components;
+	std::vector<QueryCounters> queries;
+
+	inline int64_t now_us() const {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+	}
+
+	void count_lookup(const int component_id) {
+		std::atomic_ref<uint64_t>(components[component_id].lookups).fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void record_query(const int query_id, const QueryKind kind, const std::initializer_list<int> component_ids, const size_t results) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (queries.size() <= static_cast<size_t>(query_id)) {
+			queries.resize(query_id + 1);
+		}
+
+		auto& query = queries[query_id];
+		if (query.signature.empty()) {
+			query.signature = kind == QueryKind::ENTITIES_WITH ? "GetEntitiesWith<" : "GetComponents<";
+			for (auto component_id : component_ids) {
+				query.signature += std::to_string(component_id) + ",";
+			}
+			query.signature.back() = '>';
+		}
+
+		query.calls++;
+		query.results += results;
+		if (results > query.max_results) {
+			query.max_results = results;
+		}
+	}
+
+	void record_trace(const char* name, const int64_t start_us, const int64_t duration_us) {
+		auto thread = std::hash<std::thread::id>{}(std::this_thread::get_id());
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_trace.size() >= MAX_TRACE_EVENTS) {
+			m_dropped++;
+			return;
+		}
+		m_trace.push_back({ name, start_us, duration_us, thread });
+	}
+
+	InstrumentationSnapshot snapshot() const {
+		InstrumentationSnapshot snapshot;
+		snapshot.components = counters();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& query : queries) {
+			if (query.calls > 0) {
+				snapshot.queries.push_back(query);
+			}
+		}
+		snapshot.trace_events = m_trace.size();
+		snapshot.dropped_trace_events = m_dropped;
+		return snapshot;
+	}
+
+	void reset() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& counters : components) {
+			std::atomic_ref<uint64_t>(counters.lookups).store(0, std::memory_order_relaxed);
+			counters.adds = 0;
+			counters.removes = 0;
+			counters.swap_and_pops = 0;
+		}
+		queries.clear();
+		m_trace.clear();
+		m_dropped = 0;
+	}
+
+	void write_chrome_trace(std::ostream& out) const {
+		/* Scoped timings are written as complete ("X") events and the counters as one counter ("C")
+		*  event per component and query at the time of export.
+		*/
+		auto end_us = now_us();
+		auto component_counters = counters();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		out << "{\"traceEvents\":[\n";
+
+		bool first{ true };
+		auto separator = [&out, &first]() {
+			out << (first ? "" : ",\n");
+			first = false;
+		};
+
+		for (auto& event : m_trace) {
+			separator();
+			out << "{\"name\":\"" << event.name << "\",\"cat\":\"ecs\",\"ph\":\"X\",\"ts\":" << event.start_us
+				<< ",\"dur\":" << event.duration_us << ",\"pid\":1,\"tid\":" << (event.thread % 100000) << "}";
+		}
+
+		for (int i = 0; i < MAX_COMPONENTS; i++) {
+			auto& counters = component_counters[i];
+			if (counters.adds == 0 && counters.removes == 0 && counters.lookups == 0) {
+				continue;
+			}
+			separator();
+			out << "{\"name\":\"component " << i << "\",\"cat\":\"ecs\",\"ph\":\"C\",\"ts\":" << end_us
+				<< ",\"pid\":1,\"args\":{\"adds\":" << counters.adds << ",\"removes\":" << counters.removes
+				<< ",\"lookups\":" << counters.lookups << ",\"swap_and_pops\":" << counters.swap_and_pops << "}}";
+		}
+
+		for (auto& query : queries) {
+			if (query.calls == 0) {
+				continue;
+			}
+			separator();
+			out << "{\"name\":\"" << query.signature << "\",\"cat\":\"ecs\",\"ph\":\"C\",\"ts\":" << end_us
+				<< ",\"pid\":1,\"args\":{\"calls\":" << query.calls << ",\"results\":" << query.results
+				<< ",\"max_results\":" << query.max_results << "}}";
+		}
+
+		out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+	}
+
+private:
+	std::array<ComponentCounters, MAX_COMPONENTS> counters() const {
+		std::array<ComponentCounters, MAX_COMPONENTS> copy;
+		for (int i = 0; i < MAX_COMPONENTS; i++) {
+			copy[i] = { components[i].adds, components[i].removes, load(components[i].lookups), components[i].swap_and_pops };
+		}
+		return copy;
+	}
+};
+
+class ScopedTrace
+{
+	/* Records the time between its construction and destruction as one trace event. name must outlive
+	*  the Instrumentation, normally it is a string literal.
+	*/
+private:
+	Instrumentation& m_instrumentation;
+	const char* m_name;
+	int64_t m_start_us;
+
+public:
+	ScopedTrace(Instrumentation& instrumentation, const char* name) :
+		m_instrumentation(instrumentation), m_name(name), m_start_us(instrumentation.now_us()) {};
+
+	~ScopedTrace() {
+		m_instrumentation.record_trace(m_name, m_start_us, m_instrumentation.now_us() - m_start_us);
+	};
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include "Registry.h"
+#include "Shared.h"
+
+/*
+* Prefab
+*
+* A set of components with initial values, captured once and stamped onto many entities with
+* World::Instantiate. Every component is copied into its pool for the whole batch at once -
+* trivially copyable components by doubling memcpys, anything else by copy construction.
+*
+*	Prefab goblin;
+*	goblin.With<Position>(0.0f, 0.0f, 0.0f).With<MeshRenderer>(3).With<AI>();
+*	auto wave = world.Instantiate(goblin, 500);
+*
+* Shared components are added with WithShared, which holds the value in a store of the prefab's own.
+* Each instantiated entity's SharedRef starts out pointing at it, and interns it into the World's store.
+*/
+
+class Prefab
+{
+public:
+	struct Entry
+	{
+		int component_id;
+		std::shared_ptr<const void> prototype;
+		// copies the prototype into count slots, stride bytes apart, starting at destination.
+		void (*fill)(void* destination, const void* prototype, const size_t count, const size_t stride);
+	};
+
+private:
+	std::vector<Entry> m_entries;
+
+	template <typename Component>
+	static void Fill(void* destination, const void* prototype, const size_t count, const size_t stride) {
+		auto* slots = static_cast<char*>(destination);
+		auto& value = *static_cast<const Component*>(prototype);
+
+		if constexpr (std::is_trivially_copyable_v<Component>) {
+			if (stride == sizeof(Component)) {
+				// copy the first, then keep doubling the filled run.
+				std::memcpy(slots, &value, sizeof(Component));
+				size_t filled{ 1 };
+				while (filled < count) {
+					auto copies = std::min(filled, count - filled);
+					std::memcpy(slots + filled * stride, slots, copies * stride);
+					filled += copies;
+				}
+				return;
+			}
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			new (slots + i * stride) Component(value);
+		}
+	}
+
+	void Add(Entry entry) {
+		/* A component already in the prefab is replaced. */
+		auto component_id = entry.component_id;
+		auto existing = std::find_if(m_entries.begin(), m_entries.end(),
+			[component_id](const Entry& e) { return e.component_id == component_id; });
+		if (existing != m_entries.end()) {
+			*existing = std::move(entry);
+		}
+		else {
+			m_entries.push_back(std::move(entry));
+		}
+	}
+
+public:
+	template <typename Component, typename... Args>
+	Prefab& With(Args... args) {
+		/* Adds a component, constructed from args, to the prefab. A component already in the prefab is replaced. */
+		static_assert(!is_shared_ref_v<Component>, "Shared components are added to a prefab with WithShared.");
+		Add(Entry{ ComponentRegistry::GetID<Component>(), std::make_shared<const Component>(std::forward<Args>(args)...), &Fill<Component> });
+		return *this;
+	}
+
+	template <typename Component, typename... Args>
+	Prefab& WithShared(Args... args) {
+		/* Adds a SharedRef<Component> to the value constructed from args. */
+		static_assert(SharedValue<Component>::enabled, "SharedValue<Component> has not been specialised.");
+		struct Shared
+		{
+			SharedStore<Component> store;
+			SharedRef<Component> ref;
+		};
+		auto shared = std::make_shared<Shared>();
+		shared->ref.store = &shared->store;
+		shared->ref.handle = shared->store.intern(Component(std::forward<Args>(args)...));
+
+		// the prototype is the ref, which keeps the store it points at alive.
+		std::shared_ptr<const void> prototype(shared, &shared->ref);
+		Add(Entry{ ComponentRegistry::GetID<SharedRef<Component>>(), prototype, &Fill<SharedRef<Component>> });
+		return *this;
+	}
+
+	inline const std::vector<Entry>& Entries() const {
+		return m_entries;
+	}
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <map>
+#include <mutex>
+
+class World;
+
+const int MAX_COMPONENTS{ 40 };
+
+/*
+* Process wide component type registry.
+*
+* Component ids are handed out the first time a type is used anywhere in the process, so every World
+* agrees on them. Alongside the id the registry keeps what a World needs to handle the component
+* without knowing its type - the pool layout and the compile time signal hooks - which is filled in
+* when the component is registered with a World.
+*
+* Components can also be described at run time, e.g. by a scripting layer or an editor, with a
+* RuntimeComponent. They are looked up by name instead of by type, and each name gets an id from the
+* same counter as the C++ types, so the World stores both kinds in the same pools. Only the layout of a
+* runtime component is process wide - its construct and destroy functions belong to the World it was
+* registered with.
+*
+* Worlds on different threads may register components at the same time, so the table is only read
+* and written under a lock, and GetInfo hands out a copy.
+*/
+
+enum class StoragePolicy : uint8_t { DENSE, HASHED, STABLE };
+
+struct ComponentInfo
+{
+	bool registered{ false };
+	bool tag{ false };
+	size_t stride{ 0 };
+	size_t alignment{ 0 };
+	bool huge_pages{ false };
+	StoragePolicy storage{ StoragePolicy::DENSE };
+
+	void (*static_construct)(World&, const uint32_t, void*) { nullptr };
+	void (*static_destroy)(World&, const uint32_t, void*) { nullptr };
+
+	// only set for runtime components.
+	std::string name;
+};
+
+struct RuntimeComponent
+{
+	std::string name;
+	size_t size{ 0 };
+	size_t alignment{ alignof(std::max_align_t) };
+	StoragePolicy storage{ StoragePolicy::DENSE };
+	// called on each new component with context. The bytes are zeroed instead if it is nullptr.
+	void (*construct)(void* component, void* context) { nullptr };
+	// called before a component is removed, including by KillEntity and when its World is destroyed,
+	// but not when it is moved to another World.
+	void (*destroy)(void* component, void* context) { nullptr };
+	// the functions and context are kept by the World they are registered with, so two Worlds can
+	// register the same name with their own.
+	void* context{ nullptr };
+};
+
+class ComponentRegistry
+{
+private:
+	static int NextID() {
+		static std::atomic<int> component_counter{ 0 };
+
+		auto component_id = component_counter++;
+		if (component_id >= MAX_COMPONENTS) {
+			throw std::runtime_error("Max number of components exceeded.");
+		}
+		return component_id;
+	}
+
+	static std::array<ComponentInfo, MAX_COMPONENTS>& Infos() {
+		static std::array<ComponentInfo, MAX_COMPONENTS> infos;
+		return infos;
+	}
+
+	static std::map<std::string, int>& Names() {
+		static std::map<std::string, int> names;
+		return names;
+	}
+
+	static std::mutex& NamesMutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static std::mutex& InfosMutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+
+public:
+	template <typename Component>
+	static int GetID() {
+		static const int component_id = NextID();
+		return component_id;
+	}
+
+	static int GetID(const std::string& name) {
+		/* The id of a runtime component, handed out the first time its name is used. */
+		std::lock_guard<std::mutex> lock(NamesMutex());
+		auto found = Names().find(name);
+		if (found != Names().end()) {
+			return found->second;
+		}
+		auto component_id = NextID();
+		Names().emplace(name, component_id);
+		return component_id;
+	}
+
+	static int FindID(const std::string& name) {
+		/* The id of a runtime component, or -1 if no component has been given that name. */
+		std::lock_guard<std::mutex> lock(NamesMutex());
+		auto found = Names().find(name);
+		return found != Names().end() ? found->second : -1;
+	}
+
+	static ComponentInfo GetInfo(const int component_id) {
+		std::lock_guard<std::mutex> lock(InfosMutex());
+		return Infos().at(component_id);
+	}
+
+	template <typename Function>
+	static void Describe(const int component_id, Function describe) {
+		/* Calls describe with the component's entry, under the lock. An exception it throws leaves the 
+		*  entry as describe left it, so it should check before it changes anything.
+		*/
+		std::lock_guard<std::mutex> lock(InfosMutex());
+		describe(Infos().at(component_id));
+	}
+};
@@ -0,0 +1,530 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "World.h"
+
+/*
+* Replication
+*
+* A ReplicationServer encodes the replicated components of a World into one packet per client, and a
+* ReplicationClient decodes those packets into another World. Each client has an interest set over
+* entity ids - only those entities are sent to it - and a baseline holding the last state it was sent
+* of every component. A component is only written when its quantised state differs from the
+* baseline, and then only the fields which changed, so a tick in which nothing moved costs a few bits
+* per component type.
+*
+* Which components are replicated, and how each is quantised and bit-packed, is chosen by
+* specialising Replicated<Component>:
+*
+*	template <>
+*	struct Replicated<Health>
+*	{
+*		static constexpr bool enabled{ true };
+*		struct State { uint32_t hp; };
+*		static State quantise(const Health& health) { return { health.hp }; };
+*		static void write(BitWriter& writer, const State& state, const State& baseline) { writer.write(state.hp, 16); };
+*		static State read(BitReader& reader, const State& baseline) { return { reader.read(16) }; };
+*		static void apply(const State& state, Health& health) { health.hp = state.hp; };
+*	};
+*
+* A state has changed when write encodes it differently from the baseline, each against an empty
+* State, so padding and anything write leaves out never cause a resend. Packets have to be decoded in
+* the order they were encoded, as they would be over a reliable stream, because each one is a delta on
+* the one before. The server and client must replicate the same components in the same order.
+*/
+
+const int ENTITY_ID_BITS{ 14 };
+const int ENTITY_VERSION_BITS{ 8 };
+
+static_assert(MAX_ENTITIES < (1 << ENTITY_ID_BITS), "Entity ids no longer fit in a replication record.");
+
+class BitWriter
+{
+private:
+	std::vector<uint8_t>& m_bytes;
+	uint64_t m_scratch{ 0 };
+	int m_bits{ 0 };
+
+public:
+	BitWriter(std::vector<uint8_t>& bytes) : m_bytes(bytes) {};
+
+	inline void write(const uint32_t value, const int bits) {
+		/* Appends the low bits of value, at most 32. */
+		m_scratch |= static_cast<uint64_t>(bits == 32 ? value : value & ((1u << bits) - 1)) << m_bits;
+		m_bits += bits;
+		while (m_bits >= 8) {
+			m_bytes.push_back(static_cast<uint8_t>(m_scratch));
+			m_scratch >>= 8;
+			m_bits -= 8;
+		}
+	}
+
+	void flush() {
+		/* Writes out the last partial byte, padded with zeros. */
+		if (m_bits > 0) {
+			m_bytes.push_back(static_cast<uint8_t>(m_scratch));
+			m_scratch = 0;
+			m_bits = 0;
+		}
+	}
+};
+
+class BitReader
+{
+private:
+	const uint8_t* m_data;
+	size_t m_size;
+	size_t m_offset{ 0 };
+	uint64_t m_scratch{ 0 };
+	int m_bits{ 0 };
+
+public:
+	BitReader(const uint8_t* data, const size_t size) : m_data(data), m_size(size) {};
+
+	inline uint32_t read(const int bits) {
+		while (m_bits < bits) {
+			if (m_offset == m_size) {
+				throw std::runtime_error("Replication packet is truncated.");
+			}
+			m_scratch |= static_cast<uint64_t>(m_data[m_offset++]) << m_bits;
+			m_bits += 8;
+		}
+		auto value = static_cast<uint32_t>(bits == 32 ? m_scratch : m_scratch & ((1ull << bits) - 1));
+		m_scratch >>= bits;
+		m_bits -= bits;
+		return value;
+	}
+};
+
+// positions are sent as fixed point, 1/64 of a unit over +/-8192 units, 20 bits an axis.
+const float POSITION_RANGE{ 8192.0f };
+const float POSITION_RESOLUTION{ 64.0f };
+const int POSITION_BITS{ 20 };
+
+inline uint32_t QuantisePosition(const float value) {
+	/* Values outside the range are clamped to it. */
+	auto scaled = (value + POSITION_RANGE) * POSITION_RESOLUTION + 0.5f;
+	auto max = static_cast<float>((1u << POSITION_BITS) - 1);
+	return static_cast<uint32_t>(std::min(std::max(scaled, 0.0f), max));
+}
+
+inline float DequantisePosition(const uint32_t value) {
+	return static_cast<float>(value) / POSITION_RESOLUTION - POSITION_RANGE;
+}
+
+template <typename Component>
+struct Replicated
+{
+	static constexpr bool enabled{ false };
+};
+
+template <>
+struct Replicated<Position>
+{
+	static constexpr bool enabled{ true };
+
+	struct State
+	{
+		uint32_t axes[3];
+	};
+
+	static State quantise(const Position& position) {
+		return { { QuantisePosition(position.x), QuantisePosition(position.y), QuantisePosition(position.z) } };
+	}
+
+	static void write(BitWriter& writer, const State& state, const State& baseline) {
+		/* One bit per axis says whether it changed. */
+		for (int i = 0; i < 3; i++) {
+			auto changed = state.axes[i] != baseline.axes[i];
+			writer.write(changed, 1);
+			if (changed) {
+				writer.write(state.axes[i], POSITION_BITS);
+			}
+		}
+	}
+
+	static State read(BitReader& reader, const State& baseline) {
+		auto state = baseline;
+		for (int i = 0; i < 3; i++) {
+			if (reader.read(1)) {
+				state.axes[i] = reader.read(POSITION_BITS);
+			}
+		}
+		return state;
+	}
+
+	static void apply(const State& state, Position& position) {
+		position.x = DequantisePosition(state.axes[0]);
+		position.y = DequantisePosition(state.axes[1]);
+		position.z = DequantisePosition(state.axes[2]);
+	}
+};
+
+template <>
+struct Replicated<MeshRenderer>
+{
+	static constexpr bool enabled{ true };
+
+	struct State
+	{
+		uint32_t id;
+	};
+
+	static State quantise(const MeshRenderer& renderer) {
+		return { renderer.id };
+	}
+
+	static void write(BitWriter& writer, const State& state, const State&) {
+		writer.write(state.id, 32);
+	}
+
+	static State read(BitReader& reader, const State&) {
+		return { reader.read(32) };
+	}
+
+	static void apply(const State& state, MeshRenderer& renderer) {
+		renderer.id = state.id;
+	}
+};
+
+inline uint32_t MakeRemoteEntity(const uint32_t entity_id, const uint32_t version) {
+	/* The handle an entity had on the server, built from the id and version in a record. */
+	return (entity_id << 16) | (version << 8);
+}
+
+/* An entity id set with one bit per id, shared by the interest sets and the baselines. */
+using EntityBits = std::vector<uint64_t>;
+
+inline EntityBits MakeEntityBits() {
+	return EntityBits((MAX_ENTITIES + 63) / 64, 0);
+}
+
+inline bool TestBit(const EntityBits& bits, const uint32_t entity_id) {
+	return (bits[entity_id >> 6] >> (entity_id & 63)) & 1;
+}
+
+inline void SetBit(EntityBits& bits, const uint32_t entity_id, const bool value) {
+	if (value) {
+		bits[entity_id >> 6] |= 1ull << (entity_id & 63);
+	}
+	else {
+		bits[entity_id >> 6] &= ~(1ull << (entity_id & 63));
+	}
+}
+
+struct IReplicationChannel
+{
+	virtual ~IReplicationChannel() {};
+	virtual void add_client() = 0;
+	virtual void encode(World& world, const int client, const EntityBits& interest, BitWriter& writer) = 0;
+};
+
+template <typename Component>
+class ReplicationChannel : public IReplicationChannel
+{
+	/* The server side of one replicated component - a baseline per client of the state last sent. */
+private:
+	using Traits = Replicated<Component>;
+	using State = typename Traits::State;
+
+	struct Baseline
+	{
+		std::vector<State> states;
+		// the server handle each state was sent for, so a recycled id is sent afresh.
+		std::vector<uint32_t> entities;
+		EntityBits present;
+		EntityBits seen;
+	};
+
+	std::vector<Baseline> m_baselines;
+	// the full encodings of a state and its baseline, kept to avoid allocating for each comparison.
+	std::vector<uint8_t> m_state_bytes;
+	std::vector<uint8_t> m_baseline_bytes;
+
+	static void Encode(const State& state, std::vector<uint8_t>& bytes) {
+		bytes.clear();
+		BitWriter writer(bytes);
+		Traits::write(writer, state, State{});
+		writer.flush();
+	}
+
+	bool Unchanged(const State& state, const State& baseline) {
+		Encode(state, m_state_bytes);
+		Encode(baseline, m_baseline_bytes);
+		return m_state_bytes == m_baseline_bytes;
+	}
+
+	static void WriteHeader(BitWriter& writer, const uint32_t entity, const bool removed) {
+		writer.write(1, 1);
+		writer.write(entity >> 16, ENTITY_ID_BITS);
+		writer.write((entity >> 8) & 0xFF, ENTITY_VERSION_BITS);
+		writer.write(removed, 1);
+	}
+
+public:
+	virtual void add_client() override {
+		m_baselines.push_back({ std::vector<State>(MAX_ENTITIES), std::vector<uint32_t>(MAX_ENTITIES, NULL_ENTITY),
+			MakeEntityBits(), MakeEntityBits() });
+	}
+
+	virtual void encode(World& world, const int client, const EntityBits& interest, BitWriter& writer) override {
+		/* Writes a record for every entity of interest whose state differs from the client's baseline,
+		*  then a removal for every entity in the baseline which wasn't visited. A zero bit ends the
+		*  channel.
+		*/
+		auto& baseline = m_baselines[client];
+		std::fill(baseline.seen.begin(), baseline.seen.end(), 0);
+
+		for (auto entity : world.GetEntitiesWith<Component>()) {
+			auto entity_id = entity >> 16;
+			if (!TestBit(interest, entity_id)) {
+				continue;
+			}
+			SetBit(baseline.seen, entity_id, true);
+
+			auto state = Traits::quantise(*world.GetComponent<const Component>(entity));
+			auto& previous = baseline.states[entity_id];
+			auto known = TestBit(baseline.present, entity_id) && baseline.entities[entity_id] == entity;
+			if (known && Unchanged(state, previous)) {
+				continue;
+			}
+
+			WriteHeader(writer, entity, false);
+			Traits::write(writer, state, known ? previous : State{});
+			previous = state;
+			baseline.entities[entity_id] = entity;
+			SetBit(baseline.present, entity_id, true);
+		}
+
+		for (size_t word = 0; word < baseline.present.size(); word++) {
+			auto removed = baseline.present[word] & ~baseline.seen[word];
+			if (removed == 0) {
+				continue;
+			}
+			for (int bit = 0; bit < 64; bit++) {
+				if ((removed >> bit) & 1) {
+					auto entity_id = static_cast<uint32_t>(word * 64 + bit);
+					WriteHeader(writer, baseline.entities[entity_id], true);
+					SetBit(baseline.present, entity_id, false);
+				}
+			}
+		}
+
+		writer.write(0, 1);
+	}
+};
+
+class ReplicationServer
+{
+private:
+	World& m_world;
+	std::vector<std::unique_ptr<IReplicationChannel>> m_channels;
+	std::vector<EntityBits> m_interest;
+
+public:
+	ReplicationServer(World& world) : m_world(world) {};
+
+	template <typename Component>
+	void Replicate() {
+		/* Adds a component to every packet. All components should be added before the first client. */
+		static_assert(Replicated<Component>::enabled, "Replicated<Component> has not been specialised.");
+
+		m_world.RegisterComponent<Component>();
+		m_channels.push_back(std::make_unique<ReplicationChannel<Component>>());
+		for (size_t i = 0; i < m_interest.size(); i++) {
+			m_channels.back()->add_client();
+		}
+	}
+
+	int AddClient() {
+		/* Returns the client's index, for SetInterest and Encode. The client starts interested in nothing. */
+		m_interest.push_back(MakeEntityBits());
+		for (auto& channel : m_channels) {
+			channel->add_client();
+		}
+		return static_cast<int>(m_interest.size()) - 1;
+	}
+
+	void SetInterest(const int client, const uint32_t entity, const bool interested = true) {
+		/* Interest is held by entity id, so it carries over to the next entity given the id. */
+		SetBit(m_interest.at(client), entity >> 16, interested);
+	}
+
+	void ClearInterest(const int client) {
+		auto& interest = m_interest.at(client);
+		std::fill(interest.begin(), interest.end(), 0);
+	}
+
+	inline bool IsInterested(const int client, const uint32_t entity) const {
+		return TestBit(m_interest.at(client), entity >> 16);
+	}
+
+	size_t Encode(const int client, std::vector<uint8_t>& packet) {
+		/* Encodes the changes since the client's last packet into packet, replacing its contents, and
+		*  returns the number of bytes. Reusing the same vector each tick avoids allocating.
+		*/
+		ECS_TRACE_SCOPE(m_world, "Replication::Encode");
+		packet.clear();
+		BitWriter writer(packet);
+		for (auto& channel : m_channels) {
+			channel->encode(m_world, client, m_interest.at(client), writer);
+		}
+		writer.flush();
+		return packet.size();
+	}
+};
+
+class ReplicationClient;
+
+struct IReplicaChannel
+{
+	virtual ~IReplicaChannel() {};
+	virtual void decode(ReplicationClient& client, BitReader& reader) = 0;
+	virtual void forget(const uint32_t entity_id) = 0;
+};
+
+class ReplicationClient
+{
+	/* Mirrors the server's entities in a World. Remote entities are given local entities as they arrive,
+	*  and the local entity is killed once a packet leaves it with no replicated components.
+	*/
+private:
+	template <typename Component>
+	friend class ReplicaChannel;
+
+	World& m_world;
+	std::vector<std::unique_ptr<IReplicaChannel>> m_channels;
+	std::vector<uint32_t> m_remote;
+	std::vector<uint32_t> m_local;
+	std::vector<uint8_t> m_num_components;
+	// entities which lost their last component during a Decode, killed at its end unless they gained another.
+	std::vector<uint32_t> m_orphans;
+
+	uint32_t Map(const uint32_t remote) {
+		/* Gets the local entity for the remote one, replacing the local entity if the remote id has been
+		*  recycled since.
+		*/
+		auto entity_id = remote >> 16;
+		if (m_remote[entity_id] != remote) {
+			Unmap(entity_id);
+			m_remote[entity_id] = remote;
+			m_local[entity_id] = m_world.CreateEntity();
+		}
+		return m_local[entity_id];
+	}
+
+	void Unmap(const uint32_t entity_id) {
+		if (m_remote[entity_id] == NULL_ENTITY) {
+			return;
+		}
+		for (auto& channel : m_channels) {
+			channel->forget(entity_id);
+		}
+		m_world.KillEntity(m_local[entity_id]);
+		m_remote[entity_id] = NULL_ENTITY;
+		m_local[entity_id] = NULL_ENTITY;
+		m_num_components[entity_id] = 0;
+	}
+
+public:
+	ReplicationClient(World& world) :
+		m_world(world),
+		m_remote(MAX_ENTITIES, NULL_ENTITY),
+		m_local(MAX_ENTITIES, NULL_ENTITY),
+		m_num_components(MAX_ENTITIES, 0) {};
+
+	template <typename Component>
+	void Replicate();
+
+	void Decode(const uint8_t* data, const size_t size) {
+		ECS_TRACE_SCOPE(m_world, "Replication::Decode");
+		BitReader reader(data, size);
+		for (auto& channel : m_channels) {
+			channel->decode(*this, reader);
+		}
+
+		for (auto entity_id : m_orphans) {
+			if (m_num_components[entity_id] == 0) {
+				Unmap(entity_id);
+			}
+		}
+		m_orphans.clear();
+	}
+
+	uint32_t GetLocalEntity(const uint32_t remote) const {
+		/* The local entity standing in for a server entity, NULL_ENTITY if it hasn't been replicated. */
+		auto entity_id = remote >> 16;
+		return m_remote.at(entity_id) == remote ? m_local[entity_id] : NULL_ENTITY;
+	}
+};
+
+template <typename Component>
+class ReplicaChannel : public IReplicaChannel
+{
+	/* The client side of one replicated component, holding the same baseline as the server. */
+private:
+	using Traits = Replicated<Component>;
+	using State = typename Traits::State;
+
+	std::vector<State> m_states;
+	EntityBits m_present;
+
+public:
+	ReplicaChannel() : m_states(MAX_ENTITIES), m_present(MakeEntityBits()) {};
+
+	virtual void forget(const uint32_t entity_id) override {
+		SetBit(m_present, entity_id, false);
+	}
+
+	virtual void decode(ReplicationClient& client, BitReader& reader) override {
+		auto& world = client.m_world;
+		while (reader.read(1)) {
+			auto entity_id = reader.read(ENTITY_ID_BITS);
+			auto version = reader.read(ENTITY_VERSION_BITS);
+			auto removed = reader.read(1);
+			if (entity_id >= static_cast<uint32_t>(MAX_ENTITIES)) {
+				throw std::runtime_error("Replication packet names an invalid entity.");
+			}
+			auto remote = MakeRemoteEntity(entity_id, version);
+
+			if (removed) {
+				// removals for an id which has since been recycled have already been dealt with.
+				if (client.m_remote[entity_id] != remote || !TestBit(m_present, entity_id)) {
+					continue;
+				}
+				auto local = client.m_local[entity_id];
+				world.template RemoveComponent<Component>(local);
+				SetBit(m_present, entity_id, false);
+				if (--client.m_num_components[entity_id] == 0) {
+					client.m_orphans.push_back(entity_id);
+				}
+				continue;
+			}
+
+			auto local = client.Map(remote);
+			auto present = TestBit(m_present, entity_id);
+			auto state = Traits::read(reader, present ? m_states[entity_id] : State{});
+			m_states[entity_id] = state;
+			if (!present) {
+				world.template AddComponent<Component>(local);
+				SetBit(m_present, entity_id, true);
+				client.m_num_components[entity_id]++;
+			}
+			world.template Patch<Component>(local, [&state](Component& component) { Traits::apply(state, component); });
+		}
+	}
+};
+
+template <typename Component>
+void ReplicationClient::Replicate() {
+	/* Must be called for the same components, in the same order, as on the server. */
+	static_assert(Replicated<Component>::enabled, "Replicated<Component> has not been specialised.");
+	m_world.RegisterComponent<Component>();
+	m_channels.push_back(std::make_unique<ReplicaChannel<Component>>());
+}
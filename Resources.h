@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <stdexcept>
+
+/*
+* Resources
+*
+* Singleton state which belongs to the World rather than to any entity - the camera, the input for
+* this frame, physics settings. Each resource type is given a process wide index the first time it is
+* used, and the World keeps a flat table of pointers by that index, so GetResource is a single load.
+*/
+
+const int MAX_RESOURCES{ 32 };
+
+inline int NextResourceID() {
+	static std::atomic<int> resource_counter{ 0 };
+	return resource_counter++;
+}
+
+template <typename Resource>
+int ResourceID() {
+	static const int resource_id = NextResourceID();
+
+	if (resource_id >= MAX_RESOURCES) {
+		throw std::runtime_error("Max number of resource types exceeded.");
+	}
+	return resource_id;
+}
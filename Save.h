@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include "Utils.hpp"
+
+/*
+* Background saves
+*
+* World::SaveAsync splits a save in two. On the calling thread it copies the entity table, and the
+* pool, sparse and packed arrays of each component being saved, into a SaveImage - a handful of bulk
+* copies. Then a background thread writes the image out in the same layout as Serialise followed by
+* Serialise<Component> for each component and SerialiseTimers, so the file is loaded with the usual
+* Deserialise calls.
+*
+* The file is written next to the destination and renamed over it once it is complete, so an
+* interrupted save leaves the previous one intact.
+*/
+
+struct SavedComponent
+{
+	uint16_t num_elements{ 0 };
+	size_t stride{ 0 };
+	// copies of the live components, destroyed along with the image.
+	std::shared_ptr<char> components;
+	std::vector<uint16_t> sparse;
+	std::vector<uint16_t> packed;
+	// a shared component's values, already written out, which go ahead of the section.
+	std::string values;
+	// writes the section in the layout of World::Serialise<Component>.
+	void (*write)(std::ostream& file, const SavedComponent& saved) { nullptr };
+};
+
+struct SaveImage
+{
+	uint16_t entity_counter{ 0 };
+	std::vector<uint32_t> free_entities;
+	std::vector<uint32_t> entities;
+	// the pending KillAfter timers, as the entity and the ticks it has left.
+	std::vector<std::pair<uint32_t, uint32_t>> timers;
+	std::vector<SavedComponent> components;
+};
+
+template <typename Component>
+void WriteSavedComponent(std::ostream& file, const SavedComponent& saved) {
+	file.write(saved.values.data(), saved.values.size());
+	utils::serialiseUint32(file, static_cast<uint32_t>(saved.num_elements));
+	// tags are saved without components, only their count.
+	if (saved.components != nullptr) {
+		for (uint16_t i = 0; i < saved.num_elements; i++) {
+			auto* component = reinterpret_cast<Component*>(saved.components.get() + i * saved.stride);
+			component->serialise(file);
+		}
+	}
+
+	for (auto entity_id : saved.sparse) {
+		utils::serialiseUint32(file, static_cast<uint32_t>(entity_id));
+	}
+	utils::serialiseUint32(file, static_cast<uint32_t>(saved.packed.size()));
+	for (auto entity_id : saved.packed) {
+		utils::serialiseUint32(file, static_cast<uint32_t>(entity_id));
+	}
+}
+
+inline void WriteSaveImage(const SaveImage& image, const std::string& path) {
+	auto temporary_path = path + ".tmp";
+	{
+		std::ofstream file(temporary_path, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("Could not open the save file.");
+		}
+
+		utils::serialiseUint32(file, static_cast<uint32_t>(image.entity_counter));
+		utils::serialiseUint32(file, static_cast<uint32_t>(image.free_entities.size()));
+		for (auto entity : image.free_entities) {
+			utils::serialiseUint32(file, entity);
+		}
+		for (auto entity : image.entities) {
+			utils::serialiseUint32(file, entity);
+		}
+
+		for (auto& saved : image.components) {
+			saved.write(file, saved);
+		}
+
+		utils::serialiseUint32(file, static_cast<uint32_t>(image.timers.size()));
+		for (auto& timer : image.timers) {
+			utils::serialiseUint32(file, timer.first);
+			utils::serialiseUint32(file, timer.second);
+		}
+
+		file.flush();
+		if (!file) {
+			throw std::runtime_error("Could not write the save file.");
+		}
+	}
+
+	// rename won't replace an existing file everywhere, so the old save goes first.
+	std::remove(path.c_str());
+	if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+		throw std::runtime_error("Could not replace the save file.");
+	}
+}
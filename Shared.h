@@ -0,0 +1,345 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+
+#include "Utils.hpp"
+#include "Components.h"
+#include "Signals.h"
+#include "Hierarchy.h"
+
+/*
+* Shared components
+*
+* A component which is identical across many entities - the mesh they are drawn with, say - can be
+* stored once and shared. World::AddShared interns the value in a per-World SharedStore and gives the
+* entity a small SharedRef<Component> pointing at it. Equal values are stored once, and each value
+* keeps the list of entities which share it, which doubles as its reference count - the value is
+* freed when the last entity lets go of it.
+*
+* Shared values are immutable in place. World::PatchShared copies the value, modifies the copy and
+* re-interns it, so the other entities sharing the old value are unaffected (copy-on-write).
+* World::ForEachShared visits each distinct value with the entities which share it, which gives a
+* renderer its batches without sorting.
+*
+* The SharedRefs are rolled back by World::Restore like any other component, so the values they
+* point at have to outlive the snapshots. A value whose last entity lets go of it while snapshots are
+* held is kept, unreferenced, until every snapshot taken before that is gone, and after a restore each
+* value's entity list is rebuilt from the restored SharedRefs.
+*
+* Saves deduplicate too: World::Serialise<SharedRef<Component>> (and SaveAsync and SaveChunked) write
+* the store's values once, ahead of the refs, and each ref as the handle of its value. A Prefab takes
+* a shared value through WithShared.
+*
+* Specialise SharedValue<Component> to say how values are hashed and compared:
+*
+*	template <>
+*	struct SharedValue<Material>
+*	{
+*		static constexpr bool enabled{ true };
+*		static size_t hash(const Material& material) { return std::hash<uint32_t>{}(material.shader); };
+*		static bool equal(const Material& a, const Material& b) { return a.shader == b.shader; };
+*	};
+*
+* The store saves each value with the component's own serialise and deserialise, unless the
+* specialisation has static serialise(std::ostream&, const Component&) and deserialise(const char*,
+* size_t&, Component&) functions, which it then uses instead. That lets a component whose own layout
+* can't change, like MeshRenderer, have its shared values saved in full.
+*/
+
+template <typename Component>
+struct SharedValue
+{
+	static constexpr bool enabled{ false };
+};
+
+template <>
+struct SharedValue<MeshRenderer>
+{
+	static constexpr bool enabled{ true };
+	static size_t hash(const MeshRenderer& renderer) { return std::hash<unsigned int>{}(renderer.id); };
+	static bool equal(const MeshRenderer& a, const MeshRenderer& b) { return a.id == b.id; };
+	// MeshRenderer::serialise writes nothing, to keep the layout of older saves.
+	static void serialise(std::ostream& file, const MeshRenderer& renderer) { utils::serialiseUint32(file, renderer.id); };
+	static void deserialise(const char* buffer, size_t& offset, MeshRenderer& renderer) { renderer.id = utils::deserialiseUint32(buffer, offset); };
+};
+
+struct ISharedStore
+{
+	// rebuilds the entity lists from the World's SharedRefs, set by World::SharedStoreOf.
+	void (World::*relink)() { nullptr };
+
+	virtual ~ISharedStore() {};
+	// frees the kept values released before the snapshot oldest was taken.
+	virtual void collect(const uint32_t oldest) = 0;
+};
+
+template <typename Component>
+class SharedStore;
+
+template <typename Component>
+struct SharedRef
+{
+	using value_type = Component;
+
+	// the store holding the value, so that an entity moved to another World can bring its value along.
+	SharedStore<Component>* store{ nullptr };
+	uint32_t handle{ 0 };
+	// where the entity sits in the value's entity list.
+	uint32_t slot{ 0 };
+
+	// only the handle is saved, the World links the ref back up to its store once it is loaded.
+	void serialise(std::ostream& file) const {
+		utils::serialiseUint32(file, handle);
+	}
+
+	void deserialise(const char* buffer, size_t& offset) {
+		store = nullptr;
+		handle = utils::deserialiseUint32(buffer, offset);
+		slot = 0;
+	}
+};
+
+template <typename Component>
+struct is_shared_ref : std::false_type {};
+
+template <typename Component>
+struct is_shared_ref<SharedRef<Component>> : std::true_type {};
+
+template <typename Component>
+constexpr bool is_shared_ref_v = is_shared_ref<Component>::value;
+
+template <typename Component>
+class SharedStore : public ISharedStore
+{
+private:
+	using Traits = SharedValue<Component>;
+
+	struct Entry
+	{
+		std::optional<Component> value;
+		size_t hash{ 0 };
+		std::vector<uint32_t> entities;
+		// the newest snapshot when the value was last let go of, while it is kept for the snapshots 
+		// (snapshot handles start at 1).
+		uint32_t kept_for{ 0 };
+	};
+
+	std::vector<Entry> m_entries;
+	std::vector<uint32_t> m_free;
+	std::vector<uint32_t> m_kept;
+	std::unordered_multimap<size_t, uint32_t> m_index;
+	size_t m_num_values{ 0 };
+
+	void release(const uint32_t handle) {
+		auto& entry = m_entries[handle];
+		auto range = m_index.equal_range(entry.hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == handle) {
+				m_index.erase(it);
+				break;
+			}
+		}
+		entry.value.reset();
+		entry.kept_for = 0;
+		m_free.push_back(handle);
+	}
+
+public:
+	uint32_t intern(const Component& value) {
+		/* Returns the handle of a stored value equal to value, storing it first if there is none. A new
+		*  value has no entities until add is called. A kept value is taken back into use.
+		*/
+		auto hash = Traits::hash(value);
+		auto range = m_index.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (Traits::equal(*m_entries[it->second].value, value)) {
+				return it->second;
+			}
+		}
+
+		uint32_t handle;
+		if (!m_free.empty()) {
+			handle = m_free.back();
+			m_free.pop_back();
+		}
+		else {
+			handle = static_cast<uint32_t>(m_entries.size());
+			m_entries.emplace_back();
+		}
+		m_entries[handle].value.emplace(value);
+		m_entries[handle].hash = hash;
+		m_index.emplace(hash, handle);
+		return handle;
+	}
+
+	uint32_t add(const uint32_t handle, const uint32_t entity) {
+		/* Adds entity to the value's entities and returns its slot. */
+		auto& entities = m_entries[handle].entities;
+		if (entities.empty()) {
+			m_num_values++;
+		}
+		entities.push_back(entity);
+		return static_cast<uint32_t>(entities.size() - 1);
+	}
+
+	uint32_t remove(const uint32_t handle, const uint32_t slot, const uint32_t newest_snapshot = 0) {
+		/* Removes the entity in slot by swap-and-pop and returns the entity which was moved into the slot
+		*  (NULL_ENTITY if none), whose SharedRef needs the new slot. Frees the value once no entity
+		*  shares it, unless snapshots are held (newest_snapshot isn't 0), in which case it is kept 
+		*  until collect finds them gone.
+		*/
+		auto& entry = m_entries[handle];
+		auto moved = NULL_ENTITY;
+		if (slot + 1 < entry.entities.size()) {
+			moved = entry.entities.back();
+			entry.entities[slot] = moved;
+		}
+		entry.entities.pop_back();
+
+		if (entry.entities.empty()) {
+			m_num_values--;
+			if (newest_snapshot == 0) {
+				release(handle);
+			}
+			else {
+				if (entry.kept_for == 0) {
+					m_kept.push_back(handle);
+				}
+				entry.kept_for = newest_snapshot;
+			}
+		}
+		return moved;
+	}
+
+	void collect(const uint32_t oldest) override {
+		/* Snapshot handles only grow, so a value let go of at or after oldest was taken may still be 
+		*  referenced by it. Pass UINT32_MAX once no snapshots are held.
+		*/
+		size_t kept{ 0 };
+		for (auto handle : m_kept) {
+			auto& entry = m_entries[handle];
+			if (!entry.entities.empty()) {
+				// taken back into use.
+				entry.kept_for = 0;
+				continue;
+			}
+			if (entry.kept_for < oldest) {
+				release(handle);
+			}
+			else {
+				m_kept[kept++] = handle;
+			}
+		}
+		m_kept.resize(kept);
+	}
+
+	void unlink_all(const uint32_t newest_snapshot) {
+		/* Empties every value's entity list for the World to refill from its SharedRefs after a restore.
+		*  Whichever values are left without entities are kept as if let go of now.
+		*/
+		m_kept.clear();
+		for (uint32_t handle = 0; handle < m_entries.size(); handle++) {
+			auto& entry = m_entries[handle];
+			if (entry.value) {
+				entry.entities.clear();
+				entry.kept_for = newest_snapshot;
+				m_kept.push_back(handle);
+			}
+		}
+		m_num_values = 0;
+	}
+
+	inline bool holds(const uint32_t handle) const {
+		return handle < m_entries.size() && m_entries[handle].value.has_value();
+	}
+
+	void serialise(std::ostream& file) {
+		/* Writes the value of every handle which has entities, so that saved handles can index them. */
+		utils::serialiseUint32(file, static_cast<uint32_t>(m_entries.size()));
+		for (auto& entry : m_entries) {
+			auto saved = !entry.entities.empty();
+			utils::serialiseUint8(file, saved);
+			if (saved) {
+				if constexpr (requires { Traits::serialise(file, *entry.value); }) {
+					Traits::serialise(file, *entry.value);
+				}
+				else {
+					entry.value->serialise(file);
+				}
+			}
+		}
+	}
+
+	void deserialise(const char* buffer, size_t& offset, const size_t size = SIZE_MAX) {
+		/* Replaces the store's values with those written by serialise. The values have no entities 
+		*  until the World relinks its SharedRefs to them. size is the length of buffer, if it is known, 
+		*  and nothing past it is read.
+		*/
+		utils::ReadLimit limit(size);
+		auto num_entries = utils::deserialiseUint32(buffer, offset);
+		if (num_entries > (size - std::min(offset, size)) / utils::advance(1)) {
+			throw std::runtime_error("Save file is corrupt.");
+		}
+
+		m_entries.clear();
+		m_entries.resize(num_entries);
+		m_free.clear();
+		m_kept.clear();
+		m_index.clear();
+		m_num_values = 0;
+		for (uint32_t handle = 0; handle < num_entries; handle++) {
+			if (!utils::deserialiseUint8(buffer, offset)) {
+				m_free.push_back(handle);
+				continue;
+			}
+			auto& entry = m_entries[handle];
+			entry.value.emplace();
+			if constexpr (requires { Traits::deserialise(buffer, offset, *entry.value); }) {
+				Traits::deserialise(buffer, offset, *entry.value);
+			}
+			else {
+				entry.value->deserialise(buffer, offset);
+			}
+			entry.hash = Traits::hash(*entry.value);
+			m_index.emplace(entry.hash, handle);
+		}
+	}
+
+	inline const Component& value(const uint32_t handle) const {
+		return *m_entries[handle].value;
+	}
+
+	inline size_t references(const uint32_t handle) const {
+		return m_entries[handle].entities.size();
+	}
+
+	inline size_t size() const {
+		/* The number of distinct values stored. */
+		return m_num_values;
+	}
+
+	template <typename Function>
+	void for_each(Function function) const {
+		for (auto& entry : m_entries) {
+			if (!entry.entities.empty()) {
+				function(*entry.value, static_cast<const std::vector<uint32_t>&>(entry.entities));
+			}
+		}
+	}
+};
+
+template <typename Component>
+struct Signals<SharedRef<Component>> : Listeners<SharedRef<Component>>
+{
+	// adopts a value arriving from another World, defined after World.
+	static void on_construct(World& world, const uint32_t entity, SharedRef<Component>& ref);
+	// lets go of the value, defined after World.
+	static void on_destroy(World& world, const uint32_t entity, SharedRef<Component>& ref);
+};
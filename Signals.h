@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <algorithm>
+
+class World;
+
+/*
+* Component lifecycle signals.
+*
+* Listeners can be attached to a component type in two ways:
+*
+*	- at compile time, by specialising Signals<Component> (usually by deriving from Listeners<Component>).
+*	  These are called directly from the templated World methods, so a component without a
+*	  specialisation generates no dispatch code at all.
+*	- at run time, by connecting a callback to one of the per-component sinks held by the World.
+*	  An unused sink costs a single empty() check.
+*/
+
+template <typename Component>
+struct Signals
+{
+	static constexpr bool enabled{ false };
+};
+
+template <typename Component>
+struct Listeners
+{
+	/* Convenience base for Signals<Component> specialisations, only the hooks of interest need to be hidden. */
+	static constexpr bool enabled{ true };
+
+	static void on_construct(World&, const uint32_t, Component&) {};
+	static void on_update(World&, const uint32_t, Component&) {};
+	static void on_destroy(World&, const uint32_t, Component&) {};
+};
+
+using SignalCallback = std::function<void(World&, const uint32_t, void*)>;
+
+struct Sink
+{
+	std::vector<std::pair<int, SignalCallback>> listeners;
+
+	inline bool empty() const {
+		return listeners.empty();
+	};
+
+	void connect(const int connection, SignalCallback callback) {
+		listeners.emplace_back(connection, std::move(callback));
+	}
+
+	void disconnect(const int connection) {
+		listeners.erase(std::remove_if(listeners.begin(), listeners.end(),
+			[connection](const std::pair<int, SignalCallback>& listener) { return listener.first == connection; }),
+			listeners.end());
+	}
+
+	void publish(World& world, const uint32_t entity, void* component) const {
+		for (auto& listener : listeners) {
+			listener.second(world, entity, component);
+		}
+	}
+};
+
+struct ComponentSignals
+{
+	Sink on_construct;
+	Sink on_update;
+	Sink on_destroy;
+
+	// compile time listeners have to be reached from the type-erased paths (KillEntity, MoveEntity),
+	// so they are bound to function pointers when the component is registered. nullptr if there are none.
+	void (*static_construct)(World&, const uint32_t, void*) { nullptr };
+	void (*static_destroy)(World&, const uint32_t, void*) { nullptr };
+
+	// a runtime component's functions, as given when it was registered with this World (see RuntimeComponent).
+	bool runtime{ false };
+	void (*construct)(void*, void*) { nullptr };
+	void (*destroy)(void*, void*) { nullptr };
+	void* context{ nullptr };
+
+	int connection_counter{ 0 };
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <memory_resource>
+
+#include "Registry.h"
+
+/*
+* Snapshots
+*
+* World::Snapshot doesn't copy the World. It records how long each of the World's arrays is, and
+* from then on the first write to each SNAPSHOT_CHUNK_BYTES chunk of an array saves that chunk's
+* previous contents (its pre-image) into the snapshot's log. World::Restore puts the pre-images
+* back, from the newest snapshot back to the one being restored. A restore therefore costs time in
+* proportion to the chunks dirtied since the snapshot, not to the size of the World.
+*
+* The arrays tracked (regions) are each component's pool, sparse array and packed array, the entity
+* table, the free list, the hierarchy order, the disabled flags and the KillAfter timer wheel. The last few snapshots are kept in a ring, and the
+* oldest is dropped when a new one is taken on a full ring. Shared values aren't copied - the stores
+* keep the values the snapshots may point at (see Shared.h).
+*/
+
+const size_t SNAPSHOT_CHUNK_BYTES{ 4096 };
+const size_t DEFAULT_SNAPSHOT_RING{ 8 };
+
+const int ENTITY_REGION{ 3 * MAX_COMPONENTS };
+const int FREE_LIST_REGION{ 3 * MAX_COMPONENTS + 1 };
+const int HIERARCHY_REGION{ 3 * MAX_COMPONENTS + 2 };
+const int DISABLED_REGION{ 3 * MAX_COMPONENTS + 3 };
+const int TIMER_NODE_REGION{ 3 * MAX_COMPONENTS + 4 };
+const int TIMER_HEAD_REGION{ 3 * MAX_COMPONENTS + 5 };
+const int NUM_SNAPSHOT_REGIONS{ 3 * MAX_COMPONENTS + 6 };
+
+inline int PoolRegion(const int component_id) {
+	return component_id;
+}
+
+inline int SparseRegion(const int component_id) {
+	return MAX_COMPONENTS + component_id;
+}
+
+inline int PackedRegion(const int component_id) {
+	return 2 * MAX_COMPONENTS + component_id;
+}
+
+struct ChunkImage
+{
+	int region;
+	size_t begin;
+	size_t bytes;
+	// where the pre-image starts in the snapshot's byte log.
+	size_t offset;
+};
+
+struct SnapshotImage
+{
+	uint32_t handle{ 0 };
+	uint32_t epoch{ 0 };
+
+	// the state of the World when the snapshot was taken.
+	std::array<size_t, NUM_SNAPSHOT_REGIONS> lengths{};
+	std::array<uint16_t, MAX_COMPONENTS> num_elements{};
+	std::array<uint16_t, MAX_COMPONENTS> num_active{};
+	uint16_t entity_counter{ 0 };
+	size_t hierarchy_tombstones{ 0 };
+	uint32_t timer_now{ 0 };
+	size_t num_timers{ 0 };
+
+	// pre-images of the chunks written between this snapshot and the next.
+	std::pmr::vector<ChunkImage> chunks;
+	std::pmr::vector<char> log;
+
+	SnapshotImage(std::pmr::memory_resource* resource) : chunks(resource), log(resource) {};
+};
+
+class SnapshotLog
+{
+private:
+	std::pmr::memory_resource* m_resource;
+	std::vector<SnapshotImage> m_ring;
+	size_t m_first{ 0 };
+	size_t m_count{ 0 };
+	uint32_t m_next_handle{ 1 };
+	uint32_t m_next_epoch{ 1 };
+	// the epoch in which each chunk of each region was last saved.
+	std::vector<std::pmr::vector<uint32_t>> m_chunk_epochs;
+
+public:
+	SnapshotLog(std::pmr::memory_resource* resource, const size_t ring_size = DEFAULT_SNAPSHOT_RING) : m_resource(resource) {
+		m_ring.reserve(ring_size);
+		for (size_t i = 0; i < ring_size; i++) {
+			m_ring.emplace_back(resource);
+		}
+		m_chunk_epochs.reserve(NUM_SNAPSHOT_REGIONS);
+		for (int i = 0; i < NUM_SNAPSHOT_REGIONS; i++) {
+			m_chunk_epochs.emplace_back(resource);
+		}
+	};
+
+	inline bool tracking() const {
+		return m_count > 0;
+	}
+
+	inline size_t size() const {
+		return m_count;
+	}
+
+	inline uint32_t oldest() const {
+		/* The handle of the oldest snapshot held, UINT32_MAX if there are none. */
+		return m_count > 0 ? m_ring[m_first].handle : UINT32_MAX;
+	}
+
+	inline uint32_t newest() const {
+		/* The handle of the newest snapshot held, 0 if there are none. */
+		return m_count > 0 ? m_ring[(m_first + m_count - 1) % m_ring.size()].handle : 0;
+	}
+
+	inline SnapshotImage& at(const size_t position) {
+		/* position 0 is the oldest snapshot held. */
+		return m_ring[(m_first + position) % m_ring.size()];
+	}
+
+	SnapshotImage& begin_snapshot() {
+		/* Starts a new snapshot, dropping the oldest if the ring is full. The caller records the
+		*  World's state in the returned image.
+		*/
+		if (m_count == m_ring.size()) {
+			m_first = (m_first + 1) % m_ring.size();
+			m_count--;
+		}
+		m_count++;
+
+		auto& image = at(m_count - 1);
+		image.handle = m_next_handle++;
+		image.epoch = m_next_epoch++;
+		image.chunks.clear();
+		image.log.clear();
+		return image;
+	}
+
+	int find(const uint32_t handle) {
+		for (size_t i = 0; i < m_count; i++) {
+			if (at(i).handle == handle) {
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+
+	void rewind_to(const size_t position) {
+		/* Drops every snapshot after position and empties its log, once the World has been restored
+		*  to it. A fresh epoch means no chunk counts as saved any more.
+		*/
+		m_count = position + 1;
+		auto& image = at(position);
+		image.epoch = m_next_epoch++;
+		image.chunks.clear();
+		image.log.clear();
+	}
+
+	void clear() {
+		m_count = 0;
+	}
+
+	void track(const int region, const void* base, const size_t begin, const size_t bytes) {
+		/* Called before bytes at begin in region are written (or dropped). Saves the pre-image of every
+		*  chunk in that range which hasn't been saved since the newest snapshot. Nothing past the
+		*  region's length at the time of the snapshot needs saving - a restore cuts it off.
+		*/
+		auto& image = at(m_count - 1);
+		auto length = image.lengths[region];
+		if (begin >= length || bytes == 0) {
+			return;
+		}
+		auto end = std::min(begin + bytes, length);
+
+		auto& epochs = m_chunk_epochs[region];
+		auto last_chunk = (end - 1) / SNAPSHOT_CHUNK_BYTES;
+		if (epochs.size() <= last_chunk) {
+			epochs.resize(last_chunk + 1, 0);
+		}
+
+		for (auto chunk = begin / SNAPSHOT_CHUNK_BYTES; chunk <= last_chunk; chunk++) {
+			if (epochs[chunk] == image.epoch) {
+				continue;
+			}
+			epochs[chunk] = image.epoch;
+
+			auto chunk_begin = chunk * SNAPSHOT_CHUNK_BYTES;
+			auto chunk_bytes = std::min(SNAPSHOT_CHUNK_BYTES, length - chunk_begin);
+			auto offset = image.log.size();
+			image.log.resize(offset + chunk_bytes);
+			std::memcpy(image.log.data() + offset, static_cast<const char*>(base) + chunk_begin, chunk_bytes);
+			image.chunks.push_back({ region, chunk_begin, chunk_bytes, offset });
+		}
+	}
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <bitset>
+#include <type_traits>
+
+#include "Registry.h"
+#include "Resources.h"
+
+/*
+* What a system reads and writes, for deciding which systems can run at the same time. Two systems
+* conflict if either writes a component or resource the other reads or writes.
+*
+*	auto physics = SystemAccess().Read<RigidBody>().Write<Position>().ReadResource<PhysicsSettings>();
+*	auto render = SystemAccess().Read<Position, MeshRenderer>().ReadResource<Camera>();
+*	physics.ConflictsWith(render); // true, physics writes Position
+*/
+
+struct SystemAccess
+{
+	std::bitset<MAX_COMPONENTS> reads;
+	std::bitset<MAX_COMPONENTS> writes;
+	std::bitset<MAX_RESOURCES> resource_reads;
+	std::bitset<MAX_RESOURCES> resource_writes;
+
+	template <typename... Components>
+	SystemAccess& Read() {
+		(reads.set(ComponentRegistry::GetID<std::remove_const_t<Components>>()), ...);
+		return *this;
+	}
+
+	template <typename... Components>
+	SystemAccess& Write() {
+		(writes.set(ComponentRegistry::GetID<std::remove_const_t<Components>>()), ...);
+		return *this;
+	}
+
+	template <typename... Resources>
+	SystemAccess& ReadResource() {
+		(resource_reads.set(ResourceID<std::remove_const_t<Resources>>()), ...);
+		return *this;
+	}
+
+	template <typename... Resources>
+	SystemAccess& WriteResource() {
+		(resource_writes.set(ResourceID<std::remove_const_t<Resources>>()), ...);
+		return *this;
+	}
+
+	bool ConflictsWith(const SystemAccess& other) const {
+		return (writes & (other.reads | other.writes)).any() || (other.writes & reads).any() ||
+			(resource_writes & (other.resource_reads | other.resource_writes)).any() || (other.resource_writes & resource_reads).any();
+	}
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+#include <memory_resource>
+
+#include "Snapshot.h"
+
+/*
+* Timer wheel
+*
+* World::KillAfter schedules an entity to be killed a number of ticks (EndFrame calls) from now. The
+* timers are kept in a hierarchical timer wheel: TIMER_WHEEL_LEVELS wheels of TIMER_WHEEL_SLOTS
+* slots, where a slot of level k covers TIMER_WHEEL_SLOTS^k ticks. A timer goes into the lowest level
+* whose range reaches its deadline. Each tick the wheel steps one slot of level 0 and takes every
+* timer in it as expired. Whenever a level wraps, the next slot of the level above is emptied into
+* the levels below, so each timer is moved at most once per level - O(1) amortised - and nothing
+* looks at timers which aren't due.
+*
+* Each slot is a doubly linked list threaded through an array of nodes indexed by entity id, so
+* scheduling, rescheduling and cancelling are O(1) and need no allocation once the nodes exist.
+* Deadlines beyond the top level are parked in its furthest slot and carried forward.
+*
+* The nodes and the slot heads are tracked for the World's snapshots like the rest of its storage, so
+* a restore puts the wheel back exactly as it was and the same entities expire on the same ticks.
+*/
+
+const int TIMER_WHEEL_BITS{ 6 };
+const uint32_t TIMER_WHEEL_SLOTS{ 1u << TIMER_WHEEL_BITS };
+const int TIMER_WHEEL_LEVELS{ 4 };
+const uint16_t NO_TIMER{ UINT16_MAX };
+
+struct TimerNode
+{
+	uint32_t entity{ 0 };
+	uint32_t deadline{ 0 };
+	uint16_t next{ NO_TIMER };
+	uint16_t prev{ NO_TIMER };
+	// the index of the slot it is in, NO_TIMER if it isn't scheduled.
+	uint16_t slot{ NO_TIMER };
+};
+
+class TimerWheel
+{
+private:
+	std::pmr::vector<TimerNode> m_nodes;
+	std::array<uint16_t, TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS> m_heads;
+	std::pmr::vector<uint32_t> m_expired;
+	uint32_t m_now{ 0 };
+	size_t m_num_timers{ 0 };
+	size_t m_max_entities{ 0 };
+	SnapshotLog& m_snapshot_log;
+
+	inline void track_node(const uint16_t id) {
+		/* Called before a node is written, see World::TrackSlots. */
+		if (m_snapshot_log.tracking()) {
+			m_snapshot_log.track(TIMER_NODE_REGION, m_nodes.data(), id * sizeof(TimerNode), sizeof(TimerNode));
+		}
+	}
+
+	inline void track_head(const uint16_t slot) {
+		if (m_snapshot_log.tracking()) {
+			m_snapshot_log.track(TIMER_HEAD_REGION, m_heads.data(), slot * sizeof(uint16_t), sizeof(uint16_t));
+		}
+	}
+
+	void link(const uint16_t id, const uint16_t slot) {
+		auto& node = m_nodes[id];
+		track_node(id);
+		node.slot = slot;
+		node.prev = NO_TIMER;
+		node.next = m_heads[slot];
+		if (node.next != NO_TIMER) {
+			track_node(node.next);
+			m_nodes[node.next].prev = id;
+		}
+		track_head(slot);
+		m_heads[slot] = id;
+	}
+
+	void unlink(const uint16_t id) {
+		auto& node = m_nodes[id];
+		if (node.prev != NO_TIMER) {
+			track_node(node.prev);
+			m_nodes[node.prev].next = node.next;
+		}
+		else {
+			track_head(node.slot);
+			m_heads[node.slot] = node.next;
+		}
+		if (node.next != NO_TIMER) {
+			track_node(node.next);
+			m_nodes[node.next].prev = node.prev;
+		}
+		track_node(id);
+		node.slot = NO_TIMER;
+	}
+
+	void place(const uint16_t id) {
+		/* Puts the node in the lowest level which reaches its deadline. */
+		auto delta = m_nodes[id].deadline - m_now;
+		for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+			auto shift = TIMER_WHEEL_BITS * level;
+			if (level == TIMER_WHEEL_LEVELS - 1 || delta < (TIMER_WHEEL_SLOTS << shift)) {
+				// too far out for the top level - park it in the furthest slot, it is placed again from there.
+				auto deadline = delta < (TIMER_WHEEL_SLOTS << shift) ? m_nodes[id].deadline : m_now + (TIMER_WHEEL_SLOTS << shift) - 1;
+				auto slot = (deadline >> shift) & (TIMER_WHEEL_SLOTS - 1);
+				link(id, static_cast<uint16_t>(level * TIMER_WHEEL_SLOTS + slot));
+				return;
+			}
+		}
+	}
+
+	void cascade(const int level) {
+		/* Empties the current slot of level into the levels below. */
+		auto slot = static_cast<uint16_t>(level * TIMER_WHEEL_SLOTS + ((m_now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)));
+		auto id = m_heads[slot];
+		track_head(slot);
+		m_heads[slot] = NO_TIMER;
+		while (id != NO_TIMER) {
+			auto next = m_nodes[id].next;
+			place(id);
+			id = next;
+		}
+	}
+
+public:
+	TimerWheel(std::pmr::memory_resource* resource, const size_t max_entities, SnapshotLog& snapshot_log) :
+		m_nodes(resource), m_expired(resource), m_max_entities(max_entities), m_snapshot_log(snapshot_log) {
+		m_heads.fill(NO_TIMER);
+	};
+
+	void schedule(const uint16_t id, const uint32_t entity, const uint32_t ticks) {
+		/* Expires entity in ticks ticks (at least one), replacing any timer it already has. The nodes
+		*  are only allocated by the first call.
+		*/
+		if (m_nodes.empty()) {
+			m_nodes.resize(m_max_entities);
+		}
+		cancel(id);
+		track_node(id);
+		m_nodes[id].entity = entity;
+		m_nodes[id].deadline = m_now + (ticks > 0 ? ticks : 1);
+		place(id);
+		m_num_timers++;
+	}
+
+	void cancel(const uint16_t id) {
+		if (id < m_nodes.size() && m_nodes[id].slot != NO_TIMER) {
+			unlink(id);
+			m_num_timers--;
+		}
+	}
+
+	inline bool scheduled(const uint16_t id) const {
+		return id < m_nodes.size() && m_nodes[id].slot != NO_TIMER;
+	}
+
+	inline uint32_t remaining(const uint16_t id) const {
+		/* The number of ticks until the timer expires, 0 if there is none. */
+		return scheduled(id) ? m_nodes[id].deadline - m_now : 0;
+	}
+
+	inline size_t size() const {
+		return m_num_timers;
+	}
+
+	const std::pmr::vector<uint32_t>& advance() {
+		/* Steps the wheel by one tick and returns the entities whose timers expired, valid until the
+		*  next call. Higher levels are emptied first, so that their timers can land in a slot which is
+		*  emptied in the same tick.
+		*/
+		m_now++;
+		m_expired.clear();
+		if (m_num_timers == 0) {
+			return m_expired;
+		}
+
+		int wrapped{ 0 };
+		while (wrapped + 1 < TIMER_WHEEL_LEVELS && (m_now & ((1u << (TIMER_WHEEL_BITS * (wrapped + 1))) - 1)) == 0) {
+			wrapped++;
+		}
+		for (int level = wrapped; level > 0; level--) {
+			cascade(level);
+		}
+
+		auto slot = static_cast<uint16_t>(m_now & (TIMER_WHEEL_SLOTS - 1));
+		auto id = m_heads[slot];
+		track_head(slot);
+		m_heads[slot] = NO_TIMER;
+		while (id != NO_TIMER) {
+			auto& node = m_nodes[id];
+			m_expired.push_back(node.entity);
+			track_node(id);
+			node.slot = NO_TIMER;
+			id = node.next;
+		}
+		m_num_timers -= m_expired.size();
+		return m_expired;
+	}
+
+	void clear() {
+		if (m_snapshot_log.tracking()) {
+			m_snapshot_log.track(TIMER_NODE_REGION, m_nodes.data(), 0, m_nodes.size() * sizeof(TimerNode));
+			m_snapshot_log.track(TIMER_HEAD_REGION, m_heads.data(), 0, sizeof(m_heads));
+		}
+		for (auto& node : m_nodes) {
+			node.slot = NO_TIMER;
+		}
+		m_heads.fill(NO_TIMER);
+		m_num_timers = 0;
+	}
+
+	template <typename Function>
+	void for_each(Function function) const {
+		/* Calls function(id, entity, remaining ticks) for every timer, in id order. */
+		for (size_t id = 0; id < m_nodes.size(); id++) {
+			auto& node = m_nodes[id];
+			if (node.slot != NO_TIMER) {
+				function(static_cast<uint16_t>(id), node.entity, node.deadline - m_now);
+			}
+		}
+	}
+
+	void snapshot(SnapshotImage& image) const {
+		/* Records the wheel's state in a new snapshot. */
+		image.lengths[TIMER_NODE_REGION] = m_nodes.size() * sizeof(TimerNode);
+		image.lengths[TIMER_HEAD_REGION] = sizeof(m_heads);
+		image.timer_now = m_now;
+		image.num_timers = m_num_timers;
+	}
+
+	void resize(const SnapshotImage& image) {
+		/* Sets the node array to its length when image was taken, ahead of its chunks being put back. */
+		m_nodes.resize(image.lengths[TIMER_NODE_REGION] / sizeof(TimerNode));
+	}
+
+	void restore(const SnapshotImage& image) {
+		/* Puts back the clock and count, once the nodes and heads have been. */
+		m_now = image.timer_now;
+		m_num_timers = image.num_timers;
+	}
+
+	char* region_data(const int region) {
+		return region == TIMER_NODE_REGION ? reinterpret_cast<char*>(m_nodes.data()) : reinterpret_cast<char*>(m_heads.data());
+	}
+};
@@ -1,52 +1,73 @@
-
-#pragma once
+#include <stdexcept>
 
 #include "Utils.hpp"
 
 namespace utils {
-    void serialiseUint8(std::ofstream& file, uint8_t x)
+    // the end set by the ReadLimits alive on this thread, or no limit.
+    thread_local size_t read_limit{ SIZE_MAX };
+
+    ReadLimit::ReadLimit(size_t end) : m_previous(read_limit)
+    {
+        // a limit inside another can only narrow it.
+        read_limit = end < read_limit ? end : read_limit;
+    }
+
+    ReadLimit::~ReadLimit()
+    {
+        read_limit = m_previous;
+    }
+
+    static void checkRead(size_t offset, size_t num_bytes)
+    {
+        if (num_bytes > read_limit || offset > read_limit - num_bytes) {
+            throw std::runtime_error("Save file is corrupt.");
+        }
+    }
+
+    void serialiseBytes(std::ostream& file, const uint8_t* bytes, size_t num_bytes)
     {
-        file.write(reinterpret_cast<char*>(&x), sizeof(reinterpret_cast<char*>(&x)));
+        /* Every byte of a value takes up utils::advance(1) bytes in the file - the value's bytes,
+        *  most significant first, are followed by zeros to fill out the space.
+        */
+        static const char padding[64]{};
+        file.write(reinterpret_cast<const char*>(bytes), num_bytes);
+        file.write(padding, utils::advance(num_bytes) - num_bytes);
     }
 
-    void serialiseUint16(std::ofstream& file, uint16_t x)
+    void serialiseUint8(std::ostream& file, uint8_t x)
+    {
+        serialiseBytes(file, &x, 1);
+    }
+
+    void serialiseUint16(std::ostream& file, uint16_t x)
     {
         uint8_t bytes[2];
         for (int i = 0; i < 2; i++) {
             bytes[i] = (x >> (1 - i) * 8) & 0xFF;
         }
-
-        for (int i = 0; i < 2; ++i) {
-            file.write(reinterpret_cast<char*>(&bytes[i]), sizeof(reinterpret_cast<char*>(&bytes[i])));
-        }
+        serialiseBytes(file, bytes, 2);
     }
 
-    void serialiseUint32(std::ofstream& file, uint32_t x)
+    void serialiseUint32(std::ostream& file, uint32_t x)
     {
         uint8_t bytes[4];
         bytes[0] = ((x >> 24) & 0xFF);
         bytes[1] = ((x >> 16) & 0xFF);
         bytes[2] = ((x >> 8) & 0xFF);
         bytes[3] = ((x >> 0) & 0xFF);
-
-        for (int i = 0; i < 4; ++i) {
-            file.write(reinterpret_cast<char*>(&bytes[i]), sizeof(reinterpret_cast<char*>(&bytes[i])));
-        }
+        serialiseBytes(file, bytes, 4);
     }
 
-    void serialiseUint64(std::ofstream& file, uint64_t x)
+    void serialiseUint64(std::ostream& file, uint64_t x)
     {
         uint8_t bytes[8];
-        for (int i = 0; i < 7; i++) {
+        for (int i = 0; i < 8; i++) {
             bytes[i] = (x >> (7 - i) * 8) & 0xFF;
         }
-
-        for (int i = 0; i < 8; ++i) {
-            file.write(reinterpret_cast<char*>(&bytes[i]), sizeof(reinterpret_cast<char*>(&bytes[i])));
-        }
+        serialiseBytes(file, bytes, 8);
     }
 
-    void serialiseString(std::ofstream& file, std::string data)
+    void serialiseString(std::ostream& file, std::string data)
     {
         uint32_t string_length = data.length();
         serialiseUint32(file, string_length);
@@ -56,7 +77,7 @@ namespace utils {
         }
     }
 
-    void serialiseVector(std::ofstream& file, std::vector<uint32_t>& data)
+    void serialiseVector(std::ostream& file, std::vector<uint32_t>& data)
     {
         uint32_t num_elements = data.size();
         serialiseUint32(file, num_elements);
@@ -68,6 +89,7 @@ namespace utils {
 
     uint8_t deserialiseUint8(const char* buffer, size_t& offset)
     {
+        checkRead(offset, utils::advance(1));
         uint8_t value = static_cast<unsigned char>(buffer[offset + 0]);
 
         offset += utils::advance(1);
@@ -77,6 +99,7 @@ namespace utils {
 
     uint16_t deserialiseUint16(const char* buffer, size_t& offset)
     {
+        checkRead(offset, utils::advance(2));
         uint16_t value = (static_cast<unsigned char>(buffer[offset + 0]) << 8 |
             static_cast<unsigned char>(buffer[offset + 1])
             );
@@ -87,6 +110,7 @@ namespace utils {
 
     uint32_t deserialiseUint32(const char* buffer, size_t& offset)
     {
+        checkRead(offset, utils::advance(4));
         uint32_t value = (static_cast<unsigned char>(buffer[offset + 0]) << 24 |
             static_cast<unsigned char>(buffer[offset + 1]) << 16 |
             static_cast<unsigned char>(buffer[offset + 2]) << 8 |
@@ -99,15 +123,11 @@ namespace utils {
 
     uint64_t deserialiseUint64(const char* buffer, size_t& offset)
     {
-        uint64_t value = (static_cast<unsigned char>(buffer[offset + 0]) << 56 |
-            static_cast<unsigned char>(buffer[offset + 1]) << 48 |
-            static_cast<unsigned char>(buffer[offset + 2]) << 40 |
-            static_cast<unsigned char>(buffer[offset + 3]) << 32 |
-            static_cast<unsigned char>(buffer[offset + 4]) << 24 |
-            static_cast<unsigned char>(buffer[offset + 5]) << 16 |
-            static_cast<unsigned char>(buffer[offset + 6]) << 8 |
-            static_cast<unsigned char>(buffer[offset + 7])
-            );
+        checkRead(offset, utils::advance(8));
+        uint64_t value{ 0 };
+        for (int i = 0; i < 8; i++) {
+            value = (value << 8) | static_cast<unsigned char>(buffer[offset + i]);
+        }
         offset += utils::advance(8);
 
         return value;
@@ -117,6 +137,7 @@ namespace utils {
     {
         std::string _str{ "" };
         uint32_t _strLength = utils::deserialiseUint32(buffer, offset);
+        checkRead(offset, utils::advance(_strLength));
 
         /* Read in the entity's name */
         char* str_arr = new char[_strLength];
@@ -135,6 +156,7 @@ namespace utils {
         std::vector<uint32_t> contents;
 
         uint32_t num_elements = utils::deserialiseUint32(buffer, offset);
+        checkRead(offset, utils::advance(4) * num_elements);
 
         for (uint32_t i = 0; i < num_elements; i++) {
             uint32_t element = deserialiseUint32(buffer, offset);
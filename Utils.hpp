@@ -1,20 +1,38 @@
 #pragma once
 #include <fstream>
+#include <ostream>
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 namespace utils {
 	inline size_t advance(size_t num_bytes) { return 8 * num_bytes; };
-	void serialiseUint8(std::ofstream& file, uint8_t x);
-	void serialiseUint16(std::ofstream& file, uint16_t x);
-	void serialiseUint32(std::ofstream& file, uint32_t x);
-	void serialiseUint64(std::ofstream& file, uint64_t x);
-	void serialiseString(std::ofstream& file, std::string data);
-	void serialiseVector(std::ofstream& file, std::vector<uint32_t>& data);
+	void serialiseBytes(std::ostream& file, const uint8_t* bytes, size_t num_bytes);
+	void serialiseUint8(std::ostream& file, uint8_t x);
+	void serialiseUint16(std::ostream& file, uint16_t x);
+	void serialiseUint32(std::ostream& file, uint32_t x);
+	void serialiseUint64(std::ostream& file, uint64_t x);
+	void serialiseString(std::ostream& file, std::string data);
+	void serialiseVector(std::ostream& file, std::vector<uint32_t>& data);
 	uint8_t					deserialiseUint8(const char* buffer, size_t& offset);
 	uint16_t				deserialiseUint16(const char* buffer, size_t& offset);
 	uint32_t				deserialiseUint32(const char* buffer, size_t& offset);
 	uint64_t				deserialiseUint64(const char* buffer, size_t& offset);
 	std::string				deserialiseString(const char* buffer, size_t& offset);
 	std::vector<uint32_t>	deserialiseVector(const char* buffer, size_t& offset);
+
+	class ReadLimit
+	{
+		/* While one is alive, the deserialise functions on this thread throw rather than read past 
+		*  offset end of the buffer, so that data which can't be trusted can be decoded safely.
+		*/
+	public:
+		explicit ReadLimit(size_t end);
+		~ReadLimit();
+		ReadLimit(const ReadLimit&) = delete;
+		ReadLimit& operator=(const ReadLimit&) = delete;
+
+	private:
+		size_t m_previous;
+	};
 }
\ No newline at end of file
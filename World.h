@@ -10,12 +10,38 @@
 #include <stdexcept>
 #include <cstring>
 #include <fstream>
+#include <sstream>
+#include <future>
+#include <thread>
+#include <functional>
+#include <type_traits>
+#include <memory_resource>
+#include <span>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 #include "Components.h"
+#include "Registry.h"
+#include "Allocators.h"
+#include "Signals.h"
+#include "Events.h"
+#include "Instrumentation.h"
+#include "Prefab.h"
+#include "Hierarchy.h"
+#include "Snapshot.h"
+#include "Save.h"
+#include "ChunkedSave.h"
+#include "Resources.h"
+#include "SystemAccess.h"
+#include "Shared.h"
+#include "TimerWheel.h"
 #include "Utils.hpp"
 
-const int MAX_COMPONENTS{ 40 };
 const int MAX_ENTITIES{ 16382 }; // (2^14 - 1) - 1
+const size_t CACHE_LINE_SIZE{ 64 };
+const size_t HUGE_PAGE_SIZE{ 2 * 1024 * 1024 };
 
 /*
 * Entity - 32 bits
@@ -25,45 +51,326 @@ const int MAX_ENTITIES{ 16382 }; // (2^14 - 1) - 1
 * 
 */
 
+/*
+* Tag components carry no data - either they are empty, or all they hold is the vptr for the 
+* ISerializeable interface. Their Pool only counts its elements and allocates no memory, 
+* membership is held entirely by the sparse and packed arrays. Specialise is_tag to opt a 
+* component in or out.
+*/
+template <typename Component>
+struct is_tag : std::bool_constant<std::is_empty_v<Component> ||
+	(std::is_base_of_v<ISerializeable, Component> && sizeof(Component) == sizeof(ISerializeable))> {};
+
+template <typename Component>
+constexpr bool is_tag_v = is_tag<Component>::value;
+
+template <typename Component>
+Component* TagInstance() {
+	/* Stateless stand-in returned whenever a tag component is looked up. */
+	static Component tag{};
+	return &tag;
+}
+
+/*
+* ComponentLayout controls how a component is stored in its pool. By default every pool starts on 
+* a cache line and the components are tightly packed. Specialise it (or derive from PaddedLayout) to 
+* pad each component out to its own cache line, or to ask for transparent huge pages when the pool 
+* is large enough to fill one.
+*/
+template <typename Component>
+struct ComponentLayout
+{
+	static constexpr size_t alignment{ alignof(Component) > CACHE_LINE_SIZE ? alignof(Component) : CACHE_LINE_SIZE };
+	static constexpr size_t stride{ sizeof(Component) };
+	static constexpr bool huge_pages{ false };
+};
+
+template <typename Component, size_t Alignment = CACHE_LINE_SIZE>
+struct PaddedLayout
+{
+	static constexpr size_t alignment{ Alignment };
+	static constexpr size_t stride{ (sizeof(Component) + Alignment - 1) / Alignment * Alignment };
+	static constexpr bool huge_pages{ false };
+};
+
+/*
+* ComponentStorage chooses how a component's entities are indexed and what happens when one is 
+* removed. Specialise it, or derive from HashedStorage or StableStorage:
+*
+*	DENSE	a sparse array covering every entity id and swap-and-pop removal. The fastest lookups 
+*			and iteration, the default.
+*	HASHED	an open addressing hash table from entity id to pool slot instead of the sparse array, 
+*			and a pool which grows with use. Memory is proportional to the number of entities with 
+*			the component rather than MAX_ENTITIES, for components which few entities have.
+*	STABLE	removal leaves an empty slot (EMPTY_SLOT in the packed array) which a later addition 
+*			reuses, so components never move and pointers from GetComponent stay valid until the 
+*			component itself is removed. The pool is never shrunk.
+*/
+template <typename Component>
+struct ComponentStorage
+{
+	static constexpr StoragePolicy policy{ StoragePolicy::DENSE };
+};
+
+struct HashedStorage
+{
+	static constexpr StoragePolicy policy{ StoragePolicy::HASHED };
+};
+
+struct StableStorage
+{
+	static constexpr StoragePolicy policy{ StoragePolicy::STABLE };
+};
+
+// marks an empty slot in the packed array of a STABLE component, and an empty bucket in a HASHED one's table.
+const uint16_t EMPTY_SLOT{ MAX_ENTITIES + 1 };
+// set on the packed entries of disabled entities in a STABLE pool. Like EMPTY_SLOT it is above every 
+// entity id, so queries skip both with one comparison.
+const uint16_t DISABLED_ID_BIT{ 0x8000 };
+
+inline uint16_t PackedEntityID(const uint16_t entry) {
+	/* The entity id in a packed entry, without DISABLED_ID_BIT. EMPTY_SLOT is left as it is. */
+	return static_cast<uint16_t>(entry & ~DISABLED_ID_BIT);
+}
+const size_t MIN_HASHED_BUCKETS{ 16 };
+
+template <typename T>
+struct Span
+{
+	T* data{ nullptr };
+	size_t size{ 0 };
+
+	inline T* begin() const { return data; };
+	inline T* end() const { return data + size; };
+	inline T& operator[](const size_t index) const { return data[index]; };
+};
+
+struct ComponentColumn
+{
+	/* One component's pool as raw bytes, for code which only knows the component by id - the i-th
+	*  component starts at data + i * stride and belongs to the entity with id entity_ids[i].
+	*/
+	const uint16_t* entity_ids{ nullptr };
+	// indexed by entity id, so the handle of the i-th entity is handles[entity_ids[i]].
+	const uint32_t* handles{ nullptr };
+	char* data{ nullptr };
+	size_t stride{ 0 };
+	size_t size{ 0 };
+
+	inline void* operator[](const size_t index) const { return data + index * stride; };
+};
+
+/*
+* Change detection. Each pool slot records the World tick at which its component was added and at 
+* which it was last accessed mutably - through GetComponent, GetComponents, GetComponentSpan, Patch or 
+* Replace with a non-const component type. Asking for a const component reads it without marking it. 
+* Wrapping a component in Added or Changed in a query keeps only the entities whose component was 
+* added or changed after the given tick.
+*/
+template <typename Component>
+struct Added {};
+
+template <typename Component>
+struct Changed {};
+
+enum class FilterKind { ANY, ADDED, CHANGED };
+
+template <typename Filter>
+struct QueryFilter
+{
+	using component = Filter;
+	static constexpr FilterKind kind{ FilterKind::ANY };
+};
+
+template <typename Component>
+struct QueryFilter<Added<Component>>
+{
+	using component = Component;
+	static constexpr FilterKind kind{ FilterKind::ADDED };
+};
+
+template <typename Component>
+struct QueryFilter<Changed<Component>>
+{
+	using component = Component;
+	static constexpr FilterKind kind{ FilterKind::CHANGED };
+};
+
 struct Pool
 {
-	std::unique_ptr<char[]> components{ nullptr };
+	std::pmr::memory_resource* resource{ nullptr };
+	char* components{ nullptr };
 	size_t stride{ 1 };
+	size_t alignment{ CACHE_LINE_SIZE };
+	size_t block_alignment{ CACHE_LINE_SIZE };
+	size_t reserved_bytes{ 0 };
+	bool huge_pages{ false };
 	uint16_t num_elements{ 0 };
+	// the components of enabled entities come first, followed by those of disabled ones. Kept by the 
+	// World, and not used by STABLE pools.
+	uint16_t num_active{ 0 };
+	uint16_t capacity{ 0 };
 	uint16_t max_elements{ 0 };
-
-	Pool(uint16_t elements, size_t component_size) : components(nullptr) {
-		components = std::make_unique<char[]>(elements * component_size);
+	// the World tick at which each slot's component was added and last mutably accessed.
+	std::pmr::vector<uint32_t> added_ticks;
+	std::pmr::vector<uint32_t> changed_ticks;
+
+	Pool(uint16_t elements, size_t component_size, 
+		std::pmr::memory_resource* _resource = std::pmr::get_default_resource(),
+		size_t _alignment = CACHE_LINE_SIZE, bool _huge_pages = false, uint16_t initial_elements = UINT16_MAX) : 
+		resource(_resource), added_ticks(_resource), changed_ticks(_resource) {
+		/* Room for all of elements is allocated up front unless initial_elements is smaller, in which 
+		*  case the pool grows as it fills.
+		*/
 		stride = component_size;
+		alignment = _alignment;
+		huge_pages = _huge_pages;
 		max_elements = elements;
+
+		reallocate(std::min(elements, initial_elements));
 	};
 
 	~Pool() {
-
+		if (components != nullptr) {
+			resource->deallocate(components, reserved_bytes, block_alignment);
+		}
 	};
 
+	Pool(const Pool&) = delete;
+	Pool& operator=(const Pool&) = delete;
+
+	void reallocate(const uint16_t new_capacity) {
+		/* Moves the components into a new block with room for new_capacity of them. Like swap-and-pop, 
+		*  this relocates the components by copying their bytes.
+		*/
+		capacity = new_capacity;
+		added_ticks.resize(new_capacity);
+		changed_ticks.resize(new_capacity);
+		if (stride == 0) {
+			return;
+		}
+
+		auto bytes = new_capacity * stride;
+		auto new_alignment = alignment;
+		if (huge_pages && bytes >= HUGE_PAGE_SIZE) {
+			// round up to whole huge pages so that the kernel can back all of the pool with them.
+			bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+			new_alignment = HUGE_PAGE_SIZE;
+		}
+
+		char* block{ nullptr };
+		if (bytes > 0) {
+			block = static_cast<char*>(resource->allocate(bytes, new_alignment));
+#ifdef __linux__
+			if (new_alignment == HUGE_PAGE_SIZE) {
+				madvise(block, bytes, MADV_HUGEPAGE);
+			}
+#endif
+		}
+
+		if (num_elements > 0) {
+			std::memcpy(block, components, num_elements * stride);
+		}
+		if (components != nullptr) {
+			resource->deallocate(components, reserved_bytes, block_alignment);
+		}
+
+		components = block;
+		reserved_bytes = bytes;
+		block_alignment = new_alignment;
+	}
+
+	void reserve(const size_t elements) {
+		if (capacity < elements) {
+			reallocate(static_cast<uint16_t>(std::min<size_t>(elements, max_elements)));
+		}
+	}
+
+	void shrink_to_fit() {
+		if (capacity != num_elements) {
+			reallocate(num_elements);
+			added_ticks.shrink_to_fit();
+			changed_ticks.shrink_to_fit();
+		}
+	}
+
+	inline void* append() {
+		/* Makes room for one more component at the end of the pool and returns its address. A pool which 
+		*  has been shrunk doubles its capacity when it runs out, up to max_elements.
+		*/
+		if (num_elements == capacity) {
+			reallocate(static_cast<uint16_t>(std::min<size_t>(std::max<size_t>(capacity * 2, 16), max_elements)));
+		}
+		return get_addr(num_elements++);
+	}
+
 	inline void* get_addr(const size_t index) const {
-		return components.get() + index * stride;
+		return components + index * stride;
+	};
+
+	inline char* data() const {
+		return components;
+	};
+
+	inline size_t size() const {
+		return num_elements;
 	};
 
 	template <typename Component, typename... Args>
 	void add(Args... args) {
-		new (get_addr(num_elements++)) Component(std::forward<Args>(args)...);
+		if constexpr (is_tag_v<Component>) {
+			append();
+		}
+		else {
+			new (append()) Component(std::forward<Args>(args)...);
+		}
 	};
 
+	template <typename Component, typename... Args>
+	void construct(const size_t index, Args... args) {
+		/* Constructs a component in a slot which is already part of the pool, e.g. an empty slot of a 
+		*  stable pool.
+		*/
+		if constexpr (!is_tag_v<Component>) {
+			new (get_addr(index)) Component(std::forward<Args>(args)...);
+		}
+	}
+
 	template <typename Component>
 	Component* get(const size_t index) const {
 		if (index >= num_elements) {
 			return nullptr;
 		}
 
-		return reinterpret_cast<Component*>(components.get() + index * stride);
+		if constexpr (is_tag_v<Component>) {
+			return TagInstance<Component>();
+		}
+
+		return reinterpret_cast<Component*>(components + index * stride);
+	}
+
+	inline void stamp(const size_t index, const uint32_t tick) {
+		added_ticks[index] = tick;
+		changed_ticks[index] = tick;
 	}
 
 	void swap(const size_t i, const size_t j) {
-		auto* c1 = components.get() + i * stride;
-		auto* c2 = components.get() + j * stride;
-		std::memcpy(c1, c2, stride);
+		auto* c1 = components + i * stride;
+		auto* c2 = components + j * stride;
+		if (stride > 0) {
+			std::memcpy(c1, c2, stride);
+		}
+		added_ticks[i] = added_ticks[j];
+		changed_ticks[i] = changed_ticks[j];
+	}
+
+	void exchange(const size_t i, const size_t j) {
+		/* Swaps two components, unlike swap which overwrites i with j. */
+		if (stride > 0) {
+			std::swap_ranges(components + i * stride, components + (i + 1) * stride, components + j * stride);
+		}
+		std::swap(added_ticks[i], added_ticks[j]);
+		std::swap(changed_ticks[i], changed_ticks[j]);
 	}
 
 	void erase(const size_t index) {
@@ -75,9 +382,14 @@ struct Pool
 	}
 
 	template <typename Component>
-	void serialise(std::ofstream& file) {
+	void serialise(std::ostream& file) {
 		utils::serialiseUint32(file, static_cast<uint32_t>(num_elements));
 
+		if constexpr (is_tag_v<Component>) {
+			// tags have nothing to write beyond how many there are.
+			return;
+		}
+
 		for (uint16_t i = 0; i < num_elements; i++) {
 			Component* component = get<Component>(i);
 			component->serialise(file);
@@ -88,6 +400,15 @@ struct Pool
 	void deserialise(const char* buffer, size_t& offset) {
 		auto _num_elements = static_cast<uint16_t>(utils::deserialiseUint32(buffer, offset));
 		num_elements = 0; // reset the number of elements;
+
+		if constexpr (is_tag_v<Component>) {
+			if (_num_elements > capacity) {
+				reallocate(_num_elements);
+			}
+			num_elements = _num_elements;
+			return;
+		}
+
 		for (uint16_t i = 0; i < _num_elements; i++) {
 			add<Component>();
 			Component* component = get<Component>(i);
@@ -97,24 +418,78 @@ struct Pool
 };
 
 
-using EntityList = std::vector<uint32_t>;
-using ComponentPool = std::vector<std::unique_ptr<Pool>>;
-using SparseArray = std::map<int, std::unique_ptr<uint16_t[]>>;
-using PackedArray = std::map<int, std::vector<uint16_t>>;
-using EntityArray = std::unique_ptr<uint32_t[]>;
+// query results come from the frame arena, so this is a pmr vector rather than the std::vector it once was.
+using EntityList = std::pmr::vector<uint32_t>;
+using ComponentPool = std::pmr::vector<std::unique_ptr<Pool>>;
+using SparseArray = std::pmr::map<int, std::pmr::vector<uint16_t>>;
+using PackedArray = std::pmr::map<int, std::pmr::vector<uint16_t>>;
+using EntityArray = std::pmr::vector<uint32_t>;
+
+template <typename Component>
+using ComponentList = std::pmr::vector<Component*>;
+
+template <typename... Components>
+using ComponentTupleList = std::pmr::vector<std::tuple<Components*...>>;
+using SignalArray = std::vector<ComponentSignals>;
+
+struct ComponentMemoryStats
+{
+	int component_id{ 0 };
+	size_t pool_reserved_bytes{ 0 };
+	size_t pool_used_bytes{ 0 };
+	size_t tick_bytes{ 0 };
+	size_t sparse_bytes{ 0 };
+	size_t packed_capacity{ 0 };
+	size_t packed_size{ 0 };
+	// the fraction of the bytes held for this component which are not in use.
+	double fragmentation{ 0.0 };
+};
+
+struct MemoryStats
+{
+	std::vector<ComponentMemoryStats> components;
+	size_t entity_table_bytes{ 0 };
+	size_t num_entities{ 0 };
+	size_t free_entities{ 0 };
+	size_t free_list_capacity{ 0 };
+	size_t frame_arena_bytes{ 0 };
+	size_t reserved_bytes{ 0 };
+	size_t used_bytes{ 0 };
+	double fragmentation{ 0.0 };
+};
 
 class World 
 {
 private:
+	std::pmr::memory_resource* m_resource;
+	FrameArena m_frame_arena;
 	uint16_t m_entity_counter{ 0 };
 	SparseArray m_sparse;
 	PackedArray m_packed;
+	// the empty slots of each STABLE component as a min-heap. Additions fill the lowest before the pool 
+	// grows, so which slot a component gets doesn't depend on the order of removals or on a Restore.
+	PackedArray m_empty_slots;
+	std::array<StoragePolicy, MAX_COMPONENTS> m_storage{};
 	ComponentPool m_component_pools;
-	EntityArray m_entities{ std::make_unique<uint32_t[]>(MAX_ENTITIES) };
+	EntityArray m_entities;
 	EntityList m_free_entities;
-	int component_counter{ 0 };
-
-	inline const uint16_t GetEntityID(const uint32_t entity) const {
+	// indexed by entity id, non-zero for the entities which have been disabled.
+	std::pmr::vector<uint8_t> m_disabled;
+	SignalArray m_signals;
+	EventBus m_events;
+	uint32_t m_tick{ 1 };
+	HierarchyOrder m_hierarchy_order;
+	SnapshotLog m_snapshot_log;
+	// indexed by ResourceID, nullptr for resources the World doesn't have.
+	std::array<void*, MAX_RESOURCES> m_resources{};
+	std::array<std::shared_ptr<void>, MAX_RESOURCES> m_resource_owners;
+	// indexed by the id of the shared component, not of its SharedRef.
+	std::array<std::unique_ptr<ISharedStore>, MAX_COMPONENTS> m_shared_stores;
+	// the entities waiting on KillAfter, keyed by entity id.
+	TimerWheel m_timers;
+	ECS_INSTRUMENT(Instrumentation m_instrumentation;)
+
+	inline uint16_t GetEntityID(const uint32_t entity) const {
 		/* Get the top 16 bits of entity. */
 		return static_cast<uint16_t>(entity >> 16);
 	}
@@ -135,7 +510,100 @@ private:
 		*/
 		auto current_version = GetEntityVersion(entity);
 		current_version++;
-		entity = (((entity >> 8) & (0 << 8) | current_version)) << 8;
+		entity = (entity & 0xFFFF00FF) | (static_cast<uint32_t>(current_version) << 8);
+	}
+
+	inline void TrackSlots(const int component_id, const size_t first, const size_t count) {
+		/* The Track methods are called before part of the World's storage is written, so that its old 
+		*  contents can be saved for the snapshots (see SnapshotLog). They do nothing if there are none.
+		*/
+		if (m_snapshot_log.tracking()) {
+			auto* pool = m_component_pools[component_id].get();
+			m_snapshot_log.track(PoolRegion(component_id), pool->components, first * pool->stride, count * pool->stride);
+		}
+	}
+
+	inline void TrackSparse(const int component_id, const size_t first, const size_t count = 1) {
+		if (m_snapshot_log.tracking()) {
+			m_snapshot_log.track(SparseRegion(component_id), m_sparse.at(component_id).data(), 
+				first * sizeof(uint16_t), count * sizeof(uint16_t));
+		}
+	}
+
+	inline void TrackPacked(const int component_id, const size_t first, const size_t count = 1) {
+		if (m_snapshot_log.tracking()) {
+			m_snapshot_log.track(PackedRegion(component_id), m_packed.at(component_id).data(), 
+				first * sizeof(uint16_t), count * sizeof(uint16_t));
+		}
+	}
+
+	inline void TrackEntity(const uint16_t entity_id) {
+		if (m_snapshot_log.tracking()) {
+			m_snapshot_log.track(ENTITY_REGION, m_entities.data(), entity_id * sizeof(uint32_t), sizeof(uint32_t));
+		}
+	}
+
+	inline void TrackFreeList(const size_t index) {
+		if (m_snapshot_log.tracking()) {
+			m_snapshot_log.track(FREE_LIST_REGION, m_free_entities.data(), index * sizeof(uint32_t), sizeof(uint32_t));
+		}
+	}
+
+	inline void TrackDisabled(const uint16_t entity_id) {
+		if (m_snapshot_log.tracking()) {
+			m_snapshot_log.track(DISABLED_REGION, m_disabled.data(), entity_id, 1);
+		}
+	}
+
+	inline void TrackHierarchy(const size_t first, const size_t count = 1) {
+		if (m_snapshot_log.tracking()) {
+			m_snapshot_log.track(HIERARCHY_REGION, m_hierarchy_order.nodes.data(), 
+				first * sizeof(HierarchyNode), count * sizeof(HierarchyNode));
+		}
+	}
+
+	char* RegionData(const int region) {
+		/* The start of one of the arrays tracked for snapshots. */
+		if (region == ENTITY_REGION) {
+			return reinterpret_cast<char*>(m_entities.data());
+		}
+		if (region == FREE_LIST_REGION) {
+			return reinterpret_cast<char*>(m_free_entities.data());
+		}
+		if (region == HIERARCHY_REGION) {
+			return reinterpret_cast<char*>(m_hierarchy_order.nodes.data());
+		}
+		if (region == DISABLED_REGION) {
+			return reinterpret_cast<char*>(m_disabled.data());
+		}
+		if (region == TIMER_NODE_REGION || region == TIMER_HEAD_REGION) {
+			return m_timers.region_data(region);
+		}
+		if (region < MAX_COMPONENTS) {
+			return m_component_pools[region]->components;
+		}
+		if (region < 2 * MAX_COMPONENTS) {
+			return reinterpret_cast<char*>(m_sparse.at(region - MAX_COMPONENTS).data());
+		}
+		return reinterpret_cast<char*>(m_packed.at(region - 2 * MAX_COMPONENTS).data());
+	}
+
+	void ResizeRegions(const SnapshotImage& image) {
+		/* Sets the length of every array to what it was when image was taken. */
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (!IsInstantiated(i)) {
+				continue;
+			}
+			auto* pool = m_component_pools[i].get();
+			pool->reserve(image.num_elements[i]);
+			pool->num_elements = image.num_elements[i];
+			pool->num_active = image.num_active[i];
+			m_sparse.at(i).resize(image.lengths[SparseRegion(i)] / sizeof(uint16_t), MAX_ENTITIES + 1);
+			m_packed.at(i).resize(image.lengths[PackedRegion(i)] / sizeof(uint16_t));
+		}
+		m_free_entities.resize(image.lengths[FREE_LIST_REGION] / sizeof(uint32_t));
+		m_hierarchy_order.nodes.resize(image.lengths[HIERARCHY_REGION] / sizeof(HierarchyNode));
+		m_timers.resize(image);
 	}
 
 	uint32_t NewEntity() {
@@ -148,6 +616,7 @@ private:
 		auto uid = m_entity_counter++;
 
 		SetEntityID(entity, uid);
+		TrackEntity(uid);
 		m_entities[uid] = entity;
 		return entity;
 	};
@@ -155,205 +624,2005 @@ private:
 	uint32_t RecycleEntity() {
 		/* Retrieve an entity from the free entities pool. */
 		auto entity = m_free_entities.back();
+		TrackFreeList(m_free_entities.size() - 1);
 		m_free_entities.pop_back();
 
 		return entity;
 	}
 
 	template <typename Component>
-	void InstantiatePool() {
+	void DescribeComponent() {
+		/* Record the type-erased description of a component in the registry, so that any World can 
+		*  create storage for it without knowing its type.
+		*/
+		using Layout = ComponentLayout<Component>;
+		static_assert(Layout::stride >= sizeof(Component) && Layout::stride % alignof(Component) == 0,
+			"Component stride must fit the component and keep it aligned.");
+		static_assert((Layout::alignment & (Layout::alignment - 1)) == 0, "Pool alignment must be a power of two.");
+
+		ComponentRegistry::Describe(GetID<Component>(), [](ComponentInfo& info) {
+			info.registered = true;
+			info.tag = is_tag_v<Component>;
+			// tag components only need the sparse and packed arrays, so their pool has no storage.
+			info.stride = is_tag_v<Component> ? 0 : Layout::stride;
+			info.alignment = Layout::alignment;
+			info.huge_pages = Layout::huge_pages;
+			info.storage = ComponentStorage<Component>::policy;
+
+			if constexpr (Signals<Component>::enabled) {
+				info.static_construct = [](World& world, const uint32_t entity, void* component) {
+					Signals<Component>::on_construct(world, entity, *static_cast<Component*>(component));
+				};
+				info.static_destroy = [](World& world, const uint32_t entity, void* component) {
+					Signals<Component>::on_destroy(world, entity, *static_cast<Component*>(component));
+				};
+			}
+		});
+	}
+
+	void InstantiatePool(const int component_id) {
 		/* Create the required parts for a new component - the pool, the packed array and the sparse array. */
-		
-		const int component_id = GetID<Component>();
-		
-		m_component_pools.emplace_back(std::make_unique<Pool>(MAX_ENTITIES, sizeof(Component)));
+		auto info = ComponentRegistry::GetInfo(component_id);
+		if (!info.registered) {
+			throw std::runtime_error("Component has not been registered with any World.");
+		}
+
+		if (m_component_pools.size() <= static_cast<size_t>(component_id)) {
+			m_component_pools.resize(component_id + 1);
+			m_signals.resize(component_id + 1);
+		}
+
+		// a hashed component is expected to be rare, so its pool and table start empty and grow.
+		auto hashed = info.storage == StoragePolicy::HASHED;
+		m_storage[component_id] = info.storage;
+		m_component_pools[component_id] = std::make_unique<Pool>(MAX_ENTITIES, info.stride, m_resource, 
+			info.alignment, info.huge_pages, hashed ? 0 : MAX_ENTITIES);
+
+		// Make sure we initialise all the entries in the sparse array to MAX_ENTITIES + 1 as this means that 
+		// the entity doesn't have the component.
+		m_sparse.emplace(component_id, std::pmr::vector<uint16_t>(hashed ? 0 : MAX_ENTITIES, MAX_ENTITIES + 1, m_resource));
+
+		m_packed.emplace(component_id, std::pmr::vector<uint16_t>(m_resource));
+		m_empty_slots.emplace(component_id, std::pmr::vector<uint16_t>(m_resource));
+
+		m_signals[component_id].static_construct = info.static_construct;
+		m_signals[component_id].static_destroy = info.static_destroy;
+	}
+
+	std::pmr::vector<uint16_t>& SparseCovering(const int component_id, const uint16_t entity_id) {
+		/* Gets the sparse array of a component, growing it if ShrinkToFit has trimmed it to below entity_id. */
+		auto& sparse = m_sparse.at(component_id);
+		if (sparse.size() <= entity_id) {
+			auto size = std::max<size_t>(static_cast<size_t>(entity_id) + 1, sparse.size() * 2);
+			sparse.resize(std::min<size_t>(size, MAX_ENTITIES), MAX_ENTITIES + 1);
+		}
+		return sparse;
+	}
+
+	inline size_t HashedBucket(const uint16_t entity_id, const size_t mask) const {
+		return (static_cast<uint32_t>(entity_id) * 2654435761u >> 16) & mask;
+	}
+
+	size_t ProbeHashed(const std::pmr::vector<uint16_t>& table, const uint16_t entity_id) const {
+		/* A HASHED component's table holds (entity id, packed index) pairs, found by linear probing. 
+		*  Returns the position of entity_id's pair, or of the empty bucket it would go in. The table 
+		*  must not be empty.
+		*/
+		auto mask = table.size() / 2 - 1;
+		auto bucket = HashedBucket(entity_id, mask);
+		while (table[2 * bucket] != entity_id && table[2 * bucket] != EMPTY_SLOT) {
+			bucket = (bucket + 1) & mask;
+		}
+		return 2 * bucket;
+	}
+
+	inline uint16_t SparseIndexIn(const std::pmr::vector<uint16_t>& sparse, const int component_id, const uint16_t entity_id) const {
+		if (m_storage[component_id] != StoragePolicy::HASHED) {
+			return entity_id < sparse.size() ? sparse[entity_id] : EMPTY_SLOT;
+		}
+		if (sparse.empty()) {
+			return EMPTY_SLOT;
+		}
+		auto position = ProbeHashed(sparse, entity_id);
+		return sparse[position] == entity_id ? sparse[position + 1] : EMPTY_SLOT;
+	}
+
+	inline uint16_t SparseIndex(const int component_id, const uint16_t entity_id) const {
+		/* The entity's packed index, or EMPTY_SLOT (MAX_ENTITIES + 1) if it doesn't have the component. */
+		return SparseIndexIn(m_sparse.at(component_id), component_id, entity_id);
+	}
+
+	void GrowHashed(const int component_id) {
+		/* Doubles a HASHED component's table and re-inserts its pairs. */
+		auto& table = m_sparse.at(component_id);
+		TrackSparse(component_id, 0, table.size());
+		std::pmr::vector<uint16_t> old(std::max(table.size() * 2, 2 * MIN_HASHED_BUCKETS), EMPTY_SLOT, m_resource);
+		old.swap(table);
+
+		for (size_t i = 0; i < old.size(); i += 2) {
+			if (old[i] != EMPTY_SLOT) {
+				auto position = ProbeHashed(table, old[i]);
+				table[position] = old[i];
+				table[position + 1] = old[i + 1];
+			}
+		}
+	}
+
+	void SetSparse(const int component_id, const uint16_t entity_id, const uint16_t packed_index) {
+		/* Points the entity's sparse entry at packed_index. */
+		if (m_storage[component_id] != StoragePolicy::HASHED) {
+			auto& sparse = SparseCovering(component_id, entity_id);
+			TrackSparse(component_id, entity_id);
+			sparse[entity_id] = packed_index;
+			return;
+		}
+
+		auto* table = &m_sparse.at(component_id);
+		auto position = table->empty() ? table->size() : ProbeHashed(*table, entity_id);
+		if (position == table->size() || (*table)[position] != entity_id) {
+			// a new pair, keeping the table at most three quarters full.
+			if ((m_packed.at(component_id).size() + 1) * 4 > table->size() / 2 * 3) {
+				GrowHashed(component_id);
+				table = &m_sparse.at(component_id);
+			}
+			position = ProbeHashed(*table, entity_id);
+		}
+		TrackSparse(component_id, position, 2);
+		(*table)[position] = entity_id;
+		(*table)[position + 1] = packed_index;
+	}
+
+	void EraseSparse(const int component_id, const uint16_t entity_id) {
+		/* Marks the entity as not having the component. The entity must have it. */
+		auto& sparse = m_sparse.at(component_id);
+		if (m_storage[component_id] != StoragePolicy::HASHED) {
+			TrackSparse(component_id, entity_id);
+			sparse[entity_id] = EMPTY_SLOT;
+			return;
+		}
+
+		// backward shift deletion - later pairs of the probe run move up into the hole, so that no 
+		// tombstones are needed.
+		auto mask = sparse.size() / 2 - 1;
+		auto hole = ProbeHashed(sparse, entity_id) / 2;
+		for (auto bucket = (hole + 1) & mask; sparse[2 * bucket] != EMPTY_SLOT; bucket = (bucket + 1) & mask) {
+			auto home = HashedBucket(sparse[2 * bucket], mask);
+			if (((bucket - home) & mask) >= ((bucket - hole) & mask)) {
+				TrackSparse(component_id, 2 * hole, 2);
+				sparse[2 * hole] = sparse[2 * bucket];
+				sparse[2 * hole + 1] = sparse[2 * bucket + 1];
+				hole = bucket;
+			}
+		}
+		TrackSparse(component_id, 2 * hole, 2);
+		sparse[2 * hole] = EMPTY_SLOT;
+		sparse[2 * hole + 1] = EMPTY_SLOT;
+	}
+
+	void RebuildIndex(const int component_id) {
+		/* Recomputes from the packed array what is neither saved nor snapshotted - a HASHED component's 
+		*  table, sized for its entities, and a STABLE component's empty slots. A table is rebuilt 
+		*  without being tracked, so the snapshots must have been dropped.
+		*/
+		auto& packed = m_packed.at(component_id);
+		if (m_storage[component_id] == StoragePolicy::HASHED) {
+			auto num_buckets = MIN_HASHED_BUCKETS;
+			while (packed.size() * 4 > num_buckets * 3) {
+				num_buckets *= 2;
+			}
+			auto& table = m_sparse.at(component_id);
+			table.assign(2 * num_buckets, EMPTY_SLOT);
+			for (size_t i = 0; i < packed.size(); i++) {
+				auto position = ProbeHashed(table, packed[i]);
+				table[position] = packed[i];
+				table[position + 1] = static_cast<uint16_t>(i);
+			}
+		}
+		else if (m_storage[component_id] == StoragePolicy::STABLE) {
+			// in ascending order, which is already a min-heap.
+			auto& empty_slots = m_empty_slots.at(component_id);
+			empty_slots.clear();
+			for (size_t i = 0; i < packed.size(); i++) {
+				if (packed[i] == EMPTY_SLOT) {
+					empty_slots.push_back(static_cast<uint16_t>(i));
+				}
+			}
+		}
+	}
+
+	inline size_t NumActive(const int component_id) const {
+		/* How much of the packed array queries visit. The components of disabled entities come after it, 
+		*  except in a STABLE pool, where their packed entries are marked with DISABLED_ID_BIT instead.
+		*/
+		if (m_storage[component_id] == StoragePolicy::STABLE) {
+			return m_packed.at(component_id).size();
+		}
+		return m_component_pools[component_id]->num_active;
+	}
+
+	inline Span<const uint16_t> ActiveEntities(const int component_id) const {
+		return { m_packed.at(component_id).data(), NumActive(component_id) };
+	}
+
+	void ExchangeSlots(const int component_id, const uint16_t i, const uint16_t j) {
+		/* Swaps two entities' components and packed entries and points their sparse entries at their 
+		*  new slots.
+		*/
+		if (i == j) {
+			return;
+		}
+		auto& packed = m_packed.at(component_id);
+		TrackSlots(component_id, i, 1);
+		TrackSlots(component_id, j, 1);
+		TrackPacked(component_id, i);
+		TrackPacked(component_id, j);
+		m_component_pools[component_id]->exchange(i, j);
+		std::swap(packed[i], packed[j]);
+		SetSparse(component_id, packed[i], i);
+		SetSparse(component_id, packed[j], j);
+	}
+
+	uint16_t ClaimSlot(const int component_id, const uint16_t entity_id) {
+		/* Gives the entity a slot in the component's pool for AddComponent to construct its component 
+		*  in - an empty slot of a stable pool, or a new one at the end.
+		*/
+		auto* pool = m_component_pools[component_id].get();
+		auto& packed = m_packed.at(component_id);
+		auto& empty_slots = m_empty_slots.at(component_id);
+
+		uint16_t packed_index;
+		if (!empty_slots.empty()) {
+			// a stable component fills the slot of one which has been removed.
+			std::pop_heap(empty_slots.begin(), empty_slots.end(), std::greater<uint16_t>());
+			packed_index = empty_slots.back();
+			empty_slots.pop_back();
+			TrackPacked(component_id, packed_index);
+			packed[packed_index] = entity_id;
+		}
+		else {
+			packed_index = static_cast<uint16_t>(packed.size());
+			TrackPacked(component_id, packed_index);
+			packed.push_back(entity_id);
+			pool->append();
+		}
+		TrackSlots(component_id, packed_index, 1);
+		return packed_index;
+	}
+
+	uint16_t PlaceClaimed(const int component_id, const uint16_t entity_id, const uint16_t packed_index) {
+		/* Indexes a newly constructed component and returns the slot it ends up in. */
+		SetSparse(component_id, entity_id, packed_index);
+		m_component_pools[component_id]->stamp(packed_index, m_tick);
+		ECS_INSTRUMENT(m_instrumentation.components[component_id].adds++);
+		return PartitionAdded(component_id, packed_index);
+	}
+
+	uint16_t PartitionAdded(const int component_id, const uint16_t packed_index) {
+		/* Puts a component which has just been added at packed_index on the right side of its pool's 
+		*  partition and returns where it ends up. An enabled entity's is swapped with the first 
+		*  disabled entity's, if there are any.
+		*/
+		auto entity_id = m_packed.at(component_id)[packed_index];
+		if (m_storage[component_id] == StoragePolicy::STABLE) {
+			if (m_disabled[entity_id]) {
+				TrackPacked(component_id, packed_index);
+				m_packed.at(component_id)[packed_index] |= DISABLED_ID_BIT;
+			}
+			return packed_index;
+		}
+		if (m_disabled[entity_id]) {
+			return packed_index;
+		}
+		auto* pool = m_component_pools[component_id].get();
+		auto active_index = pool->num_active++;
+		ExchangeSlots(component_id, active_index, packed_index);
+		return active_index;
+	}
+
+	inline bool IsInstantiated(const int component_id) const {
+		return static_cast<size_t>(component_id) < m_component_pools.size() && m_component_pools[component_id] != nullptr;
+	}
+
+	void RelocateComponent(World& destination, const int component_id, const uint32_t entity, uint32_t& new_entity) {
+		/* Moves one component of entity into destination by copying its bytes, in the same way that the 
+		*  pools relocate components when they swap-and-pop, and then removes it from this world.
+		*/
+		if (!destination.IsInstantiated(component_id)) {
+			destination.InstantiatePool(component_id);
+		}
+
+		auto* pool = m_component_pools[component_id].get();
+		auto* component = pool->get_addr(SparseIndex(component_id, GetEntityID(entity)));
+
+		auto new_entity_id = destination.GetEntityID(new_entity);
+		auto& destination_packed = destination.m_packed.at(component_id);
+		destination.SetSparse(component_id, new_entity_id, static_cast<uint16_t>(destination_packed.size()));
+		destination.TrackPacked(component_id, destination_packed.size());
+		destination_packed.push_back(new_entity_id);
+
+		auto* destination_pool = destination.m_component_pools[component_id].get();
+		destination.TrackSlots(component_id, destination_pool->num_elements, 1);
+		auto* destination_component = destination_pool->append();
+		destination_pool->stamp(destination_pool->num_elements - 1, destination.m_tick);
+		ECS_INSTRUMENT(destination.m_instrumentation.components[component_id].adds++);
+		if (pool->stride > 0) {
+			std::memcpy(destination_component, component, pool->stride);
+		}
+		auto destination_index = destination.PartitionAdded(component_id, static_cast<uint16_t>(destination_pool->num_elements - 1));
+		destination_component = destination_pool->get_addr(destination_index);
+
+		auto& signals = destination.m_signals[component_id];
+		if (signals.static_construct != nullptr) {
+			signals.static_construct(destination, new_entity, destination_component);
+		}
+		if (!signals.on_construct.empty()) {
+			signals.on_construct.publish(destination, new_entity, destination_component);
+		}
+
+		uint32_t _entity = entity;
+		__RemoveComponent(component_id, _entity, true);
+	}
+
+	template <typename Component>
+	void NotifyUpdate(const uint32_t entity, Component* component) {
+		/* Calls the compile time and run time update listeners for this component. */
+		if constexpr (Signals<Component>::enabled) {
+			Signals<Component>::on_update(*this, entity, *component);
+		}
+
+		auto& sink = m_signals[GetID<Component>()].on_update;
+		if (!sink.empty()) {
+			sink.publish(*this, entity, component);
+		}
+	}
+
+	template <typename Component, typename Listener>
+	int Connect(Sink ComponentSignals::* sink, Listener listener) {
+		/* Wraps a typed listener so that it can be stored in the type-erased sink. */
+		auto& signals = m_signals.at(GetID<Component>());
+		auto connection = signals.connection_counter++;
+
+		(signals.*sink).connect(connection, [listener](World& world, const uint32_t entity, void* component) {
+			listener(world, entity, *static_cast<Component*>(component));
+		});
+		return connection;
+	}
+
+#ifdef ECS_INSTRUMENTATION
+	template <QueryKind Kind, typename... Filters>
+	void RecordQuery(const size_t results) {
+		/* Each query signature gets its own slot, so the counters can be found without a lookup. */
+		static const int query_id = NextQueryID();
+		m_instrumentation.record_query(query_id, Kind, { GetID<typename QueryFilter<Filters>::component>()... }, results);
+	}
+#endif
+
+	template <typename Filter>
+	bool PassesFilter(const uint32_t entity, const uint32_t since) {
+		/* Whether the entity has the filter's component and, for Added and Changed, whether it was 
+		*  added or changed after the tick since.
+		*/
+		using Query = QueryFilter<Filter>;
+		auto component_id = GetID<typename Query::component>();
+		if (!HasComponent(component_id, entity)) {
+			return false;
+		}
+
+		if constexpr (Query::kind == FilterKind::ANY) {
+			return true;
+		}
+		else {
+			auto packed_index = SparseIndex(component_id, GetEntityID(entity));
+			auto* pool = m_component_pools[component_id].get();
+			if constexpr (Query::kind == FilterKind::ADDED) {
+				return pool->added_ticks[packed_index] > since;
+			}
+			else {
+				return pool->changed_ticks[packed_index] > since;
+			}
+		}
+	}
+
+	template <typename... Filters>
+	Span<const uint16_t> SmallestPacked() {
+		/* The active part of the packed array of whichever of the components has the fewest enabled entities. */
+		const int component_ids[] = { GetID<typename QueryFilter<Filters>::component>()... };
+
+		auto smallest = ActiveEntities(component_ids[0]);
+		for (auto component_id : component_ids) {
+			if (NumActive(component_id) < smallest.size) {
+				smallest = ActiveEntities(component_id);
+			}
+		}
+		return smallest;
+	}
+
+	template <typename Component>
+	friend struct Signals;
+
+	template <typename Component>
+	SharedStore<Component>& SharedStoreOf() {
+		auto& store = m_shared_stores[GetID<Component>()];
+		if (store == nullptr) {
+			store = std::make_unique<SharedStore<Component>>();
+			store->relink = &World::RelinkShared<Component>;
+		}
+		return *static_cast<SharedStore<Component>*>(store.get());
+	}
+
+	template <typename Component>
+	void JoinShared(const uint32_t entity, SharedRef<Component>& ref, const uint32_t handle) {
+		auto& store = SharedStoreOf<Component>();
+		ref.store = &store;
+		ref.handle = handle;
+		ref.slot = store.add(handle, entity);
+	}
+
+	template <typename Component>
+	void LeaveShared(SharedRef<Component>& ref) {
+		/* The entity moved into ref's slot in the value's entity list is told its new slot. */
+		auto moved = ref.store->remove(ref.handle, ref.slot, m_snapshot_log.newest());
+		if (moved != NULL_ENTITY) {
+			GetComponent<SharedRef<Component>>(moved)->slot = ref.slot;
+		}
+	}
+
+	template <typename Component>
+	void RelinkShared() {
+		/* Refills the store's entity lists from the SharedRefs, once they have been restored. */
+		auto& store = SharedStoreOf<Component>();
+		store.unlink_all(m_snapshot_log.newest());
+
+		auto ref_id = GetID<SharedRef<Component>>();
+		if (IsInstantiated(ref_id)) {
+			auto* pool = m_component_pools[ref_id].get();
+			auto& packed = m_packed.at(ref_id);
+			for (size_t i = 0; i < packed.size(); i++) {
+				if (packed[i] == EMPTY_SLOT) {
+					continue;
+				}
+				auto* ref = pool->template get<SharedRef<Component>>(i);
+				if (!store.holds(ref->handle)) {
+					throw std::runtime_error("A SharedRef points at a value which isn't stored.");
+				}
+				auto slot = store.add(ref->handle, m_entities[PackedEntityID(packed[i])]);
+				if (ref->store != &store || ref->slot != slot) {
+					TrackSlots(ref_id, i, 1);
+					ref->store = &store;
+					ref->slot = slot;
+				}
+			}
+		}
+		store.collect(m_snapshot_log.oldest());
+	}
+
+	void ClearSnapshots() {
+		/* Drops every snapshot, and with them the shared values kept for them. */
+		m_snapshot_log.clear();
+		for (auto& store : m_shared_stores) {
+			if (store != nullptr) {
+				store->collect(UINT32_MAX);
+			}
+		}
+	}
+
+	friend struct Signals<Hierarchy>;
+
+	void JoinHierarchy(const uint32_t entity) {
+		/* Gives the entity a Hierarchy, as a root at the end of the order, and a GlobalPosition. */
+		if (!IsInstantiated(GetID<Hierarchy>())) {
+			RegisterComponent<Hierarchy>();
+		}
+		if (!IsInstantiated(GetID<GlobalPosition>())) {
+			RegisterComponent<GlobalPosition>();
+		}
+
+		uint32_t _entity = entity;
+		if (!HasComponent(GetID<Hierarchy>(), entity)) {
+			AddComponent<Hierarchy>(_entity);
+		}
+		if (!HasComponent(GetID<GlobalPosition>(), entity)) {
+			AddComponent<GlobalPosition>(_entity);
+		}
+	}
+
+	void AttachToHierarchy(const uint32_t entity, Hierarchy& hierarchy) {
+		/* Called as the entity gains a Hierarchy, however it was added - it becomes a root at the end 
+		*  of the order. Any links it was constructed or copied with refer to other entities (or another 
+		*  World's), so they are dropped.
+		*/
+		hierarchy.parent = NULL_ENTITY;
+		hierarchy.first_child = NULL_ENTITY;
+		hierarchy.next_sibling = NULL_ENTITY;
+		hierarchy.prev_sibling = NULL_ENTITY;
+		hierarchy.order_index = static_cast<uint32_t>(m_hierarchy_order.nodes.size());
+		TrackHierarchy(m_hierarchy_order.nodes.size());
+		m_hierarchy_order.nodes.push_back({ entity, NO_PARENT_INDEX });
+	}
+
+	void Unlink(Hierarchy& hierarchy) {
+		/* Takes the entity out of its parent's list of children. */
+		if (hierarchy.prev_sibling != NULL_ENTITY) {
+			GetComponent<Hierarchy>(hierarchy.prev_sibling)->next_sibling = hierarchy.next_sibling;
+		}
+		else if (hierarchy.parent != NULL_ENTITY) {
+			GetComponent<Hierarchy>(hierarchy.parent)->first_child = hierarchy.next_sibling;
+		}
+		if (hierarchy.next_sibling != NULL_ENTITY) {
+			GetComponent<Hierarchy>(hierarchy.next_sibling)->prev_sibling = hierarchy.prev_sibling;
+		}
+
+		hierarchy.parent = NULL_ENTITY;
+		hierarchy.prev_sibling = NULL_ENTITY;
+		hierarchy.next_sibling = NULL_ENTITY;
+		TrackHierarchy(hierarchy.order_index);
+		m_hierarchy_order.nodes[hierarchy.order_index].parent_index = NO_PARENT_INDEX;
+	}
+
+	void AppendSubtree(const uint32_t root) {
+		/* Moves root and all of its descendants to the end of the order, in depth-first order, so 
+		*  that they come after root's (new) parent. Their old entries become tombstones.
+		*/
+		auto& nodes = m_hierarchy_order.nodes;
+		auto entity = root;
+		while (true) {
+			auto* hierarchy = GetComponent<Hierarchy>(entity);
+			auto parent_index = nodes[hierarchy->order_index].parent_index;
+			if (hierarchy->parent != NULL_ENTITY) {
+				// parents are visited first, so this is already their new position.
+				parent_index = GetComponent<Hierarchy>(hierarchy->parent)->order_index;
+			}
+
+			TrackHierarchy(hierarchy->order_index);
+			nodes[hierarchy->order_index].entity = NULL_ENTITY;
+			m_hierarchy_order.tombstones++;
+			hierarchy->order_index = static_cast<uint32_t>(nodes.size());
+			TrackHierarchy(nodes.size());
+			nodes.push_back({ entity, parent_index });
+
+			// step to the next entity of the subtree without a stack.
+			if (hierarchy->first_child != NULL_ENTITY) {
+				entity = hierarchy->first_child;
+				continue;
+			}
+			while (entity != root && GetComponent<Hierarchy>(entity)->next_sibling == NULL_ENTITY) {
+				entity = GetComponent<Hierarchy>(entity)->parent;
+			}
+			if (entity == root) {
+				break;
+			}
+			entity = GetComponent<Hierarchy>(entity)->next_sibling;
+		}
+
+		if (m_hierarchy_order.tombstones > 64 && m_hierarchy_order.tombstones * 2 > nodes.size()) {
+			CompactHierarchy();
+		}
+	}
+
+	void CompactHierarchy() {
+		/* Drops the tombstones from the order. Parents are always before their children, so a parent's 
+		*  new index is known by the time any of its children are reached.
+		*/
+		auto& nodes = m_hierarchy_order.nodes;
+		std::pmr::vector<uint32_t> new_index(nodes.size(), NO_PARENT_INDEX, &m_frame_arena);
+		TrackHierarchy(0, nodes.size());
+
+		size_t live{ 0 };
+		for (size_t i = 0; i < nodes.size(); i++) {
+			if (nodes[i].entity == NULL_ENTITY) {
+				continue;
+			}
+			auto node = nodes[i];
+			if (node.parent_index != NO_PARENT_INDEX) {
+				node.parent_index = new_index[node.parent_index];
+			}
+			new_index[i] = static_cast<uint32_t>(live);
+			GetComponent<Hierarchy>(node.entity)->order_index = static_cast<uint32_t>(live);
+			nodes[live++] = node;
+		}
+
+		nodes.resize(live);
+		m_hierarchy_order.tombstones = 0;
+	}
+
+	void DetachFromHierarchy(Hierarchy& hierarchy) {
+		/* Called as the entity loses its Hierarchy - it is unlinked from its parent and its children 
+		*  become roots.
+		*/
+		Unlink(hierarchy);
+
+		auto child = hierarchy.first_child;
+		while (child != NULL_ENTITY) {
+			auto* child_hierarchy = GetComponent<Hierarchy>(child);
+			auto next = child_hierarchy->next_sibling;
+			child_hierarchy->parent = NULL_ENTITY;
+			child_hierarchy->prev_sibling = NULL_ENTITY;
+			child_hierarchy->next_sibling = NULL_ENTITY;
+			TrackHierarchy(child_hierarchy->order_index);
+			m_hierarchy_order.nodes[child_hierarchy->order_index].parent_index = NO_PARENT_INDEX;
+			child = next;
+		}
+		hierarchy.first_child = NULL_ENTITY;
+
+		TrackHierarchy(hierarchy.order_index);
+		m_hierarchy_order.nodes[hierarchy.order_index].entity = NULL_ENTITY;
+		m_hierarchy_order.tombstones++;
+	}
+
+	template <typename Component>
+	void CaptureComponent(SaveImage& image) {
+		/* Copies the component's pool, sparse and packed arrays into the image. Trivially copyable
+		*  components are copied in one memcpy, anything else is copy constructed so that the copies
+		*  own whatever they point to.
+		*/
+		auto component_id = GetID<Component>();
+		auto* pool = m_component_pools.at(component_id).get();
+
+		SavedComponent saved;
+		saved.num_elements = pool->num_elements;
+		saved.stride = pool->stride;
+		saved.write = &WriteSavedComponent<Component>;
+		if constexpr (is_shared_ref_v<Component>) {
+			// the values are few, so they are written out now rather than copied.
+			std::ostringstream values(std::ios::binary);
+			SharedStoreOf<typename Component::value_type>().serialise(values);
+			saved.values = values.str();
+		}
+
+		if constexpr (!is_tag_v<Component>) {
+			auto alignment = std::align_val_t(pool->alignment);
+			auto num_elements = pool->num_elements;
+			auto stride = pool->stride;
+			auto* components = static_cast<char*>(::operator new(std::max<size_t>(num_elements * pool->stride, 1), alignment));
+			saved.components = std::shared_ptr<char>(components, [alignment, num_elements, stride](char* p) {
+				if constexpr (!std::is_trivially_destructible_v<Component>) {
+					for (uint16_t i = 0; i < num_elements; i++) {
+						reinterpret_cast<Component*>(p + i * stride)->~Component();
+					}
+				}
+				::operator delete(p, alignment);
+			});
+
+			if constexpr (std::is_trivially_copyable_v<Component>) {
+				if (num_elements > 0) {
+					std::memcpy(components, pool->data(), num_elements * stride);
+				}
+			}
+			else {
+				for (uint16_t i = 0; i < num_elements; i++) {
+					new (components + i * stride) Component(*pool->template get<Component>(i));
+				}
+			}
+		}
+
+		// saves hold a full sparse array whatever the storage, it is rebuilt from the packed array.
+		auto& packed = m_packed.at(component_id);
+		saved.sparse.assign(MAX_ENTITIES, MAX_ENTITIES + 1);
+		saved.packed.resize(packed.size());
+		for (size_t i = 0; i < packed.size(); i++) {
+			saved.packed[i] = PackedEntityID(packed[i]);
+			if (packed[i] != EMPTY_SLOT) {
+				saved.sparse[saved.packed[i]] = static_cast<uint16_t>(i);
+			}
+		}
+
+		image.components.push_back(std::move(saved));
+	}
+
+	void EncodeWorldBlock(SaveBlock& block) {
+		AppendUint32(block.raw, static_cast<uint32_t>(m_entity_counter));
+		AppendUint32(block.raw, static_cast<uint32_t>(m_free_entities.size()));
+		for (auto entity : m_free_entities) {
+			AppendUint32(block.raw, entity);
+		}
+		for (auto entity : m_entities) {
+			AppendUint32(block.raw, entity);
+		}
+		AppendUint32(block.raw, static_cast<uint32_t>(m_timers.size()));
+		m_timers.for_each([&block](const uint16_t, const uint32_t entity, const uint32_t remaining) {
+			AppendUint32(block.raw, entity);
+			AppendUint32(block.raw, remaining);
+		});
+	}
+
+	void DecodeWorldBlock(const SaveBlock& block) {
+		auto* buffer = block.raw.data();
+		size_t offset{ 0 };
+		if (block.header.raw_size < 8) {
+			throw std::runtime_error("Save file is corrupt.");
+		}
+		auto entity_counter = ReadUint32(buffer, offset);
+		auto num_free_entities = ReadUint32(buffer, offset);
+		// the timers follow the free list and the entity table.
+		size_t timers_offset = 8 + 4 * (static_cast<size_t>(num_free_entities) + MAX_ENTITIES);
+		if (entity_counter > MAX_ENTITIES || block.header.raw_size < timers_offset + 4) {
+			throw std::runtime_error("Save file is corrupt.");
+		}
+		auto num_timers = ReadUint32(buffer, timers_offset);
+		if (block.header.raw_size != timers_offset + 8 * static_cast<size_t>(num_timers)) {
+			throw std::runtime_error("Save file is corrupt.");
+		}
+
+		m_entity_counter = static_cast<uint16_t>(entity_counter);
+		m_free_entities.resize(num_free_entities);
+		for (auto& entity : m_free_entities) {
+			entity = ReadUint32(buffer, offset);
+		}
+		for (auto& entity : m_entities) {
+			entity = ReadUint32(buffer, offset);
+		}
+		offset = timers_offset;
+		for (uint32_t i = 0; i < num_timers; i++) {
+			auto entity = ReadUint32(buffer, offset);
+			LoadTimer(entity, ReadUint32(buffer, offset));
+		}
+	}
+
+	template <typename Component>
+	void EncodeComponentBlock(SaveBlock& block) {
+		/* The entity ids of the block's components, the length of each component once serialised, then 
+		*  the components written by their serialise.
+		*/
+		auto component_id = GetID<Component>();
+		auto* pool = m_component_pools.at(component_id).get();
+		auto& packed = m_packed.at(component_id);
+		auto first = block.header.first;
+		auto last = first + block.header.count;
+
+		for (auto i = first; i < last; i++) {
+			AppendUint16(block.raw, PackedEntityID(packed[i]));
+		}
+		if constexpr (!is_tag_v<Component>) {
+			std::ostringstream stream(std::ios::binary);
+			for (auto i = first; i < last; i++) {
+				auto start = stream.tellp();
+				pool->template get<Component>(i)->serialise(stream);
+				AppendUint32(block.raw, static_cast<uint32_t>(stream.tellp() - start));
+			}
+			// a shared component's first block carries the values its refs index.
+			if constexpr (is_shared_ref_v<Component>) {
+				if (first == 0) {
+					SharedStoreOf<typename Component::value_type>().serialise(stream);
+				}
+			}
+			block.raw += stream.str();
+		}
+	}
+
+	template <typename Component>
+	void PrepareComponentSection(const uint32_t total) {
+		/* Empties the component's arrays and sizes them for total components, which are then filled in
+		*  a block at a time by DecodeComponentBlock.
+		*/
+		auto component_id = GetID<Component>();
+		auto* pool = m_component_pools.at(component_id).get();
+		if (total > pool->max_elements) {
+			throw std::runtime_error("Save file is corrupt.");
+		}
+
+		pool->num_elements = 0;
+		if (total > pool->capacity) {
+			pool->reallocate(static_cast<uint16_t>(total));
+		}
+		pool->num_elements = static_cast<uint16_t>(total);
+		pool->num_active = pool->num_elements;
+		if constexpr (is_shared_ref_v<Component>) {
+			// the store is filled in by the first block, which may be decoded on another thread.
+			SharedStoreOf<typename Component::value_type>();
+		}
+		if (m_storage[component_id] == StoragePolicy::HASHED) {
+			m_sparse.at(component_id).clear();
+		}
+		else {
+			m_sparse.at(component_id).assign(MAX_ENTITIES, MAX_ENTITIES + 1);
+		}
+		m_packed.at(component_id).resize(total);
+	}
+
+	template <typename Component>
+	void DecodeComponentBlock(const SaveBlock& block) {
+		/* Blocks of one component fill different slots, so they can be decoded at the same time. A 
+		*  hashed component's table is filled in afterwards by RebuildIndex.
+		*/
+		auto component_id = GetID<Component>();
+		auto* pool = m_component_pools.at(component_id).get();
+		auto& sparse = m_sparse.at(component_id);
+		auto& packed = m_packed.at(component_id);
+		auto* buffer = block.raw.data();
+		size_t offset{ 0 };
+		auto first = block.header.first;
+		auto last = first + block.header.count;
+
+		size_t fixed_bytes = (is_tag_v<Component> ? 2 : 6) * static_cast<size_t>(block.header.count);
+		if (fixed_bytes > block.header.raw_size) {
+			throw std::runtime_error("Save file is corrupt.");
+		}
+		for (auto i = first; i < last; i++) {
+			auto entity_id = ReadUint16(buffer, offset);
+			auto empty = entity_id == EMPTY_SLOT && m_storage[component_id] == StoragePolicy::STABLE;
+			if (entity_id >= MAX_ENTITIES && !empty) {
+				throw std::runtime_error("Save file is corrupt.");
+			}
+			packed[i] = entity_id;
+			if (!empty && m_storage[component_id] != StoragePolicy::HASHED) {
+				sparse[entity_id] = static_cast<uint16_t>(i);
+			}
+			pool->stamp(i, m_tick);
+		}
+
+		if constexpr (!is_tag_v<Component>) {
+			// each component has to fit in what is left of the block, and is decoded with reads past its 
+			// length refused (see utils::ReadLimit), so it has to read exactly its length.
+			auto lengths_offset = offset;
+			offset = fixed_bytes;
+			for (auto i = first; i < last; i++) {
+				auto length = ReadUint32(buffer, lengths_offset);
+				if (length > block.header.raw_size - offset) {
+					throw std::runtime_error("Save file is corrupt.");
+				}
+				auto end = offset + length;
+				auto* component = new (pool->get_addr(i)) Component();
+				{
+					utils::ReadLimit limit(end);
+					component->deserialise(buffer, offset);
+				}
+				if (offset != end) {
+					throw std::runtime_error("Save file is corrupt.");
+				}
+			}
+			if constexpr (is_shared_ref_v<Component>) {
+				if (first == 0) {
+					SharedStoreOf<typename Component::value_type>().deserialise(buffer, offset, block.header.raw_size);
+				}
+			}
+		}
+	}
+
+	template <typename Component>
+	void RelinkLoaded() {
+		/* Links a loaded shared component's refs up to the values loaded into its store. */
+		if constexpr (is_shared_ref_v<Component>) {
+			RelinkShared<typename Component::value_type>();
+		}
+	}
+
+	void SwapPackedEntities(const int component_id, const uint16_t entity_id, const uint16_t packed_index) {
+		/* Updates the packed and sparse arrays when an entity has a component removed, if there are more 
+		*  than two entities with the specified component. This is achieved by swapping the positions in the 
+		*  packed array, updating the sparse array and then popping the final entity in the packed array.
+		*/
+
+		ECS_INSTRUMENT(m_instrumentation.components[component_id].swap_and_pops++);
+
+		auto final_entity_id = m_packed.at(component_id).back();
+		TrackPacked(component_id, packed_index);
+		TrackPacked(component_id, m_packed.at(component_id).size() - 1);
+		// update the values in the sparse array		
+		SetSparse(component_id, final_entity_id, packed_index);
+		EraseSparse(component_id, entity_id);
+		
+		// swap entity ids in the packed array and then remove the last 
+		// id (the entity which is having the component removed)
+		std::iter_swap(m_packed.at(component_id).begin() + packed_index, 
+						m_packed.at(component_id).end() - 1);
+		m_packed.at(component_id).pop_back();
+	}
+
+	void __RemoveComponent(const int component_id, uint32_t & entity, const bool relocated = false) {
+		/* If the entity has a component of this type, it is deleted, otherwise nothing happens.
+		*  This method allows components to be removed given the integer component id and allows if
+		*  therefore to be called from outside of the templated code. A relocated component has been 
+		*  moved to another World, so a runtime component's destroy isn't called on it.
+		*/
+		
+		if (HasComponent(component_id, entity)) {
+			const auto entity_id = GetEntityID(entity);
+			auto packed_index = SparseIndex(component_id, entity_id);
+			auto* pool = m_component_pools.at(component_id).get();
+			TrackSlots(component_id, packed_index, 1);
+			TrackSlots(component_id, pool->num_elements - 1, 1);
+
+			// let any listeners see the component before it is overwritten.
+			auto& signals = m_signals[component_id];
+			if (signals.static_destroy != nullptr) {
+				signals.static_destroy(*this, entity, pool->get_addr(packed_index));
+			}
+			if (!signals.on_destroy.empty()) {
+				signals.on_destroy.publish(*this, entity, pool->get_addr(packed_index));
+			}
+			if (signals.destroy != nullptr && !relocated) {
+				signals.destroy(pool->get_addr(packed_index), signals.context);
+			}
+
+			if (m_storage[component_id] == StoragePolicy::STABLE) {
+				// the component stays where it is and its slot is left empty for the next one.
+				TrackPacked(component_id, packed_index);
+				m_packed.at(component_id)[packed_index] = EMPTY_SLOT;
+				EraseSparse(component_id, entity_id);
+				auto& empty_slots = m_empty_slots.at(component_id);
+				empty_slots.push_back(packed_index);
+				std::push_heap(empty_slots.begin(), empty_slots.end(), std::greater<uint16_t>());
+				ECS_INSTRUMENT(m_instrumentation.components[component_id].removes++);
+				return;
+			}
+
+			// an enabled entity's component first swaps places with the last enabled one, so that the 
+			// swap-and-pop below fills the hole with a disabled entity's.
+			if (packed_index < pool->num_active) {
+				ExchangeSlots(component_id, packed_index, pool->num_active - 1);
+				packed_index = --pool->num_active;
+			}
+
+			// if there is more than one of these components, swap the to-be-deleted entry in the packed array
+			// with the final entry and then remove it.
+			if (m_packed.at(component_id).size() > 1) {
+				SwapPackedEntities(component_id, entity_id, packed_index);
+			}
+			else {
+				// otherwise just pop it from the packed array and update the sparse array.
+				TrackPacked(component_id, 0);
+				m_packed.at(component_id).pop_back();
+				EraseSparse(component_id, entity_id);
+			}
+
+			// now erase the component from the pool data.
+			pool->erase(packed_index);
+			ECS_INSTRUMENT(m_instrumentation.components[component_id].removes++);
+		}
+	}
+
+	void EnableAll() {
+		/* Saves don't record which entities are disabled, so loading one enables them all first. This 
+		*  keeps the components which aren't in the save consistent with the flags.
+		*/
+		for (uint16_t i = 0; i < m_entity_counter; i++) {
+			if (m_disabled[i]) {
+				Enable(m_entities[i]);
+			}
+		}
+	}
+
+	void LoadTimer(const uint32_t entity, const uint32_t remaining) {
+		/* Reschedules a KillAfter timer read from a save. */
+		if (GetEntityID(entity) >= MAX_ENTITIES || remaining == 0) {
+			throw std::runtime_error("Save file is corrupt.");
+		}
+		m_timers.schedule(GetEntityID(entity), entity, remaining);
+	}
+
+	void ExpireTimers() {
+		/* Kills every entity whose KillAfter time is up, in one batch. */
+		for (auto entity : m_timers.advance()) {
+			if (m_entities[GetEntityID(entity)] == entity) {
+				KillEntity(entity);
+			}
+		}
+	}
+
+public:
+	World(std::pmr::memory_resource* resource = std::pmr::get_default_resource(), 
+		size_t frame_arena_bytes = DEFAULT_FRAME_ARENA_BYTES) :
+		m_resource(resource),
+		m_frame_arena(frame_arena_bytes, resource),
+		m_sparse(resource),
+		m_packed(resource),
+		m_empty_slots(resource),
+		m_component_pools(resource),
+		m_entities(MAX_ENTITIES, 0, resource),
+		m_free_entities(resource),
+		m_disabled(MAX_ENTITIES, 0, resource),
+		m_events(resource),
+		m_hierarchy_order(resource),
+		m_snapshot_log(resource),
+		m_timers(resource, MAX_ENTITIES, m_snapshot_log) {
+		/* All of the world's storage is taken from resource. Query results are taken from a 
+		*  per-frame arena (see FrameArena) which sits on top of it.
+		*/
+	};
+
+	~World() {
+		/* Runtime components with a destroy function are destroyed with the World. */
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			auto& signals = m_signals[i];
+			if (!IsInstantiated(i) || signals.destroy == nullptr) {
+				continue;
+			}
+			auto& packed = m_packed.at(i);
+			for (size_t j = 0; j < packed.size(); j++) {
+				if (packed[j] != EMPTY_SLOT) {
+					signals.destroy(m_component_pools[i]->get_addr(j), signals.context);
+				}
+			}
+		}
+	};
+
+	uint32_t CreateEntity() {
+		/* Create a new entity by recycling an 'killed' id, 
+		*  or by creating a new id. 
+		*/
+		uint32_t entity;
+
+		if (!m_free_entities.empty()) {
+			entity = RecycleEntity();
+
+			IncreaseEntityVersion(entity);
+			TrackEntity(GetEntityID(entity));
+			m_entities[GetEntityID(entity)] = entity;
+		}
+		else {
+			entity = NewEntity();
+		}
+
+		return entity;
+	}
+
+	inline size_t GetNumEntities() const {
+		/* The number of entity ids which have been handed out, alive or dead. */
+		return m_entity_counter;
+	}
+
+	inline size_t GetNumFreeEntities() const {
+		/* The number of killed entity ids waiting to be recycled. */
+		return m_free_entities.size();
+	}
+
+	template <typename Component>
+	int GetID() {
+		/* Component ids are process wide (see ComponentRegistry), so every World agrees on them. A 
+		*  const component shares the id of the component.
+		*/
+		return ComponentRegistry::GetID<std::remove_const_t<Component>>();
+	}
+
+	bool HasComponent(const int component_id, const uint32_t entity) const {
+		/* Query whether the specified entity has the given component. */
+		auto sparse = m_sparse.find(component_id);
+		if (sparse == m_sparse.end()) {
+			// this component has never been added to an entity.
+			return false;
+		}
+		// the sparse array only covers the entity ids which have been seen since the last ShrinkToFit.
+		return SparseIndexIn(sparse->second, component_id, GetEntityID(entity)) != EMPTY_SLOT;
+	}
+
+	template <typename... Components>
+	bool HasComponents(const uint32_t entity) const {
+		/* Whether the entity has all of the components. Unlike HasComponent, this is false for a stale 
+		*  handle whose id has since been given to another entity.
+		*/
+		auto entity_id = GetEntityID(entity);
+		return entity_id < MAX_ENTITIES && m_entities[entity_id] == entity &&
+			(HasComponent(ComponentRegistry::GetID<std::remove_const_t<Components>>(), entity) && ...);
+	}
+
+	template <typename Component>
+	void RegisterComponent() {
+		// Register a component before use. This will be used to determine the order in which 
+		// component templates are instantiated and therefore allow correct serialisation / 
+		// deserialisation. The user must register all components before use.
+		auto component_id = GetID<Component>();
+		DescribeComponent<Component>();
+
+		if (!IsInstantiated(component_id)) {
+			// First use of this Component, so create a new Pool and associated sparse and packed 
+			// arrays.
+			InstantiatePool(component_id);
+		}
+	}
+
+	int RegisterComponent(const RuntimeComponent& description) {
+		/* Registers a component which is only known at run time and returns its id. The name picks the 
+		*  id, so every World registering the same name shares it. Its components are stored like any 
+		*  other, aligned to description.alignment, and are reached through the id based AddComponent, 
+		*  GetComponent, RemoveComponent and GetColumn. Saves don't include them, and snapshots restore 
+		*  their bytes without calling construct or destroy.
+		*/
+		if (description.size == 0) {
+			throw std::runtime_error("Runtime components must have a size.");
+		}
+		if (description.alignment == 0 || (description.alignment & (description.alignment - 1)) != 0) {
+			throw std::runtime_error("Component alignment must be a power of two.");
+		}
+
+		auto component_id = ComponentRegistry::GetID(description.name);
+		auto stride = (description.size + description.alignment - 1) / description.alignment * description.alignment;
+		auto alignment = std::max<size_t>(description.alignment, CACHE_LINE_SIZE);
+		// the layout is shared by every World, so a second registration has to agree with the first.
+		ComponentRegistry::Describe(component_id, [&](ComponentInfo& info) {
+			if (info.registered && (info.stride != stride || info.alignment != alignment || info.storage != description.storage)) {
+				throw std::runtime_error("Component " + description.name + " is already registered with a different layout.");
+			}
+			info.registered = true;
+			info.stride = stride;
+			info.alignment = alignment;
+			info.storage = description.storage;
+			info.name = description.name;
+		});
+
+		if (!IsInstantiated(component_id)) {
+			InstantiatePool(component_id);
+		}
+		auto& signals = m_signals[component_id];
+		signals.runtime = true;
+		signals.construct = description.construct;
+		signals.destroy = description.destroy;
+		signals.context = description.context;
+		return component_id;
+	}
+
+	inline int GetComponentID(const std::string& name) const {
+		/* The id of a runtime component, or -1 if no component has been registered with that name. */
+		return ComponentRegistry::FindID(name);
+	}
+
+	template <typename Component, typename... Args>
+	void AddComponent(uint32_t& entity, Args... args) {
+		/* Create an instance of Component type and ties it to the specified 
+		*  entity.
+		*/
+		auto entity_id = GetEntityID(entity);
+		auto component_id = GetID<Component>();
+		auto* pool = m_component_pools.at(component_id).get();
+
+		auto packed_index = ClaimSlot(component_id, entity_id);
+		pool->template construct<Component>(packed_index, std::forward<Args>(args)...);
+		packed_index = PlaceClaimed(component_id, entity_id, packed_index);
+
+		auto* component = pool->template get<Component>(packed_index);
+		if constexpr (Signals<Component>::enabled) {
+			Signals<Component>::on_construct(*this, entity, *component);
+		}
+
+		auto& sink = m_signals[component_id].on_construct;
+		if (!sink.empty()) {
+			sink.publish(*this, entity, component);
+		}
+	}
+
+	template <typename Component, typename Function>
+	Component* Patch(const uint32_t entity, Function function) {
+		/* Modifies the entity's component in place by calling function on it and then notifies 
+		*  the update listeners. Returns nullptr if the entity does not have the component.
+		*/
+		auto* component = GetComponent<Component>(entity);
+		if (component != nullptr) {
+			function(*component);
+			NotifyUpdate<Component>(entity, component);
+		}
+		return component;
+	}
+
+	template <typename Component, typename... Args>
+	Component* Replace(const uint32_t entity, Args... args) {
+		/* Overwrites the entity's component with a newly constructed one and notifies the 
+		*  update listeners. Returns nullptr if the entity does not have the component.
+		*/
+		auto* component = GetComponent<Component>(entity);
+		if (component != nullptr) {
+			*component = Component(std::forward<Args>(args)...);
+			NotifyUpdate<Component>(entity, component);
+		}
+		return component;
+	}
+
+	template <typename Component, typename Listener>
+	int OnConstruct(Listener listener) {
+		/* Connects a listener, callable as listener(World&, uint32_t, Component&), which is run after 
+		*  the component has been added to an entity. Returns a handle for Disconnect. 
+		*/
+		return Connect<Component>(&ComponentSignals::on_construct, listener);
+	}
+
+	template <typename Component, typename Listener>
+	int OnUpdate(Listener listener) {
+		/* Connects a listener which is run after the component has been patched or replaced. */
+		return Connect<Component>(&ComponentSignals::on_update, listener);
+	}
+
+	template <typename Component, typename Listener>
+	int OnDestroy(Listener listener) {
+		/* Connects a listener which is run before the component is removed, including by KillEntity. */
+		return Connect<Component>(&ComponentSignals::on_destroy, listener);
+	}
+
+	template <typename Component>
+	void Disconnect(const int connection) {
+		/* Removes a listener previously connected to one of the component's sinks. */
+		auto& signals = m_signals.at(GetID<Component>());
+		signals.on_construct.disconnect(connection);
+		signals.on_update.disconnect(connection);
+		signals.on_destroy.disconnect(connection);
+	}
+
+	template <typename Component>
+	Component* GetComponent(const uint32_t entity) {
+		/* Retrieves a pointer to the given component that is associated 
+		*  with the specified entity. If that entity does not have a component 
+		*  of that type, nullptr is returned 
+		*/
+		auto component_id = GetID<Component>();
+		ECS_INSTRUMENT(m_instrumentation.count_lookup(component_id));
+
+		Component* p_component{ nullptr };
+		
+		if (HasComponent(component_id, entity)) {
+			auto packed_index = SparseIndex(component_id, GetEntityID(entity));
+			auto* pool = m_component_pools.at(component_id).get();
+			p_component = pool->template get<Component>(packed_index);
+			if constexpr (!std::is_const_v<Component>) {
+				TrackSlots(component_id, packed_index, 1);
+				pool->changed_ticks[packed_index] = m_tick;
+			}
+		}
+		
+		return p_component;
+	}
+
+	template <typename Component>
+	Span<Component> GetComponentSpan() {
+		/* Gets the pool of the specified component as one contiguous array, for vectorised loops. The 
+		*  i-th component belongs to the i-th entity id of GetEntitySpan. Disabled entities' components 
+		*  are left out, except from a STABLE pool. Adding or removing components of this type, or 
+		*  enabling or disabling an entity with one, invalidates the span.
+		*/
+		static_assert(!is_tag_v<Component>, "Tag components have no storage to iterate.");
+		static_assert(ComponentLayout<std::remove_const_t<Component>>::stride == sizeof(Component), 
+			"Padded components can not be addressed as a plain array.");
+
+		auto* pool = m_component_pools.at(GetID<Component>()).get();
+		auto size = NumActive(GetID<Component>());
+		if constexpr (!std::is_const_v<Component>) {
+			TrackSlots(GetID<Component>(), 0, size);
+			std::fill(pool->changed_ticks.begin(), pool->changed_ticks.begin() + size, m_tick);
+		}
+		return { reinterpret_cast<Component*>(pool->data()), size };
+	}
+
+	template <typename Component>
+	Span<const uint16_t> GetEntitySpan() {
+		/* Gets the ids of the enabled entities which have the specified component, in pool order. The 
+		*  empty slots of a stable component have the id EMPTY_SLOT, and its disabled entities' ids have 
+		*  DISABLED_ID_BIT set.
+		*/
+		return ActiveEntities(GetID<Component>());
+	}
+
+	void* AddComponent(const int component_id, uint32_t& entity) {
+		/* Adds a runtime component, constructed by its construct function or zeroed, and returns it. */
+		if (!IsInstantiated(component_id) || !m_signals[component_id].runtime) {
+			throw std::runtime_error("Only registered runtime components can be added by id.");
+		}
+		auto& signals = m_signals[component_id];
+
+		auto entity_id = GetEntityID(entity);
+		auto* pool = m_component_pools[component_id].get();
+		auto packed_index = ClaimSlot(component_id, entity_id);
+		auto* component = pool->get_addr(packed_index);
+		if (signals.construct != nullptr) {
+			signals.construct(component, signals.context);
+		}
+		else {
+			std::memset(component, 0, pool->stride);
+		}
+		component = pool->get_addr(PlaceClaimed(component_id, entity_id, packed_index));
+
+		auto& sink = signals.on_construct;
+		if (!sink.empty()) {
+			sink.publish(*this, entity, component);
+		}
+		return component;
+	}
+
+	void* GetComponent(const int component_id, const uint32_t entity) {
+		/* The entity's component as raw bytes, or nullptr if it doesn't have one. Marks it changed. */
+		if (!IsInstantiated(component_id) || !HasComponent(component_id, entity)) {
+			return nullptr;
+		}
+		auto packed_index = SparseIndex(component_id, GetEntityID(entity));
+		TrackSlots(component_id, packed_index, 1);
+		m_component_pools[component_id]->changed_ticks[packed_index] = m_tick;
+		return m_component_pools[component_id]->get_addr(packed_index);
+	}
+
+	void RemoveComponent(const int component_id, uint32_t& entity) {
+		__RemoveComponent(component_id, entity);
+	}
+
+	ComponentColumn GetColumn(const int component_id, const bool mark_changed = true) {
+		/* Every enabled entity's component of one type, runtime or not, as raw bytes, so that a script 
+		*  can process the whole column in one call. Pass mark_changed = false to only read it. Like 
+		*  GetEntitySpan, a stable pool's column includes its empty slots and disabled entities. The 
+		*  column is invalidated by the same changes as GetComponentSpan.
+		*/
+		auto* pool = m_component_pools.at(component_id).get();
+		auto size = NumActive(component_id);
+		if (mark_changed) {
+			TrackSlots(component_id, 0, size);
+			std::fill(pool->changed_ticks.begin(), pool->changed_ticks.begin() + size, m_tick);
+		}
+		return { m_packed.at(component_id).data(), m_entities.data(), pool->data(), pool->stride, size };
+	}
+
+	template <typename Component>
+	void RemoveComponent(uint32_t& entity) {
+		/* Forwards the component to be removed. */
+		auto component_id = GetID<Component>();
+		__RemoveComponent(component_id, entity);
+	}
+
+	void KillEntity(uint32_t& entity) {
+		/* Sets all components to MAX_ENTITY + 1 to represent no component and 
+		*  then moves the id to the free entities vector ready for re-use.
+		*/
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (HasComponent(i, entity)) {
+				__RemoveComponent(i, entity);
+			}
+		}
+
+		m_timers.cancel(GetEntityID(entity));
+		if (m_disabled[GetEntityID(entity)]) {
+			TrackDisabled(GetEntityID(entity));
+			m_disabled[GetEntityID(entity)] = 0;
+		}
+		TrackFreeList(m_free_entities.size());
+		m_free_entities.push_back(entity);
+	}
+
+	void KillAfter(const uint32_t entity, const uint32_t ticks) {
+		/* Kills the entity in the EndFrame ticks calls from now, so 1 kills it at the end of this frame. 
+		*  Replaces any time it was already given. Killing the entity sooner cancels it. Pending kills 
+		*  are part of snapshots and saves, so Restore and loading bring them back.
+		*/
+		auto id = GetEntityID(entity);
+		if (m_entities[id] != entity) {
+			return;
+		}
+		m_timers.schedule(id, entity, ticks);
+	}
+
+	void CancelKill(const uint32_t entity) {
+		auto id = GetEntityID(entity);
+		if (m_entities[id] == entity) {
+			m_timers.cancel(id);
+		}
+	}
+
+	uint32_t GetTicksToKill(const uint32_t entity) const {
+		/* The number of EndFrame calls left before KillAfter kills the entity, 0 if it isn't due to be. */
+		auto id = GetEntityID(entity);
+		return m_entities[id] == entity ? m_timers.remaining(id) : 0;
+	}
+
+	void Disable(const uint32_t entity) {
+		/* Takes the entity out of every query while keeping its components. Each of its components 
+		*  swaps places with the last enabled entity's in its pool, so queries just stop short of the 
+		*  disabled ones. A STABLE component stays where it is and its packed entry is marked instead. 
+		*  GetComponent still finds a disabled entity's components, and components added while it is 
+		*  disabled are disabled too. Saves don't record it - everything loads enabled.
+		*/
+		auto entity_id = GetEntityID(entity);
+		if (m_entities[entity_id] != entity || m_disabled[entity_id]) {
+			return;
+		}
+		TrackDisabled(entity_id);
+		m_disabled[entity_id] = 1;
+
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (!IsInstantiated(i) || !HasComponent(i, entity)) {
+				continue;
+			}
+			auto packed_index = SparseIndex(i, entity_id);
+			if (m_storage[i] == StoragePolicy::STABLE) {
+				TrackPacked(i, packed_index);
+				m_packed.at(i)[packed_index] |= DISABLED_ID_BIT;
+				continue;
+			}
+			auto* pool = m_component_pools[i].get();
+			ExchangeSlots(i, packed_index, --pool->num_active);
+		}
+	}
+
+	void Enable(const uint32_t entity) {
+		/* Puts a disabled entity back into the queries. */
+		auto entity_id = GetEntityID(entity);
+		if (m_entities[entity_id] != entity || !m_disabled[entity_id]) {
+			return;
+		}
+		TrackDisabled(entity_id);
+		m_disabled[entity_id] = 0;
+
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (!IsInstantiated(i) || !HasComponent(i, entity)) {
+				continue;
+			}
+			auto packed_index = SparseIndex(i, entity_id);
+			if (m_storage[i] == StoragePolicy::STABLE) {
+				TrackPacked(i, packed_index);
+				m_packed.at(i)[packed_index] = PackedEntityID(m_packed.at(i)[packed_index]);
+				continue;
+			}
+			auto* pool = m_component_pools[i].get();
+			ExchangeSlots(i, packed_index, pool->num_active++);
+		}
+	}
+
+	inline bool IsEnabled(const uint32_t entity) const {
+		return m_disabled[GetEntityID(entity)] == 0;
+	}
+
+	template <typename Event>
+	void RegisterEvent() {
+		/* Creates the queue for an event type. Events must be registered before they are emitted. */
+		m_events.Register<Event>();
+	}
+
+	template <typename Event, typename... Args>
+	void Emit(Args... args) {
+		/* Constructs an event in the calling thread's queue. It can be read after the next EndFrame. */
+		m_events.Queue<Event>().emit(std::forward<Args>(args)...);
+	}
+
+	template <typename Event>
+	const EventQueue<Event>& GetEvents() const {
+		/* Gets the events which were emitted during the previous frame. */
+		return m_events.Queue<Event>();
+	}
+
+	template <typename Resource, typename... Args>
+	Resource& SetResource(Args... args) {
+		/* Constructs the World's Resource from args, replacing the one it had. Resources are allocated 
+		*  from the World's memory resource and are not part of snapshots.
+		*/
+		auto resource_id = ResourceID<Resource>();
+		auto owner = std::allocate_shared<Resource>(std::pmr::polymorphic_allocator<Resource>(m_resource), std::forward<Args>(args)...);
+		m_resources[resource_id] = owner.get();
+		m_resource_owners[resource_id] = std::move(owner);
+		return *static_cast<Resource*>(m_resources[resource_id]);
+	}
+
+	template <typename Resource>
+	inline Resource* GetResource() {
+		/* Returns nullptr if the World doesn't have the resource. */
+		return static_cast<Resource*>(m_resources[ResourceID<std::remove_const_t<Resource>>()]);
+	}
+
+	template <typename Resource>
+	inline bool HasResource() {
+		return m_resources[ResourceID<std::remove_const_t<Resource>>()] != nullptr;
+	}
+
+	template <typename Resource>
+	void RemoveResource() {
+		auto resource_id = ResourceID<Resource>();
+		m_resources[resource_id] = nullptr;
+		m_resource_owners[resource_id].reset();
+	}
+
+	template <typename Component, typename... Args>
+	void AddShared(uint32_t& entity, Args... args) {
+		/* Gives the entity a shared Component constructed from args - the stored value equal to it if 
+		*  there is one. The entity holds a SharedRef<Component>, so queries and RemoveComponent use 
+		*  that type.
+		*/
+		static_assert(SharedValue<Component>::enabled, "SharedValue<Component> has not been specialised.");
+		auto handle = SharedStoreOf<Component>().intern(Component(std::forward<Args>(args)...));
+		AddComponent<SharedRef<Component>>(entity);
+		JoinShared(entity, *GetComponent<SharedRef<Component>>(entity), handle);
+	}
+
+	template <typename Component>
+	const Component* GetShared(const uint32_t entity) {
+		/* The entity's shared value, nullptr if it has none. */
+		auto* ref = GetComponent<SharedRef<Component>>(entity);
+		return ref != nullptr ? &ref->store->value(ref->handle) : nullptr;
+	}
+
+	template <typename Component, typename Function>
+	const Component* PatchShared(const uint32_t entity, Function function) {
+		/* Calls function on a copy of the entity's shared value and moves the entity to the copy, which 
+		*  is interned in turn. Other entities sharing the old value keep it.
+		*/
+		auto* ref = GetComponent<SharedRef<Component>>(entity);
+		if (ref == nullptr) {
+			return nullptr;
+		}
+
+		auto& store = *ref->store;
+		auto value = store.value(ref->handle);
+		function(value);
+		auto handle = store.intern(value);
+		if (handle != ref->handle) {
+			LeaveShared(*ref);
+			JoinShared(entity, *ref, handle);
+		}
+		return &store.value(handle);
+	}
+
+	template <typename Component, typename Function>
+	void ForEachShared(Function function) {
+		/* Calls function(const Component& value, const std::vector<uint32_t>& entities) once for each 
+		*  distinct shared value, with the entities which share it, e.g. to draw each mesh in one batch.
+		*/
+		SharedStoreOf<Component>().for_each(function);
+	}
+
+	template <typename Component>
+	size_t GetNumSharedValues() {
+		return SharedStoreOf<Component>().size();
+	}
 
-		m_sparse.insert({ component_id, std::make_unique<uint16_t[]>(MAX_ENTITIES) });
-		// Make sure we initialise all the entries in the sparse array to MAX_ENTITIES + 1 as this means that 
-		// the entity doesn't have the component.
-		auto* sparse = m_sparse.at(component_id).get();
-		for (uint16_t i = 0; i < MAX_ENTITIES; i++) {
-			sparse[i] = MAX_ENTITIES + 1;
-		}
+	void EndFrame() {
+		/* Marks the end of a frame - events emitted during this frame become readable and the 
+		*  events from the previous frame are discarded. No other thread may emit while this runs.
+		*  Query results should not be kept beyond this point.
+		*/
+		ECS_TRACE_SCOPE(*this, "EndFrame");
+		ExpireTimers();
+		m_events.Swap();
+		m_frame_arena.reset();
+	}
 
-		m_packed.insert({ component_id, { } });
+#ifdef ECS_INSTRUMENTATION
+	Instrumentation& GetInstrumentation() {
+		/* The counters and timings collected by this World, only available with ECS_INSTRUMENTATION. */
+		return m_instrumentation;
 	}
+#endif
 
-	void SwapPackedEntities(const int component_id, const uint16_t entity_id, const uint16_t packed_index) {
-		/* Updates the packed and sparse arrays when an entity has a component removed, if there are more 
-		*  than two entities with the specified component. This is achieved by swapping the positions in the 
-		*  packed array, updating the sparse array and then popping the final entity in the packed array.
+	MemoryStats GetMemoryStats() const {
+		/* Reports how much memory the World holds against how much of it is in use. Used bytes are 
+		*  the live components, the sparse entries of entity ids which have been handed out, the live 
+		*  packed entries, live entities and queued free ids.
 		*/
+		MemoryStats stats;
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (!IsInstantiated(i)) {
+				continue;
+			}
+			auto* pool = m_component_pools[i].get();
+			auto& sparse = m_sparse.at(i);
+			auto& packed = m_packed.at(i);
+
+			ComponentMemoryStats component;
+			component.component_id = i;
+			component.pool_reserved_bytes = pool->reserved_bytes;
+			component.pool_used_bytes = pool->num_elements * pool->stride;
+			component.tick_bytes = (pool->added_ticks.capacity() + pool->changed_ticks.capacity()) * sizeof(uint32_t);
+			component.sparse_bytes = sparse.capacity() * sizeof(uint16_t);
+			component.packed_capacity = packed.capacity();
+			component.packed_size = packed.size();
+
+			auto reserved = component.pool_reserved_bytes + component.tick_bytes + component.sparse_bytes + 
+				packed.capacity() * sizeof(uint16_t);
+			auto sparse_used = m_storage[i] == StoragePolicy::HASHED ? 2 * packed.size() : std::min<size_t>(sparse.size(), m_entity_counter);
+			auto used = component.pool_used_bytes + pool->num_elements * 2 * sizeof(uint32_t) + sparse_used * sizeof(uint16_t) +
+				packed.size() * sizeof(uint16_t);
+			component.fragmentation = reserved > 0 ? 1.0 - static_cast<double>(used) / static_cast<double>(reserved) : 0.0;
+
+			stats.components.push_back(component);
+			stats.reserved_bytes += reserved;
+			stats.used_bytes += used;
+		}
 
-		auto final_entity_id = m_packed.at(component_id).back();
-		// update the values in the sparse array		
-		m_sparse.at(component_id)[final_entity_id] = packed_index;
-		m_sparse.at(component_id)[entity_id] = MAX_ENTITIES + 1;
-		
-		// swap entity ids in the packed array and then remove the last 
-		// id (the entity which is having the component removed)
-		std::iter_swap(m_packed.at(component_id).begin() + packed_index, 
-						m_packed.at(component_id).end() - 1);
-		m_packed.at(component_id).pop_back();
+		stats.entity_table_bytes = m_entities.capacity() * sizeof(uint32_t);
+		stats.num_entities = m_entity_counter - m_free_entities.size();
+		stats.free_entities = m_free_entities.size();
+		stats.free_list_capacity = m_free_entities.capacity();
+		stats.frame_arena_bytes = m_frame_arena.capacity();
+
+		stats.reserved_bytes += stats.entity_table_bytes + stats.free_list_capacity * sizeof(uint32_t) + stats.frame_arena_bytes;
+		stats.used_bytes += (stats.num_entities + stats.free_entities) * sizeof(uint32_t) + m_frame_arena.used();
+		stats.fragmentation = stats.reserved_bytes > 0 ? 
+			1.0 - static_cast<double>(stats.used_bytes) / static_cast<double>(stats.reserved_bytes) : 0.0;
+		return stats;
 	}
 
-	void __RemoveComponent(const int component_id, uint32_t & entity) {
-		/* If the entity has a component of this type, it is deleted, otherwise nothing happens.
-		*  This method allows components to be removed given the integer component id and allows if
-		*  therefore to be called from outside of the templated code.
+	void ShrinkToFit() {
+		/* Gives unused capacity back to the memory resource - the pools and packed arrays are cut down 
+		*  to their live components, the sparse arrays to the highest entity id which has the component 
+		*  and the free list to its length. Pointers and spans into the pools are invalidated. Storage 
+		*  grows again as components are added, so this is best called after a peak has passed. Stable 
+		*  pools are left as they are.
 		*/
-		
-		if (HasComponent(component_id, entity)) {
-			const auto entity_id = GetEntityID(entity);
-			auto packed_index = m_sparse.at(component_id)[entity_id];
+		// the snapshots can't be restored into storage which has been cut down.
+		ClearSnapshots();
 
-			// if there is more than one of these components, swap the to-be-deleted entry in the packed array
-			// with the final entry and then remove it.
-			if (m_packed.at(component_id).size() > 1) {
-				SwapPackedEntities(component_id, entity_id, packed_index);
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (!IsInstantiated(i)) {
+				continue;
+			}
+			if (m_storage[i] != StoragePolicy::STABLE) {
+				m_component_pools[i]->shrink_to_fit();
+			}
+
+			auto& packed = m_packed.at(i);
+			packed.shrink_to_fit();
+
+			auto& sparse = m_sparse.at(i);
+			if (m_storage[i] == StoragePolicy::HASHED) {
+				RebuildIndex(i);
 			}
 			else {
-				// otherwise just pop it from the packed array and update the sparse array.
-				m_packed.at(component_id).pop_back();
-				m_sparse.at(component_id)[entity_id] = MAX_ENTITIES + 1;
+				size_t covered{ 0 };
+				for (auto entity_id : packed) {
+					if (entity_id != EMPTY_SLOT) {
+						covered = std::max<size_t>(covered, static_cast<size_t>(PackedEntityID(entity_id)) + 1);
+					}
+				}
+				sparse.resize(covered);
 			}
+			sparse.shrink_to_fit();
+		}
 
-			// now erase the component from the pool data.
-			auto* pool = m_component_pools.at(component_id).get();
-			pool->erase(packed_index);
+		m_free_entities.shrink_to_fit();
+	}
+
+	uint32_t Snapshot() {
+		/* Takes a copy-on-write snapshot of the World and returns its handle for Restore. Nothing is 
+		*  copied now - the old contents of each chunk of storage are saved the first time it is written 
+		*  afterwards. The last few snapshots are kept (DEFAULT_SNAPSHOT_RING), ShrinkToFit and 
+		*  Deserialise drop them.
+		*/
+		ECS_TRACE_SCOPE(*this, "Snapshot");
+		auto& image = m_snapshot_log.begin_snapshot();
+		image.lengths = {};
+		image.num_elements = {};
+		image.num_active = {};
+
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (!IsInstantiated(i)) {
+				continue;
+			}
+			auto* pool = m_component_pools[i].get();
+			image.num_elements[i] = pool->num_elements;
+			image.num_active[i] = pool->num_active;
+			image.lengths[PoolRegion(i)] = pool->num_elements * pool->stride;
+			image.lengths[SparseRegion(i)] = m_sparse.at(i).size() * sizeof(uint16_t);
+			image.lengths[PackedRegion(i)] = m_packed.at(i).size() * sizeof(uint16_t);
 		}
+		image.lengths[ENTITY_REGION] = m_entities.size() * sizeof(uint32_t);
+		image.lengths[FREE_LIST_REGION] = m_free_entities.size() * sizeof(uint32_t);
+		image.lengths[HIERARCHY_REGION] = m_hierarchy_order.nodes.size() * sizeof(HierarchyNode);
+		image.lengths[DISABLED_REGION] = m_disabled.size();
+		image.entity_counter = m_entity_counter;
+		image.hierarchy_tombstones = m_hierarchy_order.tombstones;
+		m_timers.snapshot(image);
+
+		// a full ring has just dropped its oldest snapshot, and the values kept only for it can go.
+		for (auto& store : m_shared_stores) {
+			if (store != nullptr) {
+				store->collect(m_snapshot_log.oldest());
+			}
+		}
+		return image.handle;
 	}
 
-public:
-	World() {};
+	void Restore(const uint32_t snapshot) {
+		/* Rolls the World back to a snapshot by putting back the old contents of every chunk written 
+		*  since, newest first. The snapshot stays available, later ones are dropped. Restored 
+		*  components count as changed, and no signals are sent. The shared values' entity lists are 
+		*  rebuilt from the restored SharedRefs. Throws if the snapshot has been dropped.
+		*/
+		ECS_TRACE_SCOPE(*this, "Restore");
+		auto position = m_snapshot_log.find(snapshot);
+		if (position < 0) {
+			throw std::runtime_error("Snapshot is no longer held.");
+		}
 
-	~World() {};
+		for (auto i = static_cast<int>(m_snapshot_log.size()) - 1; i >= position; i--) {
+			auto& image = m_snapshot_log.at(i);
+			ResizeRegions(image);
 
-	uint32_t CreateEntity() {
-		/* Create a new entity by recycling an 'killed' id, 
-		*  or by creating a new id. 
-		*/
-		uint32_t entity;
+			for (auto& chunk : image.chunks) {
+				std::memcpy(RegionData(chunk.region) + chunk.begin, image.log.data() + chunk.offset, chunk.bytes);
 
-		if (!m_free_entities.empty()) {
-			entity = RecycleEntity();
+				if (chunk.region < MAX_COMPONENTS) {
+					auto* pool = m_component_pools[chunk.region].get();
+					auto first = chunk.begin / pool->stride;
+					auto last = std::min<size_t>((chunk.begin + chunk.bytes + pool->stride - 1) / pool->stride, pool->num_elements);
+					for (auto slot = first; slot < last; slot++) {
+						pool->stamp(slot, m_tick);
+					}
+				}
+			}
+		}
 
-			IncreaseEntityVersion(entity);
-			m_entities[GetEntityID(entity)] = entity;
+		auto& target = m_snapshot_log.at(position);
+		m_entity_counter = target.entity_counter;
+		m_hierarchy_order.tombstones = target.hierarchy_tombstones;
+		m_timers.restore(target);
+		m_snapshot_log.rewind_to(position);
+
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (IsInstantiated(i) && m_storage[i] == StoragePolicy::STABLE) {
+				RebuildIndex(i);
+			}
 		}
-		else {
-			entity = NewEntity();
+		for (auto& store : m_shared_stores) {
+			if (store != nullptr) {
+				(this->*store->relink)();
+			}
 		}
+	}
 
-		return entity;
+	inline uint32_t GetTick() const {
+		/* The tick which additions and changes are currently stamped with. */
+		return m_tick;
 	}
 
-	template <typename Component>
-	int GetID() {
-		/* Increase the static component counter for each new component 
-		*  type used up to a maximum of MAX_COMPONENTS.
+	uint32_t SystemTick() {
+		/* Call when a system has finished its run - returns the tick to pass as since to its queries on 
+		*  the next run, and advances the World's tick so that every later change is newer than it. 
 		*/
-		if (component_counter == MAX_COMPONENTS) {
-			throw std::runtime_error("Max number of components exceeded.");
-		}
+		return m_tick++;
+	}
 
-		static int component_id = component_counter++;
-		return component_id;
+	std::pmr::memory_resource* GetFrameAllocator() {
+		/* The per-frame arena which query results are allocated from. Command buffers and other 
+		*  scratch data which is released before the end of the frame can allocate from it too.
+		*/
+		return &m_frame_arena;
 	}
 
-	bool HasComponent(const int component_id, const uint32_t entity) const {
-		/* Query whether the specified entity has the given component. */
-		if (m_sparse.find(component_id) == m_sparse.end()) {
-			// this component has never been added to an entity.
-			return false;
+	uint32_t MoveEntity(World& destination, uint32_t& entity) {
+		/* Moves an entity and all of its components into another World and kills it in this one. The 
+		*  components are relocated rather than copied or serialised. Returns the entity's handle in 
+		*  the destination.
+		*/
+		auto new_entity = destination.CreateEntity();
+		if (!IsEnabled(entity)) {
+			destination.Disable(new_entity);
+		}
+
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (HasComponent(i, entity)) {
+				RelocateComponent(destination, i, entity, new_entity);
+			}
+		}
+
+		if (auto ticks = GetTicksToKill(entity)) {
+			destination.KillAfter(new_entity, ticks);
 		}
-		return m_sparse.at(component_id)[GetEntityID(entity)] != MAX_ENTITIES + 1;
+		KillEntity(entity);
+		return new_entity;
 	}
 
-	template <typename Component>
-	void RegisterComponent() {
-		// Register a component before use. This will be used to determine the order in which 
-		// component templates are instantiated and therefore allow correct serialisation / 
-		// deserialisation. The user must register all components before use.
-		auto component_id = GetID<Component>();
+	EntityList Instantiate(const Prefab& prefab, const size_t count) {
+		/* Creates count entities with the prefab's components. Each component is copied into its pool 
+		*  for the whole batch at once and the sparse and packed arrays are filled in with one lookup per 
+		*  component. The returned entities are allocated from the frame arena.
+		*/
+		ECS_TRACE_SCOPE(*this, "Instantiate");
+		// checked before anything is created, so a batch which doesn't fit changes nothing.
+		for (auto& entry : prefab.Entries()) {
+			if (!IsInstantiated(entry.component_id)) {
+				continue;
+			}
+			auto* pool = m_component_pools[entry.component_id].get();
+			auto reusable = std::min(count, m_empty_slots.at(entry.component_id).size());
+			if (pool->num_elements + count - reusable > pool->max_elements) {
+				throw std::runtime_error("Max number of components exceeded.");
+			}
+		}
+
+		EntityList entities(&m_frame_arena);
+		entities.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			entities.push_back(CreateEntity());
+		}
+		if (count == 0) {
+			return entities;
+		}
 
-		if (m_component_pools.empty() ||
-			m_component_pools.size() == component_id) {
+		uint16_t highest_id{ 0 };
+		for (auto entity : entities) {
+			highest_id = std::max(highest_id, GetEntityID(entity));
+		}
 
-			// First use of this Component, so create a new Pool and associated sparse and packed 
-			// arrays.
-			InstantiatePool<Component>();
+		for (auto& entry : prefab.Entries()) {
+			auto component_id = entry.component_id;
+			if (!IsInstantiated(component_id)) {
+				InstantiatePool(component_id);
+			}
+
+			auto& packed = m_packed.at(component_id);
+			if (m_storage[component_id] != StoragePolicy::HASHED) {
+				SparseCovering(component_id, highest_id);
+			}
+			auto* pool = m_component_pools[component_id].get();
+
+			// like AddComponent, a stable pool's empty slots are filled first, lowest first.
+			auto& empty_slots = m_empty_slots.at(component_id);
+			auto reused = std::min(count, empty_slots.size());
+			for (size_t i = 0; i < reused; i++) {
+				std::pop_heap(empty_slots.begin(), empty_slots.end(), std::greater<uint16_t>());
+				auto packed_index = empty_slots.back();
+				empty_slots.pop_back();
+				auto entity_id = GetEntityID(entities[i]);
+				TrackPacked(component_id, packed_index);
+				packed[packed_index] = entity_id;
+				SetSparse(component_id, entity_id, packed_index);
+				TrackSlots(component_id, packed_index, 1);
+				if (pool->stride > 0) {
+					entry.fill(pool->get_addr(packed_index), entry.prototype.get(), 1, pool->stride);
+				}
+				pool->stamp(packed_index, m_tick);
+			}
+
+			// the rest of the batch goes at the end.
+			auto first = pool->num_elements;
+			auto appended = count - reused;
+			TrackPacked(component_id, packed.size(), appended);
+			packed.reserve(packed.size() + appended);
+			for (size_t i = reused; i < count; i++) {
+				auto entity_id = GetEntityID(entities[i]);
+				SetSparse(component_id, entity_id, static_cast<uint16_t>(packed.size()));
+				packed.push_back(entity_id);
+			}
+
+			TrackSlots(component_id, first, appended);
+			pool->reserve(first + appended);
+			if (pool->stride > 0 && appended > 0) {
+				entry.fill(pool->get_addr(first), entry.prototype.get(), appended, pool->stride);
+			}
+			pool->num_elements = static_cast<uint16_t>(first + appended);
+			std::fill(pool->added_ticks.begin() + first, pool->added_ticks.begin() + first + appended, m_tick);
+			std::fill(pool->changed_ticks.begin() + first, pool->changed_ticks.begin() + first + appended, m_tick);
+			ECS_INSTRUMENT(m_instrumentation.components[component_id].adds += count);
+
+			// the new entities are enabled, so the batch moves ahead of any disabled entities' components.
+			auto moved = reused > 0 || (m_storage[component_id] != StoragePolicy::STABLE && pool->num_active != first);
+			if (m_storage[component_id] != StoragePolicy::STABLE) {
+				for (size_t i = 0; i < appended; i++) {
+					ExchangeSlots(component_id, pool->num_active++, static_cast<uint16_t>(first + i));
+				}
+			}
+
+			auto& signals = m_signals[component_id];
+			if (signals.static_construct != nullptr || !signals.on_construct.empty()) {
+				for (size_t i = 0; i < count; i++) {
+					auto* component = pool->get_addr(moved ? SparseIndex(component_id, GetEntityID(entities[i])) : first + i);
+					if (signals.static_construct != nullptr) {
+						signals.static_construct(*this, entities[i], component);
+					}
+					signals.on_construct.publish(*this, entities[i], component);
+				}
+			}
 		}
+		return entities;
 	}
 
-	template <typename Component, typename... Args>
-	void AddComponent(uint32_t& entity, Args... args) {
-		/* Create an instance of Component type and ties it to the specified 
-		*  entity.
+	void SetParent(const uint32_t child, const uint32_t parent) {
+		/* Makes child a child of parent, adding Hierarchy and GlobalPosition components to either as 
+		*  needed. The child's descendants move with it.
 		*/
-		auto entity_id = GetEntityID(entity);
-		auto component_id = GetID<Component>();
-		
-		auto packed_index = m_packed.at(component_id).size();
-		m_packed.at(component_id).push_back(entity_id);
-		m_sparse.at(component_id)[entity_id] = packed_index;
-		
+		JoinHierarchy(parent);
+		JoinHierarchy(child);
 
-		auto* pool = m_component_pools.at(component_id).get();
-		pool->template add<Component>(std::forward<Args>(args)...);
+		for (auto ancestor = parent; ancestor != NULL_ENTITY; ancestor = GetComponent<Hierarchy>(ancestor)->parent) {
+			if (ancestor == child) {
+				throw std::runtime_error("An entity can not be parented to one of its descendants.");
+			}
+		}
+
+		auto* hierarchy = GetComponent<Hierarchy>(child);
+		if (hierarchy->parent == parent) {
+			return;
+		}
+		Unlink(*hierarchy);
+
+		auto* parent_hierarchy = GetComponent<Hierarchy>(parent);
+		hierarchy->parent = parent;
+		hierarchy->next_sibling = parent_hierarchy->first_child;
+		if (parent_hierarchy->first_child != NULL_ENTITY) {
+			GetComponent<Hierarchy>(parent_hierarchy->first_child)->prev_sibling = child;
+		}
+		parent_hierarchy->first_child = child;
+
+		if (hierarchy->order_index < parent_hierarchy->order_index) {
+			AppendSubtree(child);
+		}
+		else {
+			TrackHierarchy(hierarchy->order_index);
+			m_hierarchy_order.nodes[hierarchy->order_index].parent_index = parent_hierarchy->order_index;
+		}
 	}
 
-	template <typename Component>
-	Component* GetComponent(const uint32_t entity) {
-		/* Retrieves a pointer to the given component that is associated 
-		*  with the specified entity. If that entity does not have a component 
-		*  of that type, nullptr is returned 
-		*/
-		auto component_id = GetID<Component>();
+	void RemoveParent(const uint32_t child) {
+		/* Makes child the root of its own tree. */
+		if (IsInstantiated(GetID<Hierarchy>()) && HasComponent(GetID<Hierarchy>(), child)) {
+			Unlink(*GetComponent<Hierarchy>(child));
+		}
+	}
 
-		Component* p_component{ nullptr };
-		
-		if (HasComponent(component_id, entity)) {
-			auto entity_id = GetEntityID(entity);
-			auto packed_index = m_sparse.at(component_id)[entity_id];
-			auto* pool = m_component_pools.at(component_id).get();
-			p_component = pool->template get<Component>(packed_index);
+	uint32_t GetParent(const uint32_t entity) {
+		/* The entity's parent, or NULL_ENTITY if it has none. */
+		if (!IsInstantiated(GetID<Hierarchy>()) || !HasComponent(GetID<Hierarchy>(), entity)) {
+			return NULL_ENTITY;
 		}
-		
-		return p_component;
+		return GetComponent<const Hierarchy>(entity)->parent;
 	}
 
-	template <typename Component>
-	void RemoveComponent(uint32_t& entity) {
-		/* Forwards the component to be removed. */
-		auto component_id = GetID<Component>();
-		__RemoveComponent(component_id, entity);
+	void PropagateTransforms() {
+		/* Sets every hierarchy entity's GlobalPosition to its Position offset by its parent's 
+		*  GlobalPosition, in one pass over the order. Entities without a Position sit on their parent, 
+		*  and ones given a Hierarchy directly, without a GlobalPosition, only pass theirs on. A 
+		*  GlobalPosition which already holds its new value is left alone.
+		*/
+		ECS_TRACE_SCOPE(*this, "PropagateTransforms");
+		auto& nodes = m_hierarchy_order.nodes;
+		std::pmr::vector<GlobalPosition> globals(nodes.size(), &m_frame_arena);
+
+		auto position_id = GetID<Position>();
+		bool has_positions = IsInstantiated(position_id);
+		auto global_id = GetID<GlobalPosition>();
+		bool has_globals = IsInstantiated(global_id);
+		for (size_t i = 0; i < nodes.size(); i++) {
+			auto& node = nodes[i];
+			if (node.entity == NULL_ENTITY) {
+				continue;
+			}
+
+			auto& global = globals[i];
+			if (node.parent_index != NO_PARENT_INDEX) {
+				global = globals[node.parent_index];
+			}
+			if (has_positions && HasComponent(position_id, node.entity)) {
+				auto* position = GetComponent<const Position>(node.entity);
+				global.x += position->x;
+				global.y += position->y;
+				global.z += position->z;
+			}
+			// only a GlobalPosition which moved is written, so the rest aren't marked changed or copied 
+			// into the snapshots.
+			if (has_globals && HasComponent(global_id, node.entity)) {
+				auto* current = GetComponent<const GlobalPosition>(node.entity);
+				if (current->x != global.x || current->y != global.y || current->z != global.z) {
+					*GetComponent<GlobalPosition>(node.entity) = global;
+				}
+			}
+		}
 	}
 
-	void KillEntity(uint32_t& entity) {
-		/* Sets all components to MAX_ENTITY + 1 to represent no component and 
-		*  then moves the id to the free entities vector ready for re-use.
+	EntityList MigrateEntities(World& destination, std::span<const uint32_t> entities) {
+		/* Moves a group of entities, held in any contiguous container, into another World. The returned 
+		*  handles are in the same order and are allocated from the destination's frame arena.
 		*/
-		for (int i = 0; i < component_counter; i++) {
-			if (HasComponent(i, entity)) {
-				__RemoveComponent(i, entity);
+		ECS_TRACE_SCOPE(*this, "MigrateEntities");
+		EntityList new_entities(destination.GetFrameAllocator());
+		new_entities.reserve(entities.size());
+
+		for (int i = 0; i < static_cast<int>(m_component_pools.size()); i++) {
+			if (IsInstantiated(i)) {
+				if (!destination.IsInstantiated(i)) {
+					destination.InstantiatePool(i);
+				}
+				auto& packed = destination.m_packed.at(i);
+				packed.reserve(packed.size() + std::min(entities.size(), m_packed.at(i).size()));
 			}
 		}
 
-		m_free_entities.push_back(entity);
+		for (auto entity : entities) {
+			new_entities.push_back(MoveEntity(destination, entity));
+		}
+		return new_entities;
 	}
 
 	template <typename Component>
 	EntityList GetEntitiesWith() {
 		/* Gets all the entities which have the specified component. */
+		ECS_TRACE_SCOPE(*this, "GetEntitiesWith");
 		auto component_id = GetID<Component>();
 		
-		EntityList entities;
-		for (auto entity_id : m_packed.at(component_id)) {
-			if (HasComponent(component_id, m_entities[entity_id]) == 1) {
+		EntityList entities(&m_frame_arena);
+		entities.reserve(NumActive(component_id));
+		for (auto entity_id : ActiveEntities(component_id)) {
+			if (entity_id < EMPTY_SLOT && HasComponent(component_id, m_entities[entity_id]) == 1) {
 				entities.push_back(m_entities[entity_id]);
 			}
 		}
+		ECS_INSTRUMENT(RecordQuery<QueryKind::ENTITIES_WITH, Component>(entities.size()));
 		return entities;
 	}
 
@@ -363,49 +2632,54 @@ public:
 		*  Iterate over the smallest component group, checking whether they 
 		*  also have the other component.
 		*/
+		ECS_TRACE_SCOPE(*this, "GetEntitiesWith");
 		auto component1_id = GetID<Component1>();
 		auto component2_id = GetID<Component2>();
 
-		auto num_component1_elements = m_packed.at(component1_id).size();
-		auto num_component2_elements = m_packed.at(component2_id).size();
+		auto num_component1_elements = NumActive(component1_id);
+		auto num_component2_elements = NumActive(component2_id);
 
-		EntityList entities;
+		EntityList entities(&m_frame_arena);
+		entities.reserve(std::min(num_component1_elements, num_component2_elements));
 		if (num_component1_elements <= num_component2_elements) {
 			// first type has the fewest entities
-			for (auto entity_id : m_packed.at(component1_id)) {
-				if (HasComponent(component2_id, m_entities[entity_id])) {
+			for (auto entity_id : ActiveEntities(component1_id)) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component2_id, m_entities[entity_id])) {
 					entities.push_back(m_entities[entity_id]);
 				}
 			}
 		}
 		else {
-			for (auto entity_id : m_packed.at(component2_id)) {
+			for (auto entity_id : ActiveEntities(component2_id)) {
 				// second type has the fewest entities
-				if (HasComponent(component1_id, m_entities[entity_id])) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component1_id, m_entities[entity_id])) {
 					entities.push_back(m_entities[entity_id]);
 				}
 			}
 		}
+		ECS_INSTRUMENT(RecordQuery<QueryKind::ENTITIES_WITH, Component1, Component2>(entities.size()));
 		return entities;
 	}
 
 	template <typename Component1, typename Component2, typename Component3>
 	EntityList GetEntitiesWith() {
 		/* Gets all the entities which have all three specified components. */
+		ECS_TRACE_SCOPE(*this, "GetEntitiesWith");
 		auto component1_id = GetID<Component1>();
 		auto component2_id = GetID<Component2>();
 		auto component3_id = GetID<Component3>();
 
-		auto num_component1_elements = m_packed.at(component1_id).size();
-		auto num_component2_elements = m_packed.at(component2_id).size();
-		auto num_component3_elements = m_packed.at(component3_id).size();
+		auto num_component1_elements = NumActive(component1_id);
+		auto num_component2_elements = NumActive(component2_id);
+		auto num_component3_elements = NumActive(component3_id);
 
-		EntityList entities;
+		EntityList entities(&m_frame_arena);
+		entities.reserve(std::min({ num_component1_elements, num_component2_elements, num_component3_elements }));
 		if (num_component1_elements <= num_component2_elements && 
 			num_component1_elements <= num_component3_elements) {
 			// first type has the fewest entities
-			for (auto entity_id : m_packed.at(component1_id)) {
-				if (HasComponent(component2_id, m_entities[entity_id]) && HasComponent(component3_id, m_entities[entity_id])) {
+			for (auto entity_id : ActiveEntities(component1_id)) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component2_id, m_entities[entity_id]) && HasComponent(component3_id, m_entities[entity_id])) {
 					entities.push_back(m_entities[entity_id]);
 				}
 			}
@@ -413,59 +2687,64 @@ public:
 		else if (num_component2_elements <= num_component1_elements &&
 				num_component2_elements <= num_component3_elements) {
 			// second type has the fewest entities
-			for (auto entity_id : m_packed.at(component2_id)) {
-				if (HasComponent(component1_id, m_entities[entity_id]) && HasComponent(component3_id, m_entities[entity_id])) {
+			for (auto entity_id : ActiveEntities(component2_id)) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component1_id, m_entities[entity_id]) && HasComponent(component3_id, m_entities[entity_id])) {
 					entities.push_back(m_entities[entity_id]);
 				}
 			}
 		}
 		else {
 			// third type has the fewest entities
-			for (auto entity_id : m_packed.at(component3_id)) {
-				if (HasComponent(component1_id, m_entities[entity_id]) && HasComponent(component2_id, m_entities[entity_id])) {
+			for (auto entity_id : ActiveEntities(component3_id)) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component1_id, m_entities[entity_id]) && HasComponent(component2_id, m_entities[entity_id])) {
 					entities.push_back(m_entities[entity_id]);
 				}
 			}
 		}
+		ECS_INSTRUMENT(RecordQuery<QueryKind::ENTITIES_WITH, Component1, Component2, Component3>(entities.size()));
 		return entities;
 	}
 
 	template <typename Component>
-	std::vector<Component*> GetComponents() {
+	ComponentList<Component> GetComponents() {
 		/* Gets all the entities which have the specified component. */
+		ECS_TRACE_SCOPE(*this, "GetComponents");
 		auto component_id = GetID<Component>();
 
-		std::vector<Component*> components;
+		ComponentList<Component> components(&m_frame_arena);
+		components.reserve(NumActive(component_id));
 
-		for (auto entity_id : m_packed.at(component_id)) {
-			if (HasComponent(component_id, m_entities[entity_id]) == 1) {
-				auto packed_index = m_sparse.at(component_id)[entity_id];
+		for (auto entity_id : ActiveEntities(component_id)) {
+			if (entity_id < EMPTY_SLOT && HasComponent(component_id, m_entities[entity_id]) == 1) {
 				components.push_back(GetComponent<Component>(m_entities[entity_id]));
 			}
 		}
 
+		ECS_INSTRUMENT(RecordQuery<QueryKind::COMPONENTS, Component>(components.size()));
 		return components;
 	}
 
 	template <typename Component1, typename Component2>
-	std::vector<std::tuple<Component1*, Component2*>> GetComponents() {
+	ComponentTupleList<Component1, Component2> GetComponents() {
 		/* Gets all the entities which have both specified components.
 		*  Iterate over the smallest component group, checking whether they
 		*  also have the other component.
 		*/
+		ECS_TRACE_SCOPE(*this, "GetComponents");
 
-		std::vector<std::tuple<Component1*, Component2*>> components; 
+		ComponentTupleList<Component1, Component2> components(&m_frame_arena);
 
 		auto component1_id = GetID<Component1>();
 		auto component2_id = GetID<Component2>();
 
-		auto num_component1_elements = m_packed.at(component1_id).size();
-		auto num_component2_elements = m_packed.at(component2_id).size();
+		auto num_component1_elements = NumActive(component1_id);
+		auto num_component2_elements = NumActive(component2_id);
+		components.reserve(std::min(num_component1_elements, num_component2_elements));
 
 		if (num_component1_elements <= num_component2_elements) {
 			// first type has the fewest entities
-			for (auto entity_id : m_packed.at(component1_id)) {
-				if (HasComponent(component2_id, m_entities[entity_id])) {
+			for (auto entity_id : ActiveEntities(component1_id)) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component2_id, m_entities[entity_id])) {
 					auto* c1 = GetComponent<Component1>(m_entities[entity_id]);
 					auto* c2 = GetComponent<Component2>(m_entities[entity_id]);
 					components.push_back(std::make_tuple(c1, c2));
@@ -473,38 +2752,41 @@ public:
 			}
 		}
 		else {
-			for (auto entity_id : m_packed.at(component2_id)) {
+			for (auto entity_id : ActiveEntities(component2_id)) {
 				// second type has the fewest entities
-				if (HasComponent(component1_id, m_entities[entity_id])) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component1_id, m_entities[entity_id])) {
 					auto* c1 = GetComponent<Component1>(m_entities[entity_id]);
 					auto* c2 = GetComponent<Component2>(m_entities[entity_id]);
 					components.push_back(std::make_tuple(c1, c2));
 				}
 			}
 		}
+		ECS_INSTRUMENT(RecordQuery<QueryKind::COMPONENTS, Component1, Component2>(components.size()));
 		return components;
 	}
 
 	template <typename Component1, typename Component2, typename Component3>
-	std::vector<std::tuple<Component1*, Component2*, Component3*>> GetComponents() {
+	ComponentTupleList<Component1, Component2, Component3> GetComponents() {
 		/* Gets the intersection of entities which have all three components and returns a vector of tuples of 
 		*  pointers to the components.
 		*/
+		ECS_TRACE_SCOPE(*this, "GetComponents");
 		auto component1_id = GetID<Component1>();
 		auto component2_id = GetID<Component2>();
 		auto component3_id = GetID<Component3>();
 
-		auto num_component1_elements = m_packed.at(component1_id).size();
-		auto num_component2_elements = m_packed.at(component2_id).size();
-		auto num_component3_elements = m_packed.at(component3_id).size();
+		auto num_component1_elements = NumActive(component1_id);
+		auto num_component2_elements = NumActive(component2_id);
+		auto num_component3_elements = NumActive(component3_id);
 
-		std::vector<std::tuple<Component1*, Component2*, Component3*>> components;
+		ComponentTupleList<Component1, Component2, Component3> components(&m_frame_arena);
+		components.reserve(std::min({ num_component1_elements, num_component2_elements, num_component3_elements }));
 
 		if (num_component1_elements <= num_component2_elements &&
 			num_component1_elements <= num_component3_elements) {
 			// first type has the fewest entities
-			for (auto entity_id : m_packed.at(component1_id)) {
-				if (HasComponent(component2_id, m_entities[entity_id]) && HasComponent(component3_id, m_entities[entity_id])) {
+			for (auto entity_id : ActiveEntities(component1_id)) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component2_id, m_entities[entity_id]) && HasComponent(component3_id, m_entities[entity_id])) {
 					auto* c1 = GetComponent<Component1>(m_entities[entity_id]);
 					auto* c2 = GetComponent<Component2>(m_entities[entity_id]);
 					auto* c3 = GetComponent<Component3>(m_entities[entity_id]);
@@ -515,8 +2797,8 @@ public:
 		else if (num_component2_elements <= num_component1_elements &&
 			num_component2_elements <= num_component3_elements) {
 			// second type has the fewest entities
-			for (auto entity_id : m_packed.at(component2_id)) {
-				if (HasComponent(component1_id, m_entities[entity_id]) && HasComponent(component3_id, m_entities[entity_id])) {
+			for (auto entity_id : ActiveEntities(component2_id)) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component1_id, m_entities[entity_id]) && HasComponent(component3_id, m_entities[entity_id])) {
 					auto* c1 = GetComponent<Component1>(m_entities[entity_id]);
 					auto* c2 = GetComponent<Component2>(m_entities[entity_id]);
 					auto* c3 = GetComponent<Component3>(m_entities[entity_id]);
@@ -526,8 +2808,8 @@ public:
 		}
 		else {
 			// third type has the fewest entities
-			for (auto entity_id : m_packed.at(component3_id)) {
-				if (HasComponent(component1_id, m_entities[entity_id]) && HasComponent(component2_id, m_entities[entity_id])) {
+			for (auto entity_id : ActiveEntities(component3_id)) {
+				if (entity_id < EMPTY_SLOT && HasComponent(component1_id, m_entities[entity_id]) && HasComponent(component2_id, m_entities[entity_id])) {
 					auto* c1 = GetComponent<Component1>(m_entities[entity_id]);
 					auto* c2 = GetComponent<Component2>(m_entities[entity_id]);
 					auto* c3 = GetComponent<Component3>(m_entities[entity_id]);
@@ -535,37 +2817,323 @@ public:
 				}
 			}
 		}
+		ECS_INSTRUMENT(RecordQuery<QueryKind::COMPONENTS, Component1, Component2, Component3>(components.size()));
+		return components;
+	}
+
+	template <typename... Filters>
+	EntityList GetEntitiesWith(const uint32_t since) {
+		/* Gets the entities which have all of the components. Components wrapped in Added or Changed 
+		*  must also have been added or changed after the tick since, e.g.
+		*	world.GetEntitiesWith<Changed<Position>, MeshRenderer>(last_run);
+		*/
+		EntityList entities(&m_frame_arena);
+		FillEntitiesWith<Filters...>(entities, since);
+		return entities;
+	}
+
+	template <typename... Filters, typename List>
+	void FillEntitiesWith(List& entities, const uint32_t since) {
+		/* As GetEntitiesWith(since), but replaces the contents of a list the caller keeps, so a query 
+		*  repeated every frame reuses the list's capacity rather than allocating.
+		*/
+		ECS_TRACE_SCOPE(*this, "GetEntitiesWith");
+		auto packed = SmallestPacked<Filters...>();
+
+		entities.clear();
+		entities.reserve(packed.size);
+		for (auto entity_id : packed) {
+			if (entity_id >= EMPTY_SLOT) {
+				continue;
+			}
+			auto entity = m_entities[entity_id];
+			if ((PassesFilter<Filters>(entity, since) && ...)) {
+				entities.push_back(entity);
+			}
+		}
+		ECS_INSTRUMENT(RecordQuery<QueryKind::ENTITIES_WITH, Filters...>(entities.size()));
+	}
+
+	template <typename... Filters>
+	ComponentTupleList<typename QueryFilter<Filters>::component...> GetComponents(const uint32_t since) {
+		/* As GetEntitiesWith(since), but returns tuples of pointers to the components. Use Changed<const C> 
+		*  to read the components without marking them changed again.
+		*/
+		ECS_TRACE_SCOPE(*this, "GetComponents");
+		auto packed = SmallestPacked<Filters...>();
+
+		ComponentTupleList<typename QueryFilter<Filters>::component...> components(&m_frame_arena);
+		components.reserve(packed.size);
+		for (auto entity_id : packed) {
+			if (entity_id >= EMPTY_SLOT) {
+				continue;
+			}
+			auto entity = m_entities[entity_id];
+			if ((PassesFilter<Filters>(entity, since) && ...)) {
+				components.push_back(std::make_tuple(GetComponent<typename QueryFilter<Filters>::component>(entity)...));
+			}
+		}
+		ECS_INSTRUMENT(RecordQuery<QueryKind::COMPONENTS, Filters...>(components.size()));
 		return components;
 	}
 
+	template <typename... Components>
+	std::future<void> SaveAsync(const std::string& path) {
+		/* Saves the World and the given components to path on a background thread, as if by Serialise 
+		*  followed by Serialise<Component> for each component in turn and then SerialiseTimers. Only 
+		*  the copying of the World's arrays happens on the calling thread, so the World can carry on 
+		*  changing straight away. The future becomes ready when the file has been written, and 
+		*  rethrows any error from writing it. Wait for it before the program exits.
+		*/
+		ECS_TRACE_SCOPE(*this, "SaveAsync");
+		auto image = std::make_shared<SaveImage>();
+		image->entity_counter = m_entity_counter;
+		image->free_entities.assign(m_free_entities.begin(), m_free_entities.end());
+		image->entities.assign(m_entities.begin(), m_entities.end());
+		m_timers.for_each([&image](const uint16_t, const uint32_t entity, const uint32_t remaining) {
+			image->timers.emplace_back(entity, remaining);
+		});
+		(CaptureComponent<Components>(*image), ...);
+
+		std::packaged_task<void()> task([image, path]() { WriteSaveImage(*image, path); });
+		auto saved = task.get_future();
+		std::thread(std::move(task)).detach();
+		return saved;
+	}
+
+	template <typename... Components>
+	void SaveChunked(std::ostream& out, const ChunkedSaveOptions& options = {}) {
+		/* Saves the World and the given components in the chunked format (see ChunkedSave.h), encoding 
+		*  and compressing blocks on options.threads threads. Load it with LoadChunked and the same 
+		*  components in the same order.
+		*/
+		ECS_TRACE_SCOPE(*this, "SaveChunked");
+		using Encoder = void (World::*)(SaveBlock&);
+		const std::array<Encoder, sizeof...(Components)> encoders{ &World::EncodeComponentBlock<Components>... };
+		const std::array<int, sizeof...(Components)> component_ids{ GetID<Components>()... };
+		auto threads = ChunkedSaveThreads(options.threads);
+		auto elements_per_block = std::max<uint32_t>(options.elements_per_block, 1);
+
+		std::string header;
+		AppendUint32(header, CHUNKED_SAVE_MAGIC);
+		AppendUint32(header, CHUNKED_SAVE_VERSION);
+		AppendUint32(header, static_cast<uint32_t>(sizeof...(Components)));
+		out.write(header.data(), header.size());
+
+		// every component gets at least one block, even if it's empty, so that loading clears it.
+		std::vector<BlockHeader> plan;
+		plan.push_back({ BlockKind::WORLD });
+		for (uint16_t section = 0; section < sizeof...(Components); section++) {
+			uint32_t total = m_component_pools.at(component_ids[section])->num_elements;
+			uint32_t first{ 0 };
+			do {
+				auto count = std::min(elements_per_block, total - first);
+				plan.push_back({ BlockKind::COMPONENT, BlockCodec::NONE, section, first, count, total });
+				first += count;
+			} while (first < total);
+		}
+
+		BlockWorkers workers(threads);
+		std::vector<SaveBlock> window(threads * BLOCKS_PER_THREAD);
+		for (size_t begin = 0; begin < plan.size(); begin += window.size()) {
+			auto num_blocks = std::min(window.size(), plan.size() - begin);
+			workers.run(num_blocks, [&](const size_t i) {
+				auto& block = window[i];
+				block.header = plan[begin + i];
+				block.raw.clear();
+				if (block.header.kind == BlockKind::WORLD) {
+					EncodeWorldBlock(block);
+				}
+				else {
+					(this->*encoders[block.header.section])(block);
+				}
+				CompressBlock(block, options.compress);
+			});
+
+			for (size_t i = 0; i < num_blocks; i++) {
+				WriteBlockHeader(out, window[i].header);
+				out.write(window[i].stored.data(), window[i].stored.size());
+			}
+		}
+
+		WriteBlockHeader(out, {});
+		if (!out) {
+			throw std::runtime_error("Could not write the save.");
+		}
+	}
+
+	template <typename... Components>
+	void LoadChunked(std::istream& in, const unsigned threads = 0) {
+		/* Loads a save written by SaveChunked<Components...>, replacing the entity table and the given 
+		*  components' storage. The components must have been registered. Blocks are read a window at 
+		*  a time and decompressed and decoded on threads threads (0 for every hardware thread).
+		*/
+		ECS_TRACE_SCOPE(*this, "LoadChunked");
+		using Preparer = void (World::*)(const uint32_t);
+		using Decoder = void (World::*)(const SaveBlock&);
+		const std::array<Preparer, sizeof...(Components)> preparers{ &World::PrepareComponentSection<Components>... };
+		const std::array<Decoder, sizeof...(Components)> decoders{ &World::DecodeComponentBlock<Components>... };
+		auto num_threads = ChunkedSaveThreads(threads);
+
+		char header[12];
+		if (!in.read(header, sizeof(header))) {
+			throw std::runtime_error("Save file is truncated.");
+		}
+		size_t offset{ 0 };
+		if (ReadUint32(header, offset) != CHUNKED_SAVE_MAGIC || ReadUint32(header, offset) != CHUNKED_SAVE_VERSION) {
+			throw std::runtime_error("Save file is not a chunked save.");
+		}
+		if (ReadUint32(header, offset) != sizeof...(Components)) {
+			throw std::runtime_error("Save file holds a different set of components.");
+		}
+
+		ClearSnapshots();
+		m_timers.clear();
+		EnableAll();
+		std::array<bool, sizeof...(Components)> prepared{};
+		std::array<uint32_t, sizeof...(Components)> totals{};
+		// the slots of each component covered by the blocks so far, which must follow on from each other.
+		std::array<uint32_t, sizeof...(Components)> covered{};
+		size_t world_blocks{ 0 };
+
+		BlockWorkers workers(num_threads);
+		std::vector<SaveBlock> window(num_threads * BLOCKS_PER_THREAD);
+		bool end{ false };
+		while (!end) {
+			size_t num_blocks{ 0 };
+			while (num_blocks < window.size()) {
+				auto& block = window[num_blocks];
+				ReadBlockHeader(in, block.header);
+				if (block.header.kind == BlockKind::END) {
+					end = true;
+					break;
+				}
+				if (block.header.kind == BlockKind::COMPONENT && block.header.section >= sizeof...(Components)) {
+					throw std::runtime_error("Save file is corrupt.");
+				}
+				block.stored.resize(block.header.stored_size);
+				if (!in.read(block.stored.data(), block.stored.size())) {
+					throw std::runtime_error("Save file is truncated.");
+				}
+				num_blocks++;
+			}
+
+			/* Each component is emptied and sized by its first block, before any block of it is decoded. */
+			for (size_t i = 0; i < num_blocks; i++) {
+				auto& block_header = window[i].header;
+				if (block_header.kind != BlockKind::COMPONENT) {
+					if (++world_blocks > 1) {
+						throw std::runtime_error("Save file is corrupt.");
+					}
+					continue;
+				}
+				auto section = block_header.section;
+				if (!prepared[section]) {
+					(this->*preparers[section])(block_header.total);
+					prepared[section] = true;
+					totals[section] = block_header.total;
+				}
+				else if (totals[section] != block_header.total) {
+					throw std::runtime_error("Save file is corrupt.");
+				}
+				if (block_header.first != covered[section]) {
+					throw std::runtime_error("Save file is corrupt.");
+				}
+				covered[section] += block_header.count;
+			}
+
+			workers.run(num_blocks, [&](const size_t i) {
+				auto& block = window[i];
+				DecompressBlock(block);
+				if (block.header.kind == BlockKind::WORLD) {
+					DecodeWorldBlock(block);
+				}
+				else {
+					(this->*decoders[block.header.section])(block);
+				}
+			});
+		}
+
+		for (size_t section = 0; section < sizeof...(Components); section++) {
+			if (!prepared[section] || covered[section] != totals[section]) {
+				throw std::runtime_error("Save file is corrupt.");
+			}
+		}
+		if (world_blocks != 1) {
+			throw std::runtime_error("Save file is corrupt.");
+		}
+
+		(RebuildIndex(GetID<Components>()), ...);
+		(RelinkLoaded<Components>(), ...);
+	}
+
 	template <typename Component>
-	void Serialise(std::ofstream& file) {
+	void Serialise(std::ostream& file) {
 		// serialise component-type specific data (component pool, sparse array and packed array)
 		auto id = GetID<Component>();
 
+		// a shared component's values are written once, ahead of the refs which index them.
+		if constexpr (is_shared_ref_v<Component>) {
+			SharedStoreOf<typename Component::value_type>().serialise(file);
+		}
 		auto& pool = m_component_pools[id];
-		pool.get()->serialise<Component>(file);
+		pool.get()->template serialise<Component>(file);
 
-		auto& _sparse = m_sparse.at(id);
 		for (uint16_t i = 0; i < MAX_ENTITIES; i++) {
-			utils::serialiseUint32(file, static_cast<uint32_t>(_sparse.get()[i]));
+			utils::serialiseUint32(file, static_cast<uint32_t>(SparseIndex(id, i)));
 		}
 		auto& _packed = m_packed.at(id);
 		utils::serialiseUint32(file, static_cast<uint32_t>(_packed.size()));
-		std::for_each(_packed.begin(), _packed.end(), [&file](uint16_t e) {utils::serialiseUint32(file, static_cast<uint32_t>(e)); });
+		std::for_each(_packed.begin(), _packed.end(), [&file](uint16_t e) {utils::serialiseUint32(file, static_cast<uint32_t>(PackedEntityID(e))); });
+	}
+
+	template <typename Resource>
+	void SerialiseResource(std::ostream& file) {
+		/* Writes whether the World has the resource, and if so the resource itself. */
+		static_assert(std::is_base_of_v<ISerializeable, Resource>, "Resources are serialised through ISerializeable.");
+		auto* resource = GetResource<Resource>();
+		utils::serialiseUint8(file, resource != nullptr);
+		if (resource != nullptr) {
+			resource->serialise(file);
+		}
+	}
+
+	template <typename Resource>
+	void DeserialiseResource(const char* buffer, size_t& offset) {
+		if (utils::deserialiseUint8(buffer, offset)) {
+			SetResource<Resource>().deserialise(buffer, offset);
+		}
+		else {
+			RemoveResource<Resource>();
+		}
 	}
 
 	template <typename Component>
 	void Deserialise(const char* buffer, size_t& offset) {
 		// serialise component-type specific data (component pool, sparse array and packed array)
 		auto id = GetID<Component>();
+		ClearSnapshots();
 
+		if constexpr (is_shared_ref_v<Component>) {
+			SharedStoreOf<typename Component::value_type>().deserialise(buffer, offset);
+		}
 		auto& pool = m_component_pools[id];
-		pool.get()->deserialise<Component>(buffer, offset);
+		pool.get()->template deserialise<Component>(buffer, offset);
+		for (uint16_t i = 0; i < pool->num_elements; i++) {
+			pool->stamp(i, m_tick);
+		}
 
-		auto* _sparse = m_sparse.at(id).get();
+		// a hashed component's table is rebuilt from the packed array instead.
+		auto hashed = m_storage[id] == StoragePolicy::HASHED;
+		if (!hashed) {
+			m_sparse.at(id).resize(MAX_ENTITIES, MAX_ENTITIES + 1);
+		}
+		auto* _sparse = m_sparse.at(id).data();
 		for (uint16_t i = 0; i < MAX_ENTITIES; i++) {
-			_sparse[i] = static_cast<uint16_t>(utils::deserialiseUint32(buffer, offset));
+			auto packed_index = static_cast<uint16_t>(utils::deserialiseUint32(buffer, offset));
+			if (!hashed) {
+				_sparse[i] = packed_index;
+			}
 		}
 
 		auto& _packed = m_packed.at(id);
@@ -574,10 +3142,12 @@ public:
 		for (uint32_t i = 0; i < num_packed_elements; i++) {
 			_packed.push_back(static_cast<uint16_t>(utils::deserialiseUint32(buffer, offset)));
 		}
-
+		pool->num_active = pool->num_elements;
+		RebuildIndex(id);
+		RelinkLoaded<Component>();
 	}
 
-	void Serialise(std::ofstream& file) {
+	void Serialise(std::ostream& file) {
 		// serialise the component-type independent data
 		utils::serialiseUint32(file, static_cast<uint32_t>(m_entity_counter));
 		utils::serialiseUint32(file, static_cast<uint32_t>(m_free_entities.size()));
@@ -590,6 +3160,9 @@ public:
 
 	void Deserialise(const char* buffer, size_t& offset) {
 		// deserialise the component-type independent data
+		ClearSnapshots();
+		m_timers.clear();
+		EnableAll();
 		m_entity_counter = static_cast<uint16_t>(utils::deserialiseUint32(buffer, offset));
 		auto _num_free_entities = utils::deserialiseUint32(buffer, offset);
 		for (uint32_t i = 0; i < _num_free_entities; i++) {
@@ -600,4 +3173,48 @@ public:
 			m_entities[i] = utils::deserialiseUint32(buffer, offset);
 		}
 	}
+
+	void SerialiseTimers(std::ostream& file) {
+		/* Writes the pending KillAfter timers, as the entity and the ticks it has left. They aren't part 
+		*  of Serialise, so that saves from before timers existed still load - write them after the 
+		*  components and read them back with DeserialiseTimers once the rest has been loaded.
+		*/
+		utils::serialiseUint32(file, static_cast<uint32_t>(m_timers.size()));
+		m_timers.for_each([&file](const uint16_t, const uint32_t entity, const uint32_t remaining) {
+			utils::serialiseUint32(file, entity);
+			utils::serialiseUint32(file, remaining);
+		});
+	}
+
+	void DeserialiseTimers(const char* buffer, size_t& offset) {
+		m_timers.clear();
+		auto num_timers = utils::deserialiseUint32(buffer, offset);
+		for (uint32_t i = 0; i < num_timers; i++) {
+			auto entity = utils::deserialiseUint32(buffer, offset);
+			auto remaining = utils::deserialiseUint32(buffer, offset);
+			LoadTimer(entity, remaining);
+		}
+	}
 };
+
+inline void Signals<Hierarchy>::on_construct(World& world, const uint32_t entity, Hierarchy& hierarchy) {
+	world.AttachToHierarchy(entity, hierarchy);
+}
+
+inline void Signals<Hierarchy>::on_destroy(World& world, const uint32_t, Hierarchy& hierarchy) {
+	world.DetachFromHierarchy(hierarchy);
+}
+
+template <typename Component>
+void Signals<SharedRef<Component>>::on_construct(World& world, const uint32_t entity, SharedRef<Component>& ref) {
+	if (ref.store != nullptr && ref.store != &world.SharedStoreOf<Component>()) {
+		world.JoinShared(entity, ref, world.SharedStoreOf<Component>().intern(ref.store->value(ref.handle)));
+	}
+}
+
+template <typename Component>
+void Signals<SharedRef<Component>>::on_destroy(World& world, const uint32_t, SharedRef<Component>& ref) {
+	if (ref.store == &world.SharedStoreOf<Component>()) {
+		world.LeaveShared(ref);
+	}
+}